@@ -0,0 +1,99 @@
+// Connects and disconnects per second a hub sustains, each client
+// subscribing once before it hangs up, by number of io_contexts of the
+// hub's own (hub_options::io_contexts; 0 serves clients on a shared pool):
+//
+//   connect_storm [connections [io_context counts...]]
+#include <msghub.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace mh = msghublib;
+using boost::asio::ip::tcp;
+
+namespace {
+    constexpr int      nconnectors = 4;
+    constexpr uint16_t port        = 0xBEE;
+
+    // A protocol version 1 subscription, which needs no handshake
+    std::vector<char> subscribe_frame(std::string const& topic) {
+        std::vector<char> frame(7 + topic.size());
+        std::uint16_t const topiclen = topic.size(), bodylen = 0, magic = 0xF00D ^ (0x1 << 8);
+        std::memcpy(frame.data() + 0, &topiclen, 2);
+        std::memcpy(frame.data() + 2, &bodylen, 2);
+        frame[4] = 0; // subscribe
+        std::memcpy(frame.data() + 5, &magic, 2);
+        std::copy(topic.begin(), topic.end(), frame.begin() + 7);
+        return frame;
+    }
+
+    double run(std::size_t io_contexts, int nconnections)
+    {
+        unsigned const cpus = std::max(1u, std::thread::hardware_concurrency());
+        boost::asio::thread_pool io(io_contexts ? 1 : cpus);
+
+        mh::hub_options options;
+        options.io_contexts     = io_contexts;
+        options.pin_io_contexts = true;
+
+        mh::msghub hub(io.get_executor(), options);
+        hub.create(port);
+
+        auto const frame = subscribe_frame("storm");
+        std::atomic_int next{0}, failed{0};
+
+        auto const start = std::chrono::steady_clock::now();
+        std::vector<std::thread> connectors;
+        for (int c = 0; c < nconnectors; ++c) {
+            connectors.emplace_back([&] {
+                boost::asio::io_context ctx;
+                while (next++ < nconnections) {
+                    boost::system::error_code ec;
+                    tcp::socket s(ctx);
+                    s.connect({boost::asio::ip::address_v4::loopback(), port}, ec);
+                    if (!ec)
+                        write(s, boost::asio::buffer(frame), ec);
+                    if (ec)
+                        ++failed;
+                }
+            });
+        }
+        for (auto& t : connectors)
+            t.join();
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+        hub.stop();
+        io.join();
+
+        if (failed)
+            std::cerr << "io_contexts " << io_contexts << ": " << failed << " connections failed\n";
+        return nconnections / elapsed.count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int const nconnections = argc > 1 ? std::atoi(argv[1]) : 20'000;
+
+    std::vector<std::size_t> counts;
+    for (int i = 2; i < argc; ++i)
+        counts.push_back(std::atoi(argv[i]));
+    if (counts.empty())
+        counts = {0, 1, 2, 4};
+
+    std::cout << nconnections << " connections from " << nconnectors << " threads\n";
+    for (auto io_contexts : counts)
+        std::cout << "io_contexts " << std::setw(2) << io_contexts << ": " << std::fixed
+                  << std::setprecision(0) << run(io_contexts, nconnections) << " connects/s"
+                  << std::endl;
+}
@@ -0,0 +1,230 @@
+// Throughput and publish-to-deliver latency through a hub on this host,
+// for every combination of the parameters given:
+//
+//   msghub_bench [--payloads=64,1024] [--topics=1,64] [--subscribers=1,10,100]
+//                [--publishers=1,4] [--threads=2,4] [--messages=100000]
+//                [--rate=0] [--json=results.json]
+//
+// Every subscriber subscribes to every topic; publishers spread their share
+// of the messages over the topics, stamping each with the time it was
+// published. At a --rate (messages/s in all, 0 for flat out) a message is
+// stamped with the time it was due rather than sent, lest a stalled
+// publisher hide the latency it causes. A line per run goes to stderr, the
+// results as JSON to the file given or to stdout.
+#include <latency_histogram.h>
+#include <msghub.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/asio.hpp>
+
+namespace mh = msghublib;
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+    constexpr uint16_t port = 0xBEE;
+
+    struct scenario {
+        std::size_t payload, topics, subscribers, publishers, threads;
+        long        messages;
+        double      rate; // 0 for as fast as possible
+    };
+
+    struct result {
+        scenario                run;
+        long                    deliveries = 0;
+        double                  seconds    = 0;
+        mh::latency_histogram<> latency;
+    };
+
+    std::int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch())
+            .count();
+    }
+
+    // Connections from both ends live in this process
+    void raise_fd_limit() {
+        rlimit limit{};
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+            limit.rlim_cur = limit.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    void measure(result& r)
+    {
+        auto const& s = r.run;
+        boost::asio::thread_pool io(s.threads);
+
+        std::vector<std::string> topics;
+        for (std::size_t t = 0; t < s.topics; ++t)
+            topics.push_back("bench." + std::to_string(t));
+
+        mh::msghub hub(io.get_executor());
+        hub.create(port);
+
+        std::atomic<long> delivered{0}, synced{0};
+        std::vector<std::unique_ptr<mh::msghub>> subscribers;
+        for (std::size_t i = 0; i < s.subscribers; ++i) {
+            auto& sub = *subscribers.emplace_back(std::make_unique<mh::msghub>(io.get_executor()));
+            sub.connect("localhost", port);
+            for (auto& topic : topics) {
+                sub.subscribe(topic, [&](std::string_view, mh::span<char const> body) {
+                    std::int64_t stamp;
+                    std::memcpy(&stamp, body.data(), sizeof(stamp));
+                    r.latency.record(std::max<std::int64_t>(0, now_ns() - stamp));
+                    delivered.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            // subscriptions are handled in order: once this one is in, all are
+            sub.subscribe("bench.sync", [&](auto...) { synced.fetch_add(1); });
+        }
+
+        std::vector<std::unique_ptr<mh::msghub>> publishers;
+        for (std::size_t p = 0; p < s.publishers; ++p)
+            publishers.emplace_back(std::make_unique<mh::msghub>(io.get_executor()))->connect("localhost", port);
+
+        for (auto deadline = clock_type::now() + 30s;
+             synced < long(s.subscribers) && clock_type::now() < deadline;) {
+            synced = 0;
+            publishers.front()->publish("bench.sync", "");
+            std::this_thread::sleep_for(20ms);
+        }
+        synced = 0;
+
+        auto const start = clock_type::now();
+        std::vector<std::thread> publishing;
+        for (std::size_t p = 0; p < s.publishers; ++p) {
+            publishing.emplace_back([&, p] {
+                std::string body(std::max(s.payload, sizeof(std::int64_t)), '*');
+                auto const origin = now_ns();
+                for (long i = p; i < s.messages; i += s.publishers) {
+                    auto stamp = now_ns();
+                    if (s.rate > 0) {
+                        auto const due = origin + std::int64_t(double(i) * 1e9 / s.rate);
+                        if (due > stamp)
+                            std::this_thread::sleep_for(std::chrono::nanoseconds(due - stamp));
+                        stamp = due;
+                    }
+                    std::memcpy(body.data(), &stamp, sizeof(stamp));
+                    publishers[p]->publish(topics[i % topics.size()], body);
+                }
+            });
+        }
+        for (auto& t : publishing)
+            t.join();
+
+        long const expected = s.messages * long(s.subscribers);
+        while (delivered < expected && clock_type::now() - start < 60s)
+            std::this_thread::sleep_for(1ms);
+        r.seconds    = std::chrono::duration<double>(clock_type::now() - start).count();
+        r.deliveries = delivered;
+
+        for (auto& c : subscribers)
+            c->stop();
+        for (auto& c : publishers)
+            c->stop();
+        hub.stop();
+        io.join();
+    }
+
+    std::vector<std::size_t> list(std::string const& values) {
+        std::vector<std::size_t> out;
+        std::istringstream is(values);
+        for (std::string v; std::getline(is, v, ',');)
+            out.push_back(std::stoul(v));
+        return out;
+    }
+
+    void write_json(std::ostream& os, std::vector<std::unique_ptr<result>> const& results)
+    {
+        os << "{\n  \"cpus\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+        char const* sep = "\n";
+        for (auto const& r : results) {
+            auto const& s = r->run;
+            os << sep << std::fixed << std::setprecision(0)
+               << "    {\"payload\": " << s.payload << ", \"topics\": " << s.topics
+               << ", \"subscribers\": " << s.subscribers << ", \"publishers\": " << s.publishers
+               << ", \"threads\": " << s.threads << ", \"messages\": " << s.messages
+               << ", \"rate\": " << s.rate
+               << ", \"deliveries\": " << r->deliveries << ", \"seconds\": " << std::setprecision(6)
+               << r->seconds << std::setprecision(0)
+               << ", \"messages_per_sec\": " << s.messages / r->seconds
+               << ", \"deliveries_per_sec\": " << r->deliveries / r->seconds
+               << ", \"latency_ns\": {\"p50\": " << r->latency.percentile(0.5)
+               << ", \"p99\": " << r->latency.percentile(0.99)
+               << ", \"p99_9\": " << r->latency.percentile(0.999)
+               << ", \"max\": " << r->latency.max() << "}}";
+            sep = ",\n";
+        }
+        os << "\n  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::map<std::string, std::string> args{
+        {"payloads", "64,1024"}, {"topics", "1,64"}, {"subscribers", "1,10,100"},
+        {"publishers", "1,4"},   {"threads", "4"},   {"messages", "100000"},
+        {"rate", "0"},           {"json", ""},
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        auto const eq         = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos || !args.count(arg.substr(2, eq - 2))) {
+            std::cerr << "usage: see the top of msghub_bench.cpp\n";
+            return 1;
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+    raise_fd_limit();
+
+    long const messages = std::stol(args["messages"]);
+    double const rate   = std::stod(args["rate"]);
+    std::vector<std::unique_ptr<result>> results;
+    for (auto payload : list(args["payloads"]))
+        for (auto topics : list(args["topics"]))
+            for (auto subscribers : list(args["subscribers"]))
+                for (auto publishers : list(args["publishers"]))
+                    for (auto threads : list(args["threads"])) {
+                        auto& r = *results.emplace_back(std::make_unique<result>());
+                        r.run   = {payload, topics, subscribers, publishers, threads, messages, rate};
+                        measure(r);
+
+                        std::cerr << "payload " << payload << " topics " << topics << " subscribers "
+                                  << subscribers << " publishers " << publishers << " threads "
+                                  << threads << ": " << std::fixed << std::setprecision(0)
+                                  << messages / r.seconds << " msg/s, p50 "
+                                  << r.latency.percentile(0.5) / 1000 << "us p99 "
+                                  << r.latency.percentile(0.99) / 1000 << "us p99.9 "
+                                  << r.latency.percentile(0.999) / 1000 << "us";
+                        if (r.deliveries < messages * long(subscribers))
+                            std::cerr << " (" << r.deliveries << " of " << messages * long(subscribers)
+                                      << " delivered)";
+                        std::cerr << std::endl;
+                    }
+
+    if (auto const& path = args["json"]; !path.empty()) {
+        std::ofstream os(path);
+        write_json(os, results);
+    } else {
+        write_json(std::cout, results);
+    }
+}
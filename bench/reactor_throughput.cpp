@@ -0,0 +1,84 @@
+// Publications per second through a hub, one frame per publish, from one
+// publisher to several subscribers: the workload where the per-operation
+// system calls of the I/O backend show. Build a second tree with
+// -DMSGHUB_IO_URING=ON to compare io_uring to the default reactor:
+//
+//   reactor_throughput [threads [messages [subscribers]]]
+#include <msghub.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace mh = msghublib;
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr uint16_t port = 0xBEE;
+
+    char const* backend() {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+        return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+        return "epoll";
+#else
+        return "select";
+#endif
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned const threads = argc > 1 ? std::atoi(argv[1]) : std::max(2u, std::thread::hardware_concurrency());
+    int const nmessages    = argc > 2 ? std::atoi(argv[2]) : 200'000;
+    int const nsubscribers = argc > 3 ? std::atoi(argv[3]) : 4;
+
+    boost::asio::thread_pool io(threads);
+    std::atomic<long> received{0};
+
+    mh::msghub hub(io.get_executor());
+    hub.create(port);
+
+    std::vector<std::unique_ptr<mh::msghub>> subscribers;
+    for (int s = 0; s < nsubscribers; ++s) {
+        auto& sub = *subscribers.emplace_back(std::make_unique<mh::msghub>(io.get_executor()));
+        sub.connect("localhost", port);
+        sub.subscribe("bench", [&](std::string_view, mh::span<char const>) {
+            received.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    mh::msghub publisher(io.get_executor());
+    publisher.connect("localhost", port);
+    std::this_thread::sleep_for(200ms); // subscriptions
+
+    std::string const body(64, '*');
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nmessages; ++i)
+        publisher.publish("bench", body);
+
+    long const expected = long(nmessages) * nsubscribers;
+    while (received < expected && std::chrono::steady_clock::now() - start < 60s)
+        std::this_thread::sleep_for(1ms);
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+    for (auto& sub : subscribers)
+        sub->stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+
+    if (received < expected)
+        std::cerr << "only " << received << " of " << expected << " delivered\n";
+    std::cout << backend() << ", " << threads << " threads: " << std::fixed << std::setprecision(0)
+              << nmessages / elapsed.count() << " publications/s, "
+              << received / elapsed.count() << " deliveries/s" << std::endl;
+}
@@ -0,0 +1,100 @@
+// Throughput of a single publisher fanning out to several subscribers, by
+// number of shards (hub_options::shards):
+//
+//   shard_scaling [threads [messages [shard counts...]]]
+#include <msghub.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace mh = msghublib;
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr int      ntopics      = 64;
+    constexpr int      nsubscribers = 4;
+    constexpr uint16_t port         = 0xBEE;
+
+    double run(std::size_t shards, unsigned threads, int nmessages)
+    {
+        boost::asio::thread_pool io(threads);
+
+        mh::hub_options options;
+        options.shards = shards;
+
+        std::vector<std::string> topics;
+        for (int t = 0; t < ntopics; ++t)
+            topics.push_back("bench/" + std::to_string(t));
+
+        std::atomic<long> received{0};
+        mh::msghub hub(io.get_executor(), options);
+        hub.create(port);
+
+        std::vector<std::unique_ptr<mh::msghub>> subscribers;
+        for (int s = 0; s < nsubscribers; ++s) {
+            auto& sub = *subscribers.emplace_back(std::make_unique<mh::msghub>(io.get_executor()));
+            sub.connect("localhost", port);
+            for (auto& topic : topics)
+                sub.subscribe(topic, [&](std::string_view, mh::span<char const>) {
+                    received.fetch_add(1, std::memory_order_relaxed);
+                });
+        }
+
+        mh::msghub publisher(io.get_executor());
+        publisher.connect("localhost", port);
+        std::this_thread::sleep_for(200ms); // subscriptions
+
+        std::string const body(64, '*');
+        constexpr int batch = 256;
+        std::vector<mh::message_view> messages;
+
+        auto const start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nmessages; i += batch) {
+            messages.clear();
+            for (int j = i; j < std::min(i + batch, nmessages); ++j)
+                messages.emplace_back(topics[j % ntopics], body);
+            publisher.publish_batch(messages);
+        }
+
+        long const expected = long(nmessages) * nsubscribers;
+        while (received < expected && std::chrono::steady_clock::now() - start < 60s)
+            std::this_thread::sleep_for(1ms);
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+        for (auto& sub : subscribers)
+            sub->stop();
+        publisher.stop();
+        hub.stop();
+        io.join();
+
+        if (received < expected)
+            std::cerr << "shards " << shards << ": only " << received << " of " << expected << " delivered\n";
+        return received / elapsed.count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned const threads = argc > 1 ? std::atoi(argv[1]) : std::max(4u, std::thread::hardware_concurrency());
+    int const nmessages    = argc > 2 ? std::atoi(argv[2]) : 500'000;
+
+    std::vector<std::size_t> counts;
+    for (int i = 3; i < argc; ++i)
+        counts.push_back(std::atoi(argv[i]));
+    if (counts.empty())
+        counts = {0, 1, 2, 4, 8};
+
+    std::cout << threads << " threads, " << nmessages << " messages to " << nsubscribers
+              << " subscribers over " << ntopics << " topics\n";
+    for (auto shards : counts)
+        std::cout << "shards " << std::setw(2) << shards << ": " << std::fixed << std::setprecision(0)
+                  << run(shards, threads, nmessages) << " deliveries/s" << std::endl;
+}
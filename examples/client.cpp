@@ -6,6 +6,7 @@
 #include <iostream>
 #include <system_error>
 #include <thread>
+#include <vector>
 using namespace std::chrono_literals;
 using boost::filesystem::last_write_time;
 using boost::posix_time::from_time_t;
@@ -25,12 +26,14 @@ int main(int /*argc*/, char const** argv) {
         for (auto i = 0; i < 1'000; ++i) {
             ++batches;
             post(io, [&hub, n = i * 100] {
+                std::vector<std::pair<std::string_view, std::string>> batch;
+                for (int i = n; i < n + 100; ++i)
+                    batch.emplace_back("Publish", "message " + std::to_string(i));
+
                 mh::error_code ec;
-                for (int i = n; i < n + 100; ++i) {
-                    hub.publish("Publish", "message " + std::to_string(i), ec);
-                    if (ec) {
-                        std::cerr << "Couldn't publish message " << i << " (" << ec.message() << ")\n";
-                    }
+                hub.publish_batch(batch, ec);
+                if (ec) {
+                    std::cerr << "Couldn't publish messages " << n << ".." << n + 99 << " (" << ec.message() << ")\n";
                 }
                 --batches;
             });
@@ -31,12 +31,13 @@ namespace msghublib {
         }
     };
 
-    static inline error_category const& msghub_category() {
+    // one instance for the program: error codes compare categories by address
+    inline error_category const& msghub_category() {
         static constexpr struct msghub_category s_msghub_category_instance;
         return s_msghub_category_instance;
     };
 
-    [[maybe_unused]] static inline error_code make_error_code(hub_errc e) {
+    inline error_code make_error_code(hub_errc e) {
         return {e, msghub_category()};
     }
 }
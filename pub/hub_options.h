@@ -0,0 +1,131 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace msghublib {
+
+    // What happens when a connection's outbound queue reaches its limits
+    enum class slow_consumer_policy {
+        drop_newest,     // discard the frame being queued
+        drop_oldest,     // discard the oldest frames not yet being written
+        disconnect,      // close the connection
+        block_publisher, // stop reading from the publishers feeding it until
+                         // it drained to half the limits (hub side only;
+                         // frames are never dropped)
+    };
+
+    // Tuning knobs for a msghub instance. The defaults are suitable for most
+    // workloads; every field is independent.
+    struct hub_options {
+        // Outbound write coalescing: everything queued on a connection is
+        // drained into a single gathered write, up to these limits.
+        std::size_t max_write_bytes   = 256 * 1024;
+        std::size_t max_write_buffers = 64;
+        // Frames up to this size are copied into a contiguous staging area
+        // instead of occupying buffers of their own
+        std::size_t write_copy_threshold = 512;
+
+        // Size of the per-connection receive buffer; every complete frame in
+        // it is decoded per read
+        std::size_t read_buffer_size = 64 * 1024;
+
+        // Frames each connection keeps around for reuse, once written to
+        // all their subscribers; 0 disables pooling
+        std::size_t message_pool_size = 256;
+
+        // Largest publication accepted from a peer. Bodies that don't fit a
+        // single frame travel in fragments, which takes protocol version 2.
+        std::size_t max_message_size = 64 * 1024 * 1024;
+
+        // Highest wire protocol version to negotiate with peers. Version 2
+        // replaces topic names by per-connection aliases after first use.
+        unsigned max_protocol_version = 2;
+        // Bytes of the topics a connection keeps aliases for, in each
+        // direction. A peer defining more is disconnected; past it, topics
+        // are sent literally. Keep it alike on the hub and its clients.
+        std::size_t max_alias_bytes = 1024 * 1024;
+        // How long a client waits for the hub to answer its hello before it
+        // takes the hub for one speaking version 1. Large publications
+        // wait for the answer.
+        std::chrono::milliseconds hello_timeout{5000};
+
+        // Limits of every connection's outbound queue, 0 meaning unlimited
+        std::size_t          max_queue_bytes  = 0;
+        std::size_t          max_queue_frames = 0;
+        slow_consumer_policy slow_consumer    = slow_consumer_policy::drop_newest;
+
+        // Publications a client may have in flight before async_publish
+        // waits for credit from the hub, 0 meaning unlimited. The hub grants
+        // credit as it reads publications, but not while it pauses the
+        // client under block_publisher. Hubs that don't grant credit (the
+        // protocol version 1 ones) leave the window unlimited.
+        std::size_t          publish_window   = 0;
+
+        // Spreads the fan-out of publications from clients over this many
+        // shards by topic, each served by one thread at a time, so a single
+        // busy publisher keeps several threads busy. Order is kept per
+        // topic, not across topics. 0 fans out on the publisher's thread.
+        // The hub stops reading from a client with `shard_backlog` of its
+        // publications waiting in the shards, until they're down to half
+        // (0: never).
+        std::size_t shards        = 0;
+        std::size_t shard_backlog = 4096;
+
+        // Serves TCP clients on this many io_contexts of the hub's own, run
+        // by a thread each and each listening on the hub's port with
+        // SO_REUSEPORT: the kernel spreads connects over them, and a client
+        // stays on the one that accepted it for life. 0 serves them on the
+        // hub's executor. Optionally, the threads are pinned to CPUs round
+        // robin.
+        std::size_t io_contexts     = 0;
+        bool        pin_io_contexts = false;
+
+        // Publishes the hub's stats() on "$SYS.stats" this often, and the
+        // topics busiest since the previous report on "$SYS.topics", both as
+        // JSON, to local and remote subscribers alike. 0 never does.
+        std::chrono::milliseconds sys_interval{0};
+        std::size_t               sys_topics = 10; // topics per report
+
+        // Topics (and patterns) the hub keeps an entry for: those subscribed
+        // to, retained, persisted or conflated. Entries and their ids last
+        // as long as the instance, and each new one copies the index of
+        // topics, so this bounds a hub whose topics churn. Past it,
+        // subscribing to a new topic fails with no_buffer_space, a remote
+        // subscriber's is ignored, and new retained or persisted topics are
+        // only fanned out; all count as topics_refused. 0: no limit.
+        std::size_t max_topics = 1024 * 1024;
+
+        // Memory for the publications msghub::retain keeps; over it, the
+        // topics published to least recently lose theirs first
+        std::size_t retain_bytes = 16 * 1024 * 1024;
+
+        // Durable log of the topics msghub::persist names, a directory of
+        // segment files per topic under `log_directory` (empty: no log).
+        // A thread of its own appends to them, flushing to disk at most
+        // every `log_sync_interval` (0: after every batch it wrote), which
+        // bounds what a crash may lose. Once `log_backlog` appends are
+        // queued to it (0: never), connections publishing to persisted
+        // topics stop reading until it is through half of them, and
+        // msghub::publish to them waits.
+        std::string               log_directory;
+        std::size_t               log_segment_size = 16 * 1024 * 1024;
+        std::chrono::milliseconds log_sync_interval{100};
+        std::size_t               log_backlog = 64 * 1024;
+
+        // Traces publications end to end, for msghub::latency_by_topic():
+        // they carry timestamps taken at publish, hub receive, hub send and
+        // receive. Connections negotiate it, both ends must enable it, and
+        // it takes protocol version 2; large publications aren't traced.
+        // Off, it costs nothing on the wire and a branch per publication.
+        bool trace_latency = false;
+
+        // Shared memory transport ("shm:" endpoints, clients only): bytes in
+        // each direction, rounded up to a power of two, and how long either
+        // side polls for traffic before it sleeps. Polling keeps an io
+        // thread busy, trading a core for latency.
+        std::size_t              shm_ring_size = 1024 * 1024;
+        std::chrono::nanoseconds shm_busy_poll{0};
+    };
+
+} // namespace msghublib
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace msghublib {
+
+    // Point-in-time snapshot of the counters of a msghub instance
+    struct hub_stats {
+        // outbound write coalescing
+        std::uint64_t writes         = 0; // gathered write operations
+        std::uint64_t frames_written = 0;
+        std::uint64_t bytes_written  = 0;
+
+        // publications served by the hub, from clients and its own
+        std::uint64_t publications_in = 0;
+        std::uint64_t bytes_in        = 0;
+
+        // slow consumers
+        std::uint64_t frames_dropped          = 0;
+        std::uint64_t frames_conflated        = 0; // superseded while queued (or held)
+        std::uint64_t consumers_disconnected  = 0;
+        std::uint64_t publishers_paused       = 0;
+        std::uint64_t queue_high_water_frames = 0; // deepest queue seen
+        std::uint64_t queue_high_water_bytes  = 0;
+        std::uint64_t frames_queued           = 0; // in all outbound queues, now
+        std::uint64_t bytes_queued            = 0;
+
+        // clients of the hub
+        std::uint64_t connections_accepted = 0;
+        std::uint64_t connections_open     = 0;
+        std::uint64_t accept_errors        = 0; // failed accepts, retried
+
+        // subscriptions, now: topics (or patterns) subscribed to, and
+        // subscribers summed over them
+        std::uint64_t topics         = 0;
+        std::uint64_t subscriptions  = 0;
+        std::uint64_t topics_refused = 0; // past hub_options::max_topics
+
+        [[nodiscard]] double average_batch() const {
+            return writes ? double(frames_written) / double(writes) : 0.0;
+        }
+    };
+
+    // Per topic (or pattern) known to the hub
+    struct topic_stats {
+        std::string   topic;
+        std::uint64_t publications = 0; // served by the hub
+        std::uint64_t bytes        = 0;
+        std::uint64_t subscribers  = 0; // remote ones and this instance
+    };
+
+    // Distribution of a latency, in nanoseconds
+    struct latency_stats {
+        std::uint64_t count = 0;
+        std::uint64_t p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+    };
+
+    // Where the traced publications to a topic spent their time on the way
+    // to this instance's subscriber (see hub_options::trace_latency). Stages
+    // spanning hosts are only recorded if their clocks happen to agree.
+    struct topic_latency {
+        std::string   topic;
+        latency_stats to_hub;   // publish() until the hub read it: the publisher's queue and the network
+        latency_stats in_hub;   // until the hub wrote it (or invoked the hub's own subscriber):
+                                // fan-out and outbound queue
+        latency_stats from_hub; // until it was read here
+        latency_stats handler;  // the subscriber's callback
+    };
+
+} // namespace msghublib
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace msghublib {
+
+    // Latencies in nanoseconds, recorded from any thread, in HdrHistogram
+    // style buckets: 2^SubBits linear ones per power of two, so a percentile
+    // is off by less than 1/2^SubBits of its value.
+    template <unsigned SubBits = 6>
+    class latency_histogram
+    {
+      public:
+        void record(std::uint64_t ns) {
+            counts_[index(ns)].fetch_add(1, std::memory_order_relaxed);
+            auto seen = max_.load(std::memory_order_relaxed);
+            while (ns > seen && !max_.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+                ;
+        }
+
+        [[nodiscard]] std::uint64_t count() const {
+            std::uint64_t n = 0;
+            for (auto const& c : counts_)
+                n += c.load(std::memory_order_relaxed);
+            return n;
+        }
+
+        [[nodiscard]] std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+        // The least value at least `q` (0..1) of the recordings don't exceed,
+        // to the bucket's precision
+        [[nodiscard]] std::uint64_t percentile(double q) const {
+            auto const total = count();
+            if (!total)
+                return 0;
+
+            auto const rank = static_cast<std::uint64_t>(q * double(total) + 0.5);
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < counts_.size(); ++i) {
+                seen += counts_[i].load(std::memory_order_relaxed);
+                if (seen >= rank && seen)
+                    return std::min(upper(i), max());
+            }
+            return max();
+        }
+
+      private:
+        static constexpr std::size_t sub = std::size_t(1) << SubBits;
+
+        static std::size_t index(std::uint64_t v) {
+            if (v < sub)
+                return v;
+            unsigned const e = std::bit_width(v) - 1;
+            return (e - SubBits + 1) * sub + ((v >> (e - SubBits)) - sub);
+        }
+
+        // The largest value in bucket `i`
+        static std::uint64_t upper(std::size_t i) {
+            if (i < sub)
+                return i;
+            unsigned const e      = i / sub + SubBits - 1;
+            std::uint64_t const m = i % sub + sub;
+            return ((m + 1) << (e - SubBits)) - 1;
+        }
+
+        std::array<std::atomic<std::uint64_t>, (64 - SubBits + 1) * sub> counts_{};
+        std::atomic<std::uint64_t> max_{0};
+    };
+
+} // namespace msghublib
@@ -1,30 +1,109 @@
 #pragma once
 
 #include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <utility>
 #include <boost/asio.hpp>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 #include "hub_error.h"
+#include "hub_options.h"
+#include "hub_stats.h"
 #include "span.h"
 
 namespace msghublib {
 
+    // A publication, as passed to msghub::publish_batch
+    using message_view = std::pair<std::string_view, span<char const>>;
+
     class msghub
     {
       public:
         typedef std::function< void(std::string_view topic, span<char const> message) > onmessage;
+        // A piece of a message, at `offset` into its body of `total` bytes
+        typedef std::function< void(std::string_view topic, span<char const> chunk,
+                                    std::size_t offset, std::size_t total) > onchunk;
         
       public:
-        explicit msghub(boost::asio::any_io_executor);
+        explicit msghub(boost::asio::any_io_executor, hub_options = {});
         ~msghub();
 
         //void connect(const std::string& hostip, uint16_t port);
         void connect(const std::string& hostip, uint16_t port, error_code& ec);
         void create(uint16_t port, error_code& ec);
 
+        // By endpoint URI: "tcp:host:port", or for clients on the same host
+        // "unix:/path/to/socket" and, on Linux, "unix:@abstract-name". A hub
+        // can be created on one of each, and serves them alike. Malformed
+        // URIs fail with invalid_argument.
+        void connect(const std::string& endpoint, error_code& ec);
+        void create(const std::string& endpoint, error_code& ec);
+
         void unsubscribe(const std::string& topic, error_code& ec);
+        // Subscribing to a topic past hub_options::max_topics fails with
+        // no_buffer_space, likewise below.
+        //
+        // On the instance that created the hub, handlers are invoked from
+        // whichever thread delivers the publication: that of a publish()
+        // caller, or any of the hub's threads serving clients, shards and
+        // io_contexts. They may run concurrently with each other and with
+        // themselves, and may publish in turn, so they must be thread safe
+        // and reentrant. Elsewhere they run one at a time on the connection.
         void subscribe(const std::string& topic, onmessage handler, error_code& ec);
+        // Receives large messages piecewise, as their fragments arrive,
+        // instead of reassembled. Other messages arrive as a single chunk.
+        // Replaces the topic's onmessage handler, if any.
+        void subscribe_stream(const std::string& topic, onchunk handler, error_code& ec);
+        // For topics where only the latest value matters: a publication
+        // queued by the hub for this client and not being written yet is
+        // replaced by the next one to the same topic, rather than followed
+        // by it, so a slow client catches up at once. With a `min_interval`,
+        // the hub passes on at most one publication per topic per interval
+        // (the latest). On the hub's own instance it is a plain subscription.
+        void subscribe_conflated(const std::string& topic, onmessage handler,
+                                 std::chrono::milliseconds min_interval, error_code& ec);
+        // Keeps the last `depth` publications to `topic`, or to every topic
+        // matching it as a pattern, on the hub: a client subscribing gets
+        // them replayed first, then those that follow, none twice or
+        // missing. Within hub_options::retain_bytes; 0 stops retaining.
+        // Large publications aren't retained, and subscribers on the hub's
+        // own instance get no replay.
+        void retain(const std::string& topic, std::size_t depth = 1);
+        // Appends publications to `topic`, or to every topic matching it
+        // as a pattern, to the hub's durable log (hub_options::log_directory)
+        // for subscribe_from(), for as long as the hub lives. Topics logged
+        // by earlier runs can be replayed once persisted again. Without a
+        // log directory, fails with operation_not_supported. Large
+        // publications aren't logged.
+        void persist(const std::string& topic, error_code& ec);
+        // Subscribes, replaying first what the hub's log holds of `topic`
+        // (or of the topics matching it): from publication `sequence` on,
+        // counting each topic's publications from 0, or from those the hub
+        // served at `since` or later. A client that replayed a topic from
+        // `n` and received `k` publications resumes at `n + k`. Publications
+        // that follow come live, none twice or missing; in order per topic,
+        // not across topics. The replay is queued to the client at once,
+        // within the queue limits like any burst.
+        //
+        // Already subscribed, or subscribing on the hub's own instance, it
+        // is a plain subscription; likewise for topics that aren't logged.
+        void subscribe_from(const std::string& topic, onmessage handler, std::uint64_t sequence,
+                            error_code& ec);
+        void subscribe_from(const std::string& topic, onmessage handler,
+                            std::chrono::system_clock::time_point since, error_code& ec);
+        // On the instance that created the hub, handlers of local
+        // subscriptions are invoked in-process, from within publish(), while
+        // other threads may be invoking them too (see subscribe).
+        //
+        // Messages up to hub_options::max_message_size are accepted. Those
+        // that don't fit a single frame are sent in fragments, in between
+        // other traffic, so they may overtake or be overtaken by smaller
+        // messages. Only peers speaking protocol version 2 take them.
         void publish(std::string_view topic, span<char const> message, error_code& ec);
 
         // Treat string literals specially, not including the terminating NUL
@@ -34,14 +113,122 @@ namespace msghublib {
             publish(topic, span<char const>{literal, N-1}, ec);
         }
 
+        // Publishes all of `messages` with a single hand-off to the
+        // connection, carried in as few frames as they fit in by peers that
+        // speak protocol version 2. Order is kept per topic, but for
+        // messages too large for a frame: they go in fragments, out of that
+        // order, as with publish(). If any is too large even for that, none
+        // goes and it fails with message_size.
+        void publish_batch(span<message_view const> messages, error_code& ec);
+
+        // Any range of (topic, body) pairs
+        template <typename Range>
+            requires (!std::is_convertible_v<Range const&, span<message_view const>>)
+        void publish_batch(Range const& messages, error_code& ec) {
+            std::vector<message_view> views;
+            for (auto const& [topic, body] : messages)
+                views.emplace_back(topic, body);
+            publish_batch(views, ec);
+        }
+
+        // Asynchronous counterparts, taking any Asio completion token
+        // (callbacks, use_future, use_awaitable, ...) for a void(error_code)
+        // completion. Handlers run on their associated executor, never from
+        // within the initiating call.
+        template <typename CompletionToken>
+        auto async_connect(std::string hostip, uint16_t port, CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(error_code)>(
+                [this](auto handler, std::string const& hostip, uint16_t port) {
+                    initiate_connect(hostip, port, completion_for(std::move(handler)));
+                },
+                token, std::move(hostip), port);
+        }
+
+        template <typename CompletionToken>
+        auto async_connect(std::string endpoint, CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(error_code)>(
+                [this](auto handler, std::string const& endpoint) {
+                    initiate_connect(endpoint, completion_for(std::move(handler)));
+                },
+                token, std::move(endpoint));
+        }
+
+        // Complete once the request is queued to the hub, ahead of anything
+        // this instance sends later
+        template <typename CompletionToken>
+        auto async_subscribe(std::string topic, onmessage handler, CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(error_code)>(
+                [this](auto completion, std::string const& topic, onmessage handler) {
+                    initiate_subscribe(topic, std::move(handler), completion_for(std::move(completion)));
+                },
+                token, std::move(topic), std::move(handler));
+        }
+
+        template <typename CompletionToken>
+        auto async_unsubscribe(std::string topic, CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(error_code)>(
+                [this](auto handler, std::string const& topic) {
+                    initiate_unsubscribe(topic, completion_for(std::move(handler)));
+                },
+                token, std::move(topic));
+        }
+
+        // Completes once the message was accepted within the publish window
+        // (hub_options::publish_window). `topic` and `message` are copied
+        // when the operation is initiated.
+        template <typename CompletionToken>
+        auto async_publish(std::string_view topic, span<char const> message, CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(error_code)>(
+                [this](auto handler, std::string_view topic, span<char const> message) {
+                    initiate_publish(topic, message, completion_for(std::move(handler)));
+                },
+                token, topic, message);
+        }
+
+        // Treat string literals specially, not including the terminating NUL
+        template <size_t N, typename CompletionToken>
+        auto async_publish(std::string_view topic, char const (&literal)[N], CompletionToken&& token) {
+            static_assert(N>0);
+            return async_publish(topic, span<char const>{literal, N-1},
+                                 std::forward<CompletionToken>(token));
+        }
+
         void stop();
 
+        using executor_type = boost::asio::any_io_executor;
+        [[nodiscard]] executor_type get_executor() const;
+        [[nodiscard]] hub_stats     stats() const;
+        // Per topic subscribed to, when this instance is the hub. Topics only
+        // wildcard subscriptions take aren't tracked one by one.
+        [[nodiscard]] std::vector<topic_stats> stats_by_topic() const;
+        // Per topic traced publications reached this instance's subscribers
+        // on, likewise
+        [[nodiscard]] std::vector<topic_latency> latency_by_topic() const;
+
         // convenience throwing wrappers
         void connect(const std::string& hostip, uint16_t port);
         void create(uint16_t port);
+        void connect(const std::string& endpoint);
+        void create(const std::string& endpoint);
         void unsubscribe(const std::string& topic);
         void subscribe(const std::string& topic, onmessage handler);
+        void subscribe_stream(const std::string& topic, onchunk handler);
+        void subscribe_conflated(const std::string& topic, onmessage handler,
+                                 std::chrono::milliseconds min_interval = {});
+        void persist(const std::string& topic);
+        void subscribe_from(const std::string& topic, onmessage handler, std::uint64_t sequence);
+        void subscribe_from(const std::string& topic, onmessage handler,
+                            std::chrono::system_clock::time_point since);
         void publish(std::string_view topic, span<char const> message);
+        void publish_batch(span<message_view const> messages);
+
+        template <typename Range>
+            requires (!std::is_convertible_v<Range const&, span<message_view const>>)
+        void publish_batch(Range const& messages) {
+            error_code ec;
+            publish_batch(messages, ec);
+            if (ec) throw system_error(ec);
+        }
 
         // Treat string literals specially, not including the terminating NUL
         template <size_t N>
@@ -52,6 +239,26 @@ namespace msghublib {
         }
         
       private:
+        // Type-erased handler, invoked on its associated executor
+        using completion = std::function<void(error_code)>;
+
+        template <typename Handler> completion completion_for(Handler handler) const {
+            auto work = boost::asio::prefer(
+                boost::asio::get_associated_executor(handler, get_executor()),
+                boost::asio::execution::outstanding_work.tracked);
+            auto shared = std::make_shared<Handler>(std::move(handler));
+
+            return [shared, work](error_code ec) {
+                boost::asio::post(work, [shared, ec] { std::move(*shared)(ec); });
+            };
+        }
+
+        void initiate_connect(const std::string& hostip, uint16_t port, completion);
+        void initiate_connect(const std::string& endpoint, completion);
+        void initiate_subscribe(const std::string& topic, onmessage handler, completion);
+        void initiate_unsubscribe(const std::string& topic, completion);
+        void initiate_publish(std::string_view topic, span<char const> message, completion);
+
         class impl;
         std::shared_ptr<impl> pimpl;
     };
@@ -0,0 +1,40 @@
+#include "conflation.h"
+
+#include <algorithm>
+
+namespace msghublib::detail {
+
+    bool conflation_rules::subscribe(std::string_view topic, std::optional<interval> conflation)
+    {
+        auto rule = std::find_if(rules_.begin(), rules_.end(),
+                                 [&](auto const& r) { return r.first == topic; });
+        if (rule == rules_.end() && !conflation)
+            return false; // the common case
+
+        if (rule == rules_.end())
+            rules_.emplace_back(topic, *conflation);
+        else if (conflation)
+            rule->second = *conflation;
+        else
+            rules_.erase(rule);
+
+        trie_ = {};
+        for (topic_id i = 0; i < rules_.size(); ++i)
+            trie_.insert(rules_[i].first, i);
+        cache_.clear();
+        return true;
+    }
+
+    std::optional<conflation_rules::interval> conflation_rules::lookup(topic_id id, std::string_view topic)
+    {
+        auto [cached, fresh] = cache_.try_emplace(id);
+        if (fresh) {
+            for (auto rule : trie_.match(topic)) {
+                auto& least = cached->second;
+                least = least ? std::min(*least, rules_[rule].second) : rules_[rule].second;
+            }
+        }
+        return cached->second;
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "topicregistry.h"
+#include "topictrie.h"
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace msghublib::detail {
+
+// The subscriptions a client asked the hub to conflate (see
+// msghub::subscribe_conflated), by topic or pattern. A publication matching
+// several of the client's subscriptions is conflated if any of them is, at
+// the least interval among those. Lookups are cached by topic id.
+class conflation_rules
+{
+  public:
+    using interval = std::chrono::milliseconds;
+
+    // A subscription to `topic`, conflated or not, replaces any before it.
+    // Returns whether that changed the rules.
+    bool subscribe(std::string_view topic, std::optional<interval> conflation);
+    bool unsubscribe(std::string_view topic) { return subscribe(topic, std::nullopt); }
+
+    [[nodiscard]] bool empty() const { return rules_.empty(); }
+    // Whether publications to `topic`, interned as `id`, are conflated
+    [[nodiscard]] std::optional<interval> lookup(topic_id id, std::string_view topic);
+
+  private:
+    std::vector<std::pair<std::string, interval>>         rules_;
+    topic_trie                                            trie_; // by rule index
+    std::unordered_map<topic_id, std::optional<interval>> cache_;
+};
+
+}  // namespace msghublib::detail
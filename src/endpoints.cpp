@@ -0,0 +1,50 @@
+#include "endpoints.h"
+
+#include <boost/asio/error.hpp>
+#include <charconv>
+
+namespace msghublib::detail {
+
+    endpoint parse_endpoint(std::string_view uri, boost::system::error_code& ec)
+    {
+        ec = {};
+        auto scheme = [&uri](std::string_view prefix) {
+            if (uri.substr(0, prefix.size()) != prefix)
+                return false;
+            uri.remove_prefix(prefix.size());
+            return true;
+        };
+
+        auto local = [&]() -> local_endpoint {
+            if (uri.empty() || uri.size() >= sizeof(sockaddr_un::sun_path)) {
+                ec = boost::asio::error::invalid_argument;
+                return {};
+            }
+            if (uri.front() != '@')
+                return local_endpoint(uri);
+
+            std::string abstract(uri); // a leading NUL selects the namespace
+            abstract.front() = '\0';
+            return local_endpoint(abstract);
+        };
+
+        if (scheme("unix:"))
+            return local();
+        if (scheme("shm:"))
+            return shm_endpoint{local()};
+
+        if (scheme("tcp:")) {
+            auto const colon = uri.rfind(':');
+            auto const port  = colon == uri.npos ? uri : uri.substr(colon + 1);
+
+            tcp_endpoint result{std::string(uri.substr(0, colon == uri.npos ? 0 : colon)), 0};
+            auto [end, err] = std::from_chars(port.data(), port.data() + port.size(), result.port);
+            if (err == std::errc() && end == port.data() + port.size() && !port.empty())
+                return result;
+        }
+
+        ec = boost::asio::error::invalid_argument;
+        return {};
+    }
+
+}  // namespace msghublib::detail
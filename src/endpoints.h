@@ -0,0 +1,31 @@
+#pragma once
+
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace msghublib::detail {
+
+// Endpoint URIs accepted by msghub::create and msghub::connect:
+//
+//   unix:/run/msghub.sock   Unix domain socket at a path
+//   unix:@msghub            in the abstract namespace (Linux)
+//   shm:/run/msghub.sock    shared memory, set up through a Unix domain
+//   shm:@msghub             socket; to create, the same as unix:
+//   tcp:host:port           TCP; to create, the host is optional
+struct tcp_endpoint {
+    std::string   host;
+    std::uint16_t port;
+};
+using local_endpoint = boost::asio::local::stream_protocol::endpoint;
+struct shm_endpoint {
+    local_endpoint control;
+};
+using endpoint = std::variant<tcp_endpoint, local_endpoint, shm_endpoint>;
+
+endpoint parse_endpoint(std::string_view uri, boost::system::error_code& ec);
+
+}  // namespace msghublib::detail
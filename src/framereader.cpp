@@ -0,0 +1,27 @@
+#include "framereader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace msghublib::detail {
+
+    framereader::framereader(std::size_t capacity, std::size_t max_alias_bytes)
+        // always room for a maximum size frame behind a partial one
+        : buffer_(std::max<std::size_t>(capacity, 2 * hubmessage::messagesize))
+        , decoder_(max_alias_bytes)
+    {}
+
+    boost::asio::mutable_buffer framereader::prepare()
+    {
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        } else if (buffer_.size() - end_ < hubmessage::messagesize) {
+            // move the partial frame to the front so it can be completed
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        return boost::asio::buffer(buffer_.data() + end_, buffer_.size() - end_);
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "wireprotocol.h"
+
+#include <boost/asio/buffer.hpp>
+#include <utility>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Receive side framing shared by hubclient and hubconnection. Socket reads
+// land in one large buffer and every complete frame found there is decoded
+// per wakeup, so a burst of small messages costs a single read and a single
+// completion handler instead of two of each per message.
+class framereader
+{
+  public:
+    framereader(std::size_t capacity, std::size_t max_alias_bytes);
+
+    // Free space at the tail of the buffer, to read into
+    boost::asio::mutable_buffer prepare();
+    // Marks `n` bytes at the tail as received
+    void commit(std::size_t n) { end_ += n; }
+
+    // Decodes all complete frames received so far, invoking `f` with each in
+    // turn. The message passed is only valid for the duration of the call.
+    // Returns false if a corrupt frame was encountered; the stream is
+    // unusable after that.
+    template <typename F> bool consume(F&& f) {
+        while (begin_ != end_) {
+            auto n = decoder_.decode({buffer_.data() + begin_, end_ - begin_}, current_);
+            if (n == frame_decoder::corrupt)
+                return false;
+            if (!n)
+                break; // incomplete
+
+            begin_ += n;
+            f(std::as_const(current_));
+        }
+        return true;
+    }
+
+  private:
+    std::vector<char> buffer_;
+    std::size_t       begin_ = 0, end_ = 0;
+    frame_decoder     decoder_;
+    hubmessage        current_;
+};
+
+}  // namespace msghublib::detail
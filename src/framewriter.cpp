@@ -0,0 +1,52 @@
+#include "framewriter.h"
+
+namespace msghublib::detail {
+
+    framewriter::buffers_t framewriter::gather(hubmessage_queue const& queue)
+    {
+        staging_.clear();
+        segments_.clear();
+        frames_ = bytes_ = 0;
+
+        // extends the trailing staged segment up to the end of the staging
+        // area, or starts a new one at `from`
+        auto stage = [this](std::size_t from) {
+            if (!segments_.empty() && !segments_.back().data)
+                segments_.back().size = staging_.size() - segments_.back().offset;
+            else
+                segments_.push_back({nullptr, from, staging_.size() - from});
+        };
+
+        for (auto const& msg : queue) {
+            // a frame adds at most two segments
+            if (frames_ && (bytes_ >= options_.max_write_bytes ||
+                            segments_.size() + 2 > options_.max_write_buffers))
+                break;
+
+            std::size_t const start = staging_.size();
+            auto const tail = encoder_.encode(*msg, staging_);
+
+            std::size_t const size = staging_.size() - start + tail.size();
+
+            if (size <= options_.write_copy_threshold) {
+                staging_.insert(staging_.end(), tail.begin(), tail.end());
+                stage(start);
+            } else {
+                stage(start);
+                segments_.push_back({tail.data(), 0, tail.size()});
+            }
+
+            ++frames_;
+            bytes_ += size;
+        }
+
+        // the staging area is complete, now buffers can point into it
+        buffers_.clear();
+        for (auto const& seg : segments_) {
+            buffers_.emplace_back(seg.data ? seg.data : staging_.data() + seg.offset, seg.size);
+        }
+
+        return {buffers_.data(), buffers_.size()};
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "hub_options.h"
+#include "wireprotocol.h"
+
+#include <boost/asio/buffer.hpp>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Coalesces the frames queued on a connection into a single gathered write.
+// Frames are encoded on the fly; frames up to `write_copy_threshold` bytes
+// are copied into a contiguous staging area, of larger ones only the header
+// is, and the payload is referenced in place. That is safe because the
+// queue keeps them alive until the write completes.
+class framewriter
+{
+  public:
+    using buffers_t = span<boost::asio::const_buffer const>;
+
+    framewriter(hub_options const& options, frame_encoder::aliasing aliasing)
+        : options_(options), encoder_(aliasing, options.max_alias_bytes) {}
+
+    // Prepares a write covering as many frames from the front of `queue` as
+    // the configured limits allow (at least one). The returned view stays
+    // valid until the next call.
+    buffers_t gather(hubmessage_queue const& queue);
+
+    // Extent of the batch prepared by the last gather()
+    [[nodiscard]] std::size_t frames() const { return frames_; }
+    [[nodiscard]] std::size_t bytes()  const { return bytes_;  }
+
+    // Framing applies to frames gathered from now on
+    void set_protocol_version(unsigned v) { encoder_.set_version(v); }
+    [[nodiscard]] unsigned protocol_version() const { return encoder_.version(); }
+    void set_tracing(bool on) { encoder_.set_tracing(on); }
+
+  private:
+    // part of the write: either staged (`data` is null, `offset` into the
+    // staging area) or referenced in place
+    struct segment {
+        char const* data;
+        std::size_t offset, size;
+    };
+
+    hub_options const&                     options_;
+    frame_encoder                          encoder_;
+    std::vector<char>                      staging_;
+    std::vector<segment>                   segments_;
+    std::vector<boost::asio::const_buffer> buffers_;
+    std::size_t                            frames_ = 0;
+    std::size_t                            bytes_  = 0;
+};
+
+}  // namespace msghublib::detail
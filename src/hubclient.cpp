@@ -1,81 +1,526 @@
 #include "hubclient.h"
+#include "hubcounters.h"
+#include "wireprotocol.h"
+
+#include <algorithm>
+#include <iterator>
 
 namespace msghublib::detail {
     using boost::asio::ip::tcp;
 
     auto hubclient::bind(void (hubclient::*handler)(error_code)) {
 #pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
-        return [=, self = shared_from_this()](error_code ec, size_t /*transferred*/) {
+        return recycled(recycler_, [=, self = shared_from_this()](error_code ec, size_t /*transferred*/) {
             (this->*handler)(ec);
-        };
+        });
+    }
+
+    auto hubclient::bind(void (hubclient::*handler)(error_code, size_t)) {
+        return recycled(recycler_, [=, self = shared_from_this()](error_code ec, size_t transferred) {
+            (this->*handler)(ec, transferred);
+        });
     }
 
-    tcp::socket& hubclient::socket() {
+    hubclient::~hubclient()
+    {
+        if (started_)
+            counters_->local().connections_closed.fetch_add(1, std::memory_order_relaxed);
+        release_waiting(); // we won't drain anymore
+    }
+
+    hubclient::socket_type& hubclient::socket() {
         return socket_;
     }
 
     void hubclient::start()
     {
-        // First read tiny header for verification
-        async_read(socket_, inmsg_.header_buf(), bind(&hubclient::handle_read_header));
+        // clients on the same host may hand us a shared memory stream
+        error_code ec;
+        fds_expected_ = socket_.local_endpoint(ec).protocol().family() == AF_UNIX;
+        started_      = true;
+        counters_->local().connections_accepted.fetch_add(1, std::memory_order_relaxed);
+        do_read();
     }
 
     void hubclient::stop()
     {
         post(socket_.get_executor(), [this, self=shared_from_this()]{
             socket_.cancel();
+            throttle_timer_.cancel();
+        });
+    }
+
+    void hubclient::close()
+    {
+        error_code ignored;
+        socket_.close(ignored);
+        throttle_timer_.cancel();
+        if (shm_)
+            shm_->close();
+        release_waiting();
+    }
+
+    bool hubclient::send(shared_hubmessage msg)
+    {
+        post(socket_.get_executor(), recycled(recycler_, [this, msg = std::move(msg), self=shared_from_this()] () mutable {
+            enqueue(std::move(msg));
+        }));
+
+        return !(distributor_.options().slow_consumer == slow_consumer_policy::block_publisher &&
+                 outmsg_queue_.congested());
+    }
+
+    bool hubclient::send(shared_large_message msg)
+    {
+        post(socket_.get_executor(), [this, msg = std::move(msg), self=shared_from_this()] () mutable {
+            if (!socket_.is_open())
+                return;
+            if (writer_.protocol_version() < 2) {
+                counters_->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // held back during a replay like small ones
+            if (!replaying_.empty() && msg->topic_id) {
+                if (auto r = replaying_.find(*msg->topic_id); r != replaying_.end())
+                    return settle(outmsg_queue_.hold(r->second.held, {nullptr, std::move(msg)}, inflight_));
+            }
+            settle(outmsg_queue_.push_bulk(std::move(msg), inflight_));
+        });
+
+        return !(distributor_.options().slow_consumer == slow_consumer_policy::block_publisher &&
+                 outmsg_queue_.congested());
+    }
+
+    void hubclient::wait_for(std::shared_ptr<hubclient> const& subscriber)
+    {
+        // from a shard, we may be reading already: we stop after that read
+        if (!socket_.get_executor().running_in_this_thread()) {
+            post(socket_.get_executor(), [subscriber, self = shared_from_this()] {
+                self->wait_for(subscriber);
+            });
+            return;
+        }
+
+        pause();
+        post(subscriber->socket_.get_executor(),
+             [subscriber, self = shared_from_this()]() mutable {
+                 subscriber->release_when_drained(std::move(self));
+             });
+    }
+
+    void hubclient::pause()
+    {
+        if (!socket_.get_executor().running_in_this_thread()) {
+            post(socket_.get_executor(), [self = shared_from_this()] { self->pause(); });
+            return;
+        }
+
+        if (!std::exchange(paused_, true))
+            counters_->local().publishers_paused.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void hubclient::release_when_drained(std::shared_ptr<hubclient> publisher)
+    {
+        if (outmsg_queue_.drained() || !socket_.is_open())
+            publisher->resume();
+        else
+            waiting_.push_back(std::move(publisher));
+    }
+
+    void hubclient::release_waiting()
+    {
+        for (auto& publisher : waiting_)
+            publisher->resume();
+        waiting_.clear();
+    }
+
+    void hubclient::resume()
+    {
+        post(socket_.get_executor(), [this, self = shared_from_this()] {
+            if (std::exchange(paused_, false) && !reading_ && !backlogged()) {
+                grant();
+                do_read();
+            }
+        });
+    }
+
+    bool hubclient::backlogged()
+    {
+        auto const limit = distributor_.options().shard_backlog;
+        if (!limit || backlog_.load() < limit)
+            return false;
+
+        if (!backlog_paused_.exchange(true))
+            counters_->local().publishers_paused.fetch_add(1, std::memory_order_relaxed);
+        // unless the shards got through it meanwhile
+        return !(backlog_.load() <= limit / 2 && backlog_paused_.exchange(false));
+    }
+
+    void hubclient::fanned_out()
+    {
+        auto const left = backlog_.fetch_sub(1) - 1;
+        if (left > distributor_.options().shard_backlog / 2 || !backlog_paused_.exchange(false))
+            return;
+
+        post(socket_.get_executor(), [this, self = shared_from_this()] {
+            if (!paused_ && !reading_ && socket_.is_open()) {
+                grant();
+                do_read();
+            }
+        });
+    }
+
+    void hubclient::enqueue(shared_hubmessage msg)
+    {
+        if (!socket_.is_open())
+            return;
+
+        if (!replaying_.empty() && msg->topic_id() && msg->publication()) {
+            if (auto r = replaying_.find(*msg->topic_id()); r != replaying_.end())
+                return settle(outmsg_queue_.hold(r->second.held, {std::move(msg), nullptr}, inflight_));
+        }
+        admit(std::move(msg));
+    }
+
+    void hubclient::admit(shared_hubmessage msg)
+    {
+        if (!conflation_.empty() && msg->get_action() == hubmessage::action::publish &&
+            msg->topic_id()) {
+            if (auto interval = conflation_.lookup(*msg->topic_id(), msg->topic()))
+                return conflate(std::move(msg), *interval);
+        }
+        settle(outmsg_queue_.push(std::move(msg), inflight_));
+    }
+
+    void hubclient::settle(outbound_queue::verdict verdict)
+    {
+        if (verdict == outbound_queue::verdict::overflow) {
+            // slow consumer, hang up
+            close();
+            outmsg_queue_.discard(inflight_);
+            outmsg_queue_.discard_bulk();
+            for (auto& [id, r] : replaying_)
+                for (auto& msg : r.held)
+                    outmsg_queue_.unhold(msg);
+            replaying_.clear();
+            return;
+        }
+
+        if (!inflight_ && (!outmsg_queue_.empty() || outmsg_queue_.bulk_pending()))
+        {
+            do_write();
+        }
+    }
+
+    void hubclient::begin_replay(std::vector<std::uint32_t> topics)
+    {
+        post(socket_.get_executor(), [this, topics = std::move(topics), self = shared_from_this()] {
+            for (auto id : topics)
+                ++replaying_[id].replays;
+        });
+    }
+
+    void hubclient::send_replayed(std::vector<shared_hubmessage> batch)
+    {
+        replayed_pending_.fetch_add(batch.size(), std::memory_order_relaxed);
+        post(socket_.get_executor(), [this, batch = std::move(batch), self = shared_from_this()]() mutable {
+            std::move(batch.begin(), batch.end(), std::back_inserter(replayed_));
+            feed_replayed();
+        });
+    }
+
+    void hubclient::feed_replayed()
+    {
+        // the replay is paced, not policed; held publications wait for it
+        std::size_t fed = 0;
+        for (; !replayed_.empty() && (!socket_.is_open() || outmsg_queue_.has_room()); ++fed) {
+            if (socket_.is_open())
+                admit(std::move(replayed_.front()));
+            replayed_.pop_front();
+        }
+        if (fed)
+            replayed_pending_.fetch_sub(fed, std::memory_order_release);
+    }
+
+    bool hubclient::replay_ready() const
+    {
+        // a batch's worth queued at most, whatever the limits
+        return !replayed_pending_.load(std::memory_order_acquire) && outmsg_queue_.caught_up(256);
+    }
+
+    void hubclient::end_replay(std::vector<std::uint32_t> topics)
+    {
+        post(socket_.get_executor(), [this, topics = std::move(topics), self = shared_from_this()] {
+            for (auto id : topics) {
+                auto r = replaying_.find(id);
+                if (r == replaying_.end() || --r->second.replays)
+                    continue;
+                auto held = std::move(r->second.held);
+                replaying_.erase(r);
+                for (auto& msg : held) {
+                    outmsg_queue_.unhold(msg);
+                    if (!socket_.is_open())
+                        continue;
+                    if (msg.frame)
+                        admit(std::move(msg.frame));
+                    else
+                        settle(outmsg_queue_.push_bulk(std::move(msg.large), inflight_));
+                }
+            }
         });
     }
 
-    void hubclient::send(const hubmessage& msg)
+    void hubclient::update_conflation(hubmessage const& msg)
+    {
+        auto const conflation = msg.get_action() == hubmessage::action::subscribe
+            ? wire::subscription_of(msg).conflation
+            : std::nullopt;
+
+        // throttles are only ever lifted early, a publication held back
+        // never falls behind a later one
+        if (conflation_.subscribe(msg.topic(), conflation))
+            release_held();
+    }
+
+    void hubclient::conflate(shared_hubmessage msg, conflation_rules::interval interval)
     {
-        post(socket_.get_executor(), [this, msg, self=shared_from_this()] () mutable {
-            bool write_in_progress = !outmsg_queue_.empty();
-            outmsg_queue_.push_back(std::move(msg));
-            if (!write_in_progress)
-            {
-                async_write(socket_,
-                    outmsg_queue_.front().on_the_wire(),
-                    bind(&hubclient::handle_write));
+        // the one pending, if any, is stale now
+        if (outmsg_queue_.replace(msg, inflight_))
+            return;
+
+        if (interval.count()) {
+            auto const now = std::chrono::steady_clock::now();
+            auto& t = throttled_[*msg->topic_id()];
+            t.interval = interval;
+            if (now < t.next) {
+                if (std::exchange(t.held, std::move(msg)))
+                    counters_->local().frames_conflated.fetch_add(1, std::memory_order_relaxed);
+                throttle(t.next);
+                return;
             }
+            t.next = now + interval;
+        }
+        settle(outmsg_queue_.push_conflated(std::move(msg), inflight_));
+    }
+
+    void hubclient::throttle(std::chrono::steady_clock::time_point until)
+    {
+        if (throttling_ && throttle_timer_.expiry() <= until)
+            return;
+
+        throttling_ = true;
+        throttle_timer_.expires_at(until);
+        throttle_timer_.async_wait([this, self = shared_from_this()](error_code ec) {
+            if (ec == boost::asio::error::operation_aborted)
+                return; // set anew, or closed
+            throttling_ = false;
+            release_throttled();
         });
     }
 
-    void hubclient::handle_read_header(error_code error)
+    void hubclient::release_throttled()
+    {
+        auto const now = std::chrono::steady_clock::now();
+        std::optional<std::chrono::steady_clock::time_point> next;
+
+        for (auto it = throttled_.begin(); it != throttled_.end() && socket_.is_open();) {
+            auto& t = it->second;
+            if (t.held && t.next <= now) {
+                t.next = now + t.interval;
+                settle(outmsg_queue_.push_conflated(std::move(t.held), inflight_));
+            }
+
+            if (t.held)
+                next = next ? std::min(*next, t.next) : t.next;
+            if (!t.held && t.next <= now)
+                it = throttled_.erase(it); // idle, forget it
+            else
+                ++it;
+        }
+
+        if (next)
+            throttle(*next);
+    }
+
+    void hubclient::release_held()
+    {
+        for (auto& [id, t] : throttled_) {
+            if (t.held && socket_.is_open())
+                settle(outmsg_queue_.push_conflated(std::move(t.held), inflight_));
+        }
+        throttled_.clear();
+    }
+
+    void hubclient::do_write()
+    {
+        // Drain as much of the queue as fits in one gathered write, with at
+        // most one fragment of a large publication
+        outmsg_queue_.feed_bulk();
+        if (shm_)
+            shm_->async_write(writer_.gather(outmsg_queue_.frames()), bind(&hubclient::handle_write));
+        else
+            async_write(socket_, writer_.gather(outmsg_queue_.frames()), bind(&hubclient::handle_write));
+        inflight_ = writer_.frames();
+    }
+
+    void hubclient::do_read()
+    {
+        reading_ = true;
+        if (shm_)
+            shm_->async_read_some(reader_.prepare(), bind(&hubclient::handle_read));
+        else if (fds_expected_)
+            socket_.async_wait(socket_type::wait_read, recycled(recycler_, [this, self = shared_from_this()](error_code ec) {
+                receive_with_fds(ec);
+            }));
+        else
+            socket_.async_read_some(reader_.prepare(), bind(&hubclient::handle_read));
+    }
+
+    void hubclient::receive_with_fds(error_code error)
     {
-        if (!error && inmsg_.verify()) {
-            // read decoded payload size
-            async_read(socket_, inmsg_.payload_area(), bind(&hubclient::handle_read_body));
+        std::size_t transferred = 0;
+        if (!error) {
+            transferred = detail::receive_with_fds(socket_.native_handle(), reader_.prepare(),
+                                                   received_fds_, error);
+            if (error == boost::asio::error::would_block)
+                return do_read();
+            // the descriptors come with the first frame, if at all
+            fds_expected_ = false;
+        }
+        handle_read(error, transferred);
+    }
+
+    bool hubclient::attach(hubmessage const& transport)
+    {
+        if (shm_ || received_fds_.size() != 3) {
+            close(); // the client would wait for us on a stream we don't have
+            return false;
+        }
+
+        error_code ec;
+        shm_stream::handles const handles{std::move(received_fds_[0]), std::move(received_fds_[1]),
+                                          std::move(received_fds_[2])};
+        received_fds_.clear();
+
+        // the client picks the size; keep to rings that hold a read buffer
+        auto const ring_size = wire::transport_ring_size(transport);
+        if (ring_size < distributor_.options().read_buffer_size) {
+            close();
+            return false;
+        }
+        shm_ = shm_stream::open(socket_.get_executor(), handles, ring_size, shm_stream::side::hub,
+                                distributor_.options().shm_busy_poll, ec);
+        if (!shm_) {
+            close();
+            return false;
         }
 
-        // TODO(sehe): handle invalid headers (connection reset?)
+        // nothing but the client going away shows on the socket now
+        socket_.async_wait(socket_type::wait_read, [this, self = shared_from_this()](error_code) {
+            close();
+        });
+        return true;
     }
 
-    void hubclient::handle_read_body(error_code error)
+    void hubclient::handle_read(error_code error, size_t transferred)
     {
+        reading_ = false;
         if (!error) {
-            distributor_.distribute(shared_from_this(), inmsg_);
+            reader_.commit(transferred);
+
+            auto self = shared_from_this();
+            bool frames_ok = true;
+            bool const valid = reader_.consume([&](hubmessage const& msg) {
+                switch (msg.get_action()) {
+                case hubmessage::action::hello:
+                    negotiate(msg);
+                    return;
+                case hubmessage::action::fragment_begin:
+                case hubmessage::action::fragment:
+                    frames_ok = frames_ok && reassemble(msg);
+                    return;
+                case hubmessage::action::transport:
+                    frames_ok = frames_ok && attach(msg);
+                    return;
+                case hubmessage::action::subscribe:
+                case hubmessage::action::unsubscribe:
+                    update_conflation(msg);
+                    break;
+                default:
+                    break;
+                }
+                if (credit_)
+                    ungranted_ += wire::publications(msg);
+                distributor_.distribute(self, msg);
+            });
+
+            // a client we can't follow anymore is dropped, even while
+            // something else (a write, a timer) keeps us alive
+            if (!valid || !frames_ok)
+                return close();
+
+            // Get next, unless waiting for a slow consumer or the shards;
+            // the client gets its credit back once we read on
+            if (!paused_ && !backlogged()) {
+                grant();
+                do_read();
+            }
+            return;
+        }
+        close();
+    }
+
+    bool hubclient::reassemble(hubmessage const& fragment)
+    {
+        if (!assembler_.add(fragment))
+            return false;
 
-            // Get next
-            async_read(socket_, inmsg_.header_buf(), bind(&hubclient::handle_read_header));
+        if (assembler_.complete()) {
+            if (credit_)
+                ++ungranted_;
+            distributor_.distribute(shared_from_this(), assembler_.take());
         }
-        // TODO(sehe): handle IO failure
+        return true;
+    }
+
+    void hubclient::negotiate(hubmessage const& hello)
+    {
+        // answer with the version we'll both use, and switch to it
+        unsigned const version = std::min(wire::hello_version(hello),
+                                          distributor_.options().max_protocol_version);
+
+        credit_ = wire::hello_credit(hello);
+        bool const trace =
+            version >= 2 && wire::hello_trace(hello) && distributor_.options().trace_latency;
+        enqueue(std::make_shared<hubmessage const>(wire::hello(version, credit_, trace)));
+        writer_.set_protocol_version(version);
+        writer_.set_tracing(trace);
+    }
+
+    void hubclient::grant()
+    {
+        if (credit_ && ungranted_)
+            enqueue(std::make_shared<hubmessage const>(wire::credit(std::exchange(ungranted_, 0))));
     }
 
     void hubclient::handle_write(error_code error)
     {
         if (!error) {
-            outmsg_queue_.pop_front();
-
-            if (!outmsg_queue_.empty()) {
-                // Write next from queue
-                // TODO(sehe) remove duplication
-                async_write(socket_,
-                    outmsg_queue_.front().on_the_wire(),
-                    bind(&hubclient::handle_write));
+            counters_->record_write(writer_.frames(), writer_.bytes());
+            outmsg_queue_.pop(std::exchange(inflight_, 0));
+
+            if (outmsg_queue_.drained())
+                release_waiting();
+
+            if (!outmsg_queue_.empty() || outmsg_queue_.bulk_pending()) {
+                // Write whatever queued up in the meantime
+                do_write();
             }
+            feed_replayed(); // writes, unless on the way already
+        } else {
+            close(); // we won't drain anymore: releases those waiting
         }
-        // error TODO handling
     }
 
 }  // namespace msghublib::detail
@@ -2,10 +2,24 @@
 
 #include "ihub.h"
 #include "hubmessage.h"
+#include "framereader.h"
+#include "framewriter.h"
+#include "hub_options.h"
+#include "outboundqueue.h"
+#include "messagepool.h"
+#include "recycler.h"
+#include "hubexecutor.h"
+#include "wireprotocol.h"
+#include "shmstream.h"
+#include "conflation.h"
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <functional>
 #include <deque>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -17,26 +31,128 @@ class hubclient : public std::enable_shared_from_this<hubclient>
   public:
     template <typename Executor>
 	hubclient(Executor executor, ihub& distrib)
-      : socket_(make_strand(executor))
+      : socket_(boost::asio::make_strand(hub_executor<>(executor)))
+      , throttle_timer_(socket_.get_executor())
       , distributor_(distrib)
+      , reader_(distrib.options().read_buffer_size, distrib.options().max_alias_bytes)
+      , outmsg_queue_(distrib.options(), distrib.counters(), recycler_)
+      , pool_(distrib.options().message_pool_size)
+      , writer_(distrib.options(), frame_encoder::aliasing::by_topic_id)
+      , assembler_(distrib.options().max_message_size)
+      , counters_(distrib.counters())
     {}
+	~hubclient();
 
-	tcp::socket& socket();
+	using socket_type = boost::asio::basic_stream_socket<
+	    boost::asio::generic::stream_protocol, boost::asio::strand<hub_executor<>>>;
+	socket_type& socket();
 	void start();
 	void stop();
-	void send(const hubmessage& msg);
+	// Queues a frame for this subscriber. Returns false if it is congested
+	// and the publisher should wait for it (block_publisher policy).
+	bool send(shared_hubmessage msg);
+	// Queues a large publication, sent in fragments, likewise. Subscribers
+	// that negotiated protocol version 1 can't receive it.
+	bool send(shared_large_message msg);
+	// Suspends reading until `subscriber` has drained its queue. From
+	// within distribute() that takes effect before the next read, from
+	// elsewhere (a shard) after the read in progress.
+	void wait_for(std::shared_ptr<hubclient> const& subscriber);
+	// Suspends reading until resume(), likewise: while the hub's log is
+	// behind (see hub_options::log_backlog). resume() may come from any
+	// thread.
+	void pause();
+	void resume();
+	// Publications of ours waiting in the hub's shards, counted in and
+	// out by the hub: we stop reading while there are too many (see
+	// hub_options::shard_backlog)
+	void handed_off() { backlog_.fetch_add(1, std::memory_order_relaxed); }
+	void fanned_out();
+	// Replays (see msghub::subscribe_from): from begin_replay() until
+	// end_replay(), live publications to `topics` wait for the replayed
+	// ones, which are sent with send_replayed(), a batch at a time once
+	// replay_ready(), and queued as the queue has room for them
+	void begin_replay(std::vector<std::uint32_t> topics);
+	void send_replayed(std::vector<shared_hubmessage> batch);
+	[[nodiscard]] bool replay_ready() const;
+	void end_replay(std::vector<std::uint32_t> topics);
+	// Frames published by this client are built from here
+	message_pool& pool() { return pool_; }
   private:
     using error_code = boost::system::error_code;
-	void handle_read_header(error_code /*error*/);
-	void handle_read_body(error_code /*error*/);
+	void do_read();
+	void receive_with_fds(error_code /*error*/);
+	void handle_read(error_code /*error*/, size_t /*transferred*/);
+	bool attach(hubmessage const& transport);
+	void close();
+	bool reassemble(hubmessage const& fragment);
+	void negotiate(hubmessage const& hello);
+	void grant();
+	void enqueue(shared_hubmessage msg);
+	void admit(shared_hubmessage msg);
+	void settle(outbound_queue::verdict verdict);
+	void update_conflation(hubmessage const& msg);
+	void conflate(shared_hubmessage msg, conflation_rules::interval interval);
+	void throttle(std::chrono::steady_clock::time_point until);
+	void release_throttled();
+	void release_held();
+	void feed_replayed();
+	bool backlogged();
+	void release_when_drained(std::shared_ptr<hubclient> publisher);
+	void release_waiting();
+	void do_write();
 	void handle_write(error_code /*error*/);
 
     auto bind(void (hubclient::* /*handler*/)(error_code));
+    auto bind(void (hubclient::* /*handler*/)(error_code, size_t));
   
-	tcp::socket			socket_;
+	// handler and queue node memory, shared with the handlers in flight
+	std::shared_ptr<recycler> recycler_ = std::make_shared<recycler>();
+	socket_type			socket_;
+	boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+	    boost::asio::wait_traits<std::chrono::steady_clock>,
+	    boost::asio::strand<hub_executor<>>> throttle_timer_;
+	std::shared_ptr<shm_stream> shm_;   // once attached, carries all frames
+	bool				fds_expected_ = false; // for the first read on a local socket
+	std::vector<unique_fd> received_fds_;
 	ihub&				distributor_;
-	hubmessage			inmsg_;
-	hubmessage_queue	outmsg_queue_;
+	framereader			reader_;
+	outbound_queue		outmsg_queue_;
+	message_pool		pool_;
+	framewriter			writer_;
+	wire::reassembler	assembler_;
+	std::shared_ptr<hub_counters> counters_; // we may outlive the hub
+	bool				started_ = false;
+	std::size_t			inflight_ = 0; // frames being written
+	bool				paused_ = false;
+	bool				reading_ = false;
+	std::atomic<std::size_t> backlog_{0};
+	std::atomic_bool	backlog_paused_{false}; // not reading for it
+	bool				credit_ = false;   // the client asked for publish credit
+	std::uint32_t		ungranted_ = 0;    // publications read since the last grant
+	// conflated subscriptions, and the throttled topics among them: when
+	// their last publication was queued, and the one held back since
+	struct throttled {
+	    std::chrono::steady_clock::time_point next; // earliest to queue another
+	    conflation_rules::interval interval{};
+	    shared_hubmessage held;
+	};
+	conflation_rules	conflation_;
+	std::unordered_map<std::uint32_t, throttled> throttled_;
+	bool				throttling_ = false; // the timer is set
+	// topics being replayed, by the replays in progress, and the live
+	// publications to them held back meanwhile
+	struct replaying {
+	    unsigned replays = 0;
+	    std::deque<held_publication> held; // counted in outmsg_queue_
+	};
+	std::unordered_map<std::uint32_t, replaying> replaying_;
+	std::deque<shared_hubmessage> replayed_; // sent, not queued yet
+	std::atomic<std::size_t> replayed_pending_{0}; // likewise, from the log's thread
+	// publishers waiting for us to drain, kept alive while they don't read;
+	// let go once we can't write anymore, publishers waiting for each
+	// other would keep each other alive
+	std::vector<std::shared_ptr<hubclient>> waiting_;
 };
 
 }  // namespace detail
@@ -1,19 +1,40 @@
 #include "hubconnection.h"
+#include "hubcounters.h"
+#include "wireprotocol.h"
+
+#include <algorithm>
+#include <bit>
 #include <boost/system/error_code.hpp>
 #include <hub_error.h>
 
 namespace msghublib::detail {
 
+    namespace {
+        // Resolved addresses, as the socket's protocol-independent endpoints
+        std::vector<boost::asio::generic::stream_protocol::endpoint>
+        generic_endpoints(tcp::resolver::results_type const& results) {
+            std::vector<boost::asio::generic::stream_protocol::endpoint> endpoints;
+            for (auto const& entry : results)
+                endpoints.emplace_back(entry.endpoint());
+            return endpoints;
+        }
+    }
+
     auto hubconnection::bind(void (hubconnection::*handler)(error_code)) {
 #pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
-        return [=, self=shared_from_this()](error_code ec, size_t /*transferred*/) {
+        return recycled(recycler_, [=, self=shared_from_this()](error_code ec, size_t /*transferred*/) {
             (this->*handler)(ec);
-        };
+        });
+    }
+
+    auto hubconnection::bind(void (hubconnection::*handler)(error_code, size_t)) {
+        return recycled(recycler_, [=, self=shared_from_this()](error_code ec, size_t transferred) {
+            (this->*handler)(ec, transferred);
+        });
     }
 
     void hubconnection::init(const std::string& host, uint16_t port, error_code& ec) {
         try {
-            error_code ec;
             tcp::resolver resolver(socket_.get_executor());
             tcp::resolver::results_type results =
                 resolver.resolve(host, std::to_string(port), ec);
@@ -21,12 +42,10 @@ namespace msghublib::detail {
             // Do blocking connect (connection is more important than
             // subscription here)
             if (!ec)
-                connect(socket_, results, ec);
+                connect(socket_, generic_endpoints(results), ec);
 
-            // Schedule packet read
             if (!ec)
-                async_read(socket_, inmsg_.header_buf(),
-                           bind(&hubconnection::handle_read_header));
+                start();
         } catch (system_error const& se) {
             ec = se.code();
         } catch (...) {
@@ -34,15 +53,150 @@ namespace msghublib::detail {
         }
     }
 
-    void hubconnection::async_send(const hubmessage& msg) {
-#pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
-        post(socket_.get_executor(), [=, self = shared_from_this()]() mutable {
-            do_send(std::move(msg));
+    void hubconnection::async_init(const std::string& host, uint16_t port, completion connected) {
+        auto resolver = std::make_shared<tcp::resolver>(socket_.get_executor());
+
+        resolver->async_resolve(
+            host, std::to_string(port),
+            [this, resolver, connected, self = shared_from_this()](
+                error_code ec, tcp::resolver::results_type const& results) {
+                if (ec)
+                    return connected(ec);
+
+                async_connect(socket_, generic_endpoints(results),
+                              [this, connected, self](error_code ec, auto const& /*endpoint*/) {
+                                  if (!ec)
+                                      start();
+                                  connected(ec);
+                              });
+            });
+    }
+
+    void hubconnection::init(tcp_endpoint const& ep, error_code& ec) {
+        init(ep.host, ep.port, ec);
+    }
+
+    void hubconnection::async_init(tcp_endpoint const& ep, completion connected) {
+        async_init(ep.host, ep.port, std::move(connected));
+    }
+
+    void hubconnection::init(local_endpoint const& ep, error_code& ec) {
+        socket_.connect(ep, ec);
+        if (!ec)
+            start();
+    }
+
+    void hubconnection::async_init(local_endpoint const& ep, completion connected) {
+        socket_.async_connect(ep, [this, connected, self = shared_from_this()](error_code ec) {
+            if (!ec)
+                start();
+            connected(ec);
         });
     }
 
-    void hubconnection::send(const hubmessage& msg, error_code& ec) {
-        write(socket_, msg.on_the_wire(), ec);
+    void hubconnection::init(shm_endpoint const& ep, error_code& ec) {
+        socket_.connect(ep.control, ec);
+        if (!ec)
+            attach_shm(ec);
+        if (!ec)
+            start();
+    }
+
+    void hubconnection::async_init(shm_endpoint const& ep, completion connected) {
+        socket_.async_connect(ep.control, [this, connected, self = shared_from_this()](error_code ec) {
+            if (!ec)
+                attach_shm(ec);
+            if (!ec)
+                start();
+            connected(ec);
+        });
+    }
+
+    void hubconnection::attach_shm(error_code& ec) {
+        auto const& options  = courier_.options();
+        // the hub takes no ring smaller than its read buffer
+        auto const least     = std::max<std::size_t>(4096, options.read_buffer_size);
+        auto const ring_size = std::bit_ceil(std::clamp<std::size_t>(options.shm_ring_size, least, 1u << 30));
+
+        auto const handles = shm_stream::allocate(ring_size, ec);
+        if (!ec)
+            shm_ = shm_stream::open(socket_.get_executor(), handles, ring_size,
+                                    shm_stream::side::client, options.shm_busy_poll, ec);
+        if (ec)
+            return;
+
+        // the hub takes the descriptors along with the frame, and both sides
+        // switch over
+        std::vector<char> frame;
+        hubmessage const transport = wire::transport(static_cast<std::uint32_t>(ring_size));
+        for (auto const& buffer : transport.on_the_wire())
+            frame.insert(frame.end(), static_cast<char const*>(buffer.data()),
+                         static_cast<char const*>(buffer.data()) + buffer.size());
+
+        int const fds[] = {handles.memory.get(), handles.wake_client.get(), handles.wake_hub.get()};
+        send_with_fds(socket_.native_handle(), frame, fds, ec);
+        if (ec)
+            shm_.reset();
+    }
+
+    void hubconnection::watch_socket() {
+        // nothing but the hub going away shows on the socket now
+        socket_.async_wait(boost::asio::socket_base::wait_read,
+                           [this, self = shared_from_this()](error_code) { do_close(true); });
+    }
+
+    void hubconnection::start() {
+        if (shm_)
+            watch_socket();
+
+        // Offer a newer protocol and ask for publish credit; the hub
+        // answers if it speaks the hello
+        auto const& options = courier_.options();
+        if (options.max_protocol_version > 1 || options.publish_window) {
+            negotiating_ = true;
+            async_send(wire::hello(options.max_protocol_version, options.publish_window,
+                                   options.trace_latency));
+
+            hello_timer_.expires_after(options.hello_timeout);
+            hello_timer_.async_wait([this, self = shared_from_this()](error_code ec) {
+                if (!ec && negotiating_)
+                    negotiated(); // version 1, then
+            });
+        }
+
+        // Schedule packet read
+        do_read();
+    }
+
+    void hubconnection::async_send(const hubmessage& msg, completion accepted) {
+        async_send(pool_.make(msg), std::move(accepted));
+    }
+
+    void hubconnection::async_send(shared_hubmessage msg, completion accepted) {
+#pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
+        post(socket_.get_executor(),
+             recycled(recycler_, [this, msg = std::move(msg), accepted = std::move(accepted),
+                                  self = shared_from_this()]() mutable {
+                 do_send(std::move(msg), std::move(accepted));
+             }));
+    }
+
+    void hubconnection::async_send(std::vector<shared_hubmessage> msgs) {
+#pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
+        post(socket_.get_executor(),
+             [this, msgs = std::move(msgs), self = shared_from_this()]() mutable {
+                 for (auto& msg : msgs)
+                     do_send(std::move(msg), {});
+             });
+    }
+
+    void hubconnection::async_send(shared_large_message msg, completion accepted) {
+#pragma GCC diagnostic ignored "-Wdeprecated" // implicit this-capture
+        post(socket_.get_executor(),
+             [this, msg = std::move(msg), accepted = std::move(accepted),
+              self = shared_from_this()]() mutable {
+                 do_send(std::move(msg), std::move(accepted));
+             });
     }
 
     void hubconnection::close(bool forced) {
@@ -51,43 +205,229 @@ namespace msghublib::detail {
              [=, self = shared_from_this()] { do_close(forced); });
     }
 
-    void hubconnection::handle_read_header(error_code error) {
-        if (!error && inmsg_.verify()) {
-            async_read(socket_, inmsg_.payload_area(),
-                       bind(&hubconnection::handle_read_body));
-        } else {
+    void hubconnection::do_read() {
+        if (shm_)
+            shm_->async_read_some(reader_.prepare(), bind(&hubconnection::handle_read));
+        else
+            socket_.async_read_some(reader_.prepare(), bind(&hubconnection::handle_read));
+    }
+
+    void hubconnection::handle_read(error_code error, size_t transferred) {
+        if (!error) {
+            reader_.commit(transferred);
+            bool fragments_ok = true;
+            bool const valid = reader_.consume([&](hubmessage const& msg) {
+                if (msg.get_action() == hubmessage::action::hello) {
+                    writer_.set_protocol_version(
+                        std::min(wire::hello_version(msg),
+                                 courier_.options().max_protocol_version));
+                    credited_ = wire::hello_credit(msg) && courier_.options().publish_window;
+                    writer_.set_tracing(writer_.protocol_version() >= 2 && wire::hello_trace(msg) &&
+                                        courier_.options().trace_latency);
+                    negotiated();
+                } else if (msg.get_action() == hubmessage::action::credit) {
+                    granted_ += wire::credit_amount(msg);
+                    accept_pending();
+                } else if (msg.get_action() == hubmessage::action::fragment_begin ||
+                           msg.get_action() == hubmessage::action::fragment) {
+                    fragments_ok = fragments_ok && reassemble(msg);
+                } else {
+                    courier_.deliver(msg);
+                }
+            });
+
+            if (valid && fragments_ok) {
+                do_read();
+                return;
+            }
+        }
+        do_close(true);
+    }
+
+    void hubconnection::negotiated() {
+        negotiating_ = false;
+        hello_timer_.cancel();
+        for (auto& [msg, accepted] : std::exchange(unnegotiated_, {}))
+            do_send(std::move(msg), std::move(accepted));
+    }
+
+    void hubconnection::do_send(shared_hubmessage msg, completion accepted) {
+        if (is_closing) {
+            if (accepted)
+                accepted(hub_errc::hub_not_connected);
+            return;
+        }
+
+        // peers that predate batches get the publications one by one
+        if (msg->get_action() == hubmessage::action::batch && writer_.protocol_version() < 2) {
+            wire::batch unpacked;
+            if (wire::read_batch(*msg, unpacked)) {
+                for (auto const& [topic, body] : unpacked.entries)
+                    do_send(std::make_shared<hubmessage const>(
+                                hubmessage::action::publish, unpacked.topics[topic], body),
+                            {});
+            }
+            if (accepted)
+                accepted({});
+            return;
+        }
+
+        bool const publication = msg->publication();
+        auto const count       = wire::publications(*msg);
+
+        // there's no publisher to block here, so block_publisher never drops
+        switch (outmsg_queue_.push(std::move(msg), inflight_)) {
+        case outbound_queue::verdict::overflow:
+            outmsg_queue_.discard(inflight_);
             do_close(true);
+            if (accepted)
+                accepted(boost::asio::error::no_buffer_space);
+            return;
+        case outbound_queue::verdict::dropped:
+            if (courier_.options().slow_consumer == slow_consumer_policy::drop_newest) {
+                if (accepted)
+                    accepted(boost::asio::error::no_buffer_space);
+                return;
+            }
+            published_ += count;
+            uncount(outmsg_queue_.evicted());
+            break;
+        default:
+            published_ += count;
+            break;
         }
+
+        if (!inflight_ && !outmsg_queue_.empty())
+            do_write();
+
+        complete_send(publication, std::move(accepted));
     }
 
-    void hubconnection::handle_read_body(error_code error) {
-        if (!error) {
-            courier_.deliver(inmsg_);
-            async_read(socket_, inmsg_.header_buf(),
-                       bind(&hubconnection::handle_read_header));
-        } else {
+    void hubconnection::do_send(shared_large_message msg, completion accepted) {
+        if (is_closing) {
+            if (accepted)
+                accepted(hub_errc::hub_not_connected);
+            return;
+        }
+
+        if (negotiating_) {
+            unnegotiated_.emplace_back(std::move(msg), std::move(accepted));
+            return;
+        }
+        if (writer_.protocol_version() < 2) {
+            courier_.counters()->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            if (accepted)
+                accepted(boost::asio::error::message_size);
+            return;
+        }
+
+        // subject to the queue limits as a whole, fed into the queue a
+        // fragment at a time
+        switch (outmsg_queue_.push_bulk(std::move(msg), inflight_)) {
+        case outbound_queue::verdict::overflow:
+            outmsg_queue_.discard(inflight_);
+            outmsg_queue_.discard_bulk();
             do_close(true);
+            if (accepted)
+                accepted(boost::asio::error::no_buffer_space);
+            return;
+        case outbound_queue::verdict::dropped:
+            if (courier_.options().slow_consumer == slow_consumer_policy::drop_newest) {
+                if (accepted)
+                    accepted(boost::asio::error::no_buffer_space);
+                return;
+            }
+            ++published_;
+            uncount(outmsg_queue_.evicted());
+            break;
+        default:
+            ++published_;
+            break;
         }
+
+        if (!inflight_ && bulk_ready())
+            do_write();
+
+        complete_send(true, std::move(accepted));
     }
 
-    void hubconnection::do_send(hubmessage msg) {
-        if (outmsg_queue_.push_back(std::move(msg));
-            1 == outmsg_queue_.size())
-        {
-            async_write(socket_, outmsg_queue_.front().on_the_wire(),
-                        bind(&hubconnection::handle_write));
+    void hubconnection::complete_send(bool publication, completion accepted) {
+        if (!accepted)
+            return;
+        if (!publication || !credited_ ||
+            published_ <= granted_ + courier_.options().publish_window)
+            accepted({});
+        else
+            pending_.emplace_back(published_, std::move(accepted));
+    }
+
+    void hubconnection::uncount(std::size_t dropped) {
+        // the hub won't credit them; the publications waiting for credit
+        // move up as many, which may accept those queued before a little
+        // early, but never leaves one waiting for credit that won't come
+        published_ -= dropped;
+        for (auto& [number, accepted] : pending_)
+            number -= std::min<std::uint64_t>(number, dropped);
+        if (dropped)
+            accept_pending();
+    }
+
+    void hubconnection::accept_pending() {
+        auto const window = courier_.options().publish_window;
+        while (!pending_.empty() && pending_.front().first <= granted_ + window) {
+            auto accepted = std::move(pending_.front().second);
+            pending_.pop_front();
+            accepted({});
         }
     }
 
+    bool hubconnection::reassemble(hubmessage const& fragment) {
+        bool const first = fragment.get_action() == hubmessage::action::fragment_begin;
+        if (!assembler_.add(fragment))
+            return false;
+
+        // stream the chunk; keep the body only if someone wants it whole
+        bool const whole = courier_.deliver_chunk(assembler_.topic(), assembler_.chunk(),
+                                                  assembler_.offset(), assembler_.total());
+        if (first && !whole)
+            assembler_.drop_body();
+
+        if (assembler_.complete()) {
+            bool const kept = assembler_.keeps_body();
+            if (auto msg = assembler_.take(); kept)
+                courier_.deliver(*msg);
+        }
+        return true;
+    }
+
+    bool hubconnection::bulk_ready() const {
+        return outmsg_queue_.bulk_pending() && writer_.protocol_version() >= 2;
+    }
+
+    void hubconnection::do_write() {
+        // Drain as much of the queue as fits in one gathered write, with at
+        // most one fragment of a large publication
+        if (bulk_ready())
+            outmsg_queue_.feed_bulk();
+        if (shm_)
+            shm_->async_write(writer_.gather(outmsg_queue_.frames()),
+                              bind(&hubconnection::handle_write));
+        else
+            async_write(socket_, writer_.gather(outmsg_queue_.frames()),
+                        bind(&hubconnection::handle_write));
+        inflight_ = writer_.frames();
+    }
+
     void hubconnection::handle_write(error_code error)
     {
         if (!error)
         {
-            if (outmsg_queue_.pop_front(); !outmsg_queue_.empty())
+            courier_.counters()->record_write(writer_.frames(), writer_.bytes());
+            outmsg_queue_.pop(std::exchange(inflight_, 0));
+
+            if (!outmsg_queue_.empty() || bulk_ready())
             {
-                async_write(socket_,
-                    outmsg_queue_.front().on_the_wire(),
-                    bind(&hubconnection::handle_write));
+                do_write();
             } else if (is_closing) {
                 do_close(false);
             }
@@ -104,11 +444,20 @@ namespace msghublib::detail {
 
         // TODO(sehe): Unsubscribe?
 
+        for (auto& waiting : std::exchange(pending_, {}))
+            waiting.second(boost::asio::error::operation_aborted);
+        for (auto& waiting : std::exchange(unnegotiated_, {}))
+            if (waiting.second)
+                waiting.second(hub_errc::hub_not_connected);
+        hello_timer_.cancel();
+
         if (forced || outmsg_queue_.empty()) {
             if (socket_.is_open()) {
                 error_code ec;
                 socket_.close(ec);
             }
+            if (shm_)
+                shm_->close();
         }
     }
 
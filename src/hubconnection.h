@@ -2,12 +2,27 @@
 
 #include "ihub.h"
 #include "hubmessage.h"
+#include "framereader.h"
+#include "framewriter.h"
+#include "hub_options.h"
+#include "outboundqueue.h"
+#include "messagepool.h"
+#include "recycler.h"
+#include "hubexecutor.h"
+#include "wireprotocol.h"
 #include "hub_error.h"
+#include "endpoints.h"
+#include "shmstream.h"
 
 #include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <vector>
 #include <memory>
 #include <functional>
+#include <utility>
 
 #include <boost/atomic.hpp>
 #include <boost/asio.hpp>
@@ -20,30 +35,94 @@ class hubconnection : public std::enable_shared_from_this<hubconnection>
 public:
     template <typename Executor>
 	hubconnection(Executor executor, ihub& courier)
-        : socket_(make_strand(executor))
+        : socket_(boost::asio::make_strand(hub_executor<>(executor)))
+        , hello_timer_(socket_.get_executor())
         , courier_(courier)
+        , reader_(courier.options().read_buffer_size, courier.options().max_alias_bytes)
+        , outmsg_queue_(courier.options(), courier.counters(), recycler_)
+        , pool_(courier.options().message_pool_size)
+        , writer_(courier.options(), frame_encoder::aliasing::by_name)
+        , assembler_(courier.options().max_message_size)
         , is_closing(false)
     {}
 
+    // Invoked on the connection's strand
+    using completion = std::function<void(error_code)>;
+
 	void init(const std::string& host, uint16_t port, error_code& ec);
-	void async_send(const hubmessage& msg);
-	void send(const hubmessage& msg, error_code& ec);
+	void init(tcp_endpoint const& ep, error_code& ec);
+	void init(local_endpoint const& ep, error_code& ec);
+	void init(shm_endpoint const& ep, error_code& ec);
+	void async_init(const std::string& host, uint16_t port, completion connected);
+	void async_init(tcp_endpoint const& ep, completion connected);
+	void async_init(local_endpoint const& ep, completion connected);
+	void async_init(shm_endpoint const& ep, completion connected);
+	// Queues `msg`. Publications complete `accepted` once they fit in the
+	// publish window (see hub_options::publish_window), other frames as
+	// soon as they are queued.
+	void async_send(const hubmessage& msg, completion accepted = {});
+	void async_send(shared_hubmessage msg, completion accepted = {});
+	// Queues several frames with a single hand-off
+	void async_send(std::vector<shared_hubmessage> msgs);
+	// Queues a large publication, sent in fragments between other frames.
+	// Held back until the hub answered the hello (see
+	// hub_options::hello_timeout), fails with message_size if it only
+	// speaks protocol version 1.
+	void async_send(shared_large_message msg, completion accepted = {});
 	void close(bool forced);
 
+	// Frames to send are best built from here
+	message_pool& pool() { return pool_; }
+
 private:
     auto bind(void (hubconnection::* /*handler*/)(error_code));
+    auto bind(void (hubconnection::* /*handler*/)(error_code, size_t));
 
-	void handle_read_header(error_code error);
-	void handle_read_body(error_code error);
-	void do_send(hubmessage msg);
+	void attach_shm(error_code& ec);
+	void watch_socket();
+	void start();
+	void do_read();
+	void handle_read(error_code error, size_t transferred);
+	void negotiated();
+	void do_send(shared_hubmessage msg, completion accepted);
+	void do_send(shared_large_message msg, completion accepted);
+	void complete_send(bool publication, completion accepted);
+	bool reassemble(hubmessage const& fragment);
+	// Forgets publications dropped from the queue (drop_oldest)
+	void uncount(std::size_t dropped);
+	void accept_pending();
+	bool bulk_ready() const;
+	void do_write();
 	void handle_write(error_code error);
 	void do_close(bool forced);
 
-	tcp::socket        socket_;
+	// handler and queue node memory, shared with the handlers in flight
+	std::shared_ptr<recycler> recycler_ = std::make_shared<recycler>();
+	// TCP or Unix domain
+	boost::asio::basic_stream_socket<boost::asio::generic::stream_protocol,
+	                                 boost::asio::strand<hub_executor<>>> socket_;
+	std::shared_ptr<shm_stream> shm_; // once attached, carries all frames
+	boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+	    boost::asio::wait_traits<std::chrono::steady_clock>,
+	    boost::asio::strand<hub_executor<>>> hello_timer_;
 	ihub&              courier_;
-	hubmessage         inmsg_;
-	hubmessage_queue   outmsg_queue_;
+	framereader        reader_;
+	outbound_queue     outmsg_queue_;
+	message_pool       pool_;
+	framewriter        writer_;
+	wire::reassembler  assembler_;
+	std::size_t        inflight_ = 0; // frames being written
 	std::atomic_bool   is_closing;
+	bool               negotiating_ = false; // hello not answered yet
+	// large publications waiting for the answer
+	std::deque<std::pair<shared_large_message, completion>> unnegotiated_;
+
+	// publish credit: publications numbered from 1, each accepted when it
+	// is no more than the window ahead of what the hub granted
+	bool               credited_  = false; // the hub grants credit
+	std::uint64_t      published_ = 0;
+	std::uint64_t      granted_   = 0;
+	std::deque<std::pair<std::uint64_t, completion>> pending_;
 };
 
 }  // namespace detail
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "hub_stats.h"
+#include "hubmessage.h"
+#include "latency_histogram.h"
+#include "topicregistry.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace msghublib::detail {
+
+    // Live counters shared by all connections of a hub. Every thread counts
+    // in a stripe of its own (mostly: threads share stripes round robin),
+    // so counting doesn't bounce cache lines between cores; a snapshot adds
+    // the stripes up. Updates are relaxed; readers only ever see a snapshot.
+    struct hub_counters {
+        using counter = std::atomic<std::uint64_t>;
+
+        struct alignas(64) stripe {
+            counter writes{0};
+            counter frames_written{0};
+            counter bytes_written{0};
+
+            counter publications_in{0};
+            counter bytes_in{0};
+
+            counter frames_dropped{0};
+            counter frames_conflated{0};
+            counter consumers_disconnected{0};
+            counter publishers_paused{0};
+
+            counter connections_accepted{0};
+            counter connections_closed{0};
+            counter accept_errors{0};
+            counter topics_refused{0};
+
+            // gauges: a stripe may go "negative", wrapping, the sum doesn't
+            counter frames_queued{0};
+            counter bytes_queued{0};
+        };
+
+        // High water marks are raised rarely, they aren't striped
+        counter queue_high_water_frames{0};
+        counter queue_high_water_bytes{0};
+
+        stripe& local() {
+            static std::atomic_uint next{0};
+            thread_local std::size_t const mine = next.fetch_add(1, std::memory_order_relaxed);
+            return stripes_[mine % stripes_.size()];
+        }
+
+        static void raise(counter& mark, std::uint64_t value) {
+            auto current = mark.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !mark.compare_exchange_weak(current, value, std::memory_order_relaxed))
+                ;
+        }
+
+        void record_write(std::size_t frames, std::size_t bytes) {
+            auto& s = local();
+            s.writes.fetch_add(1, std::memory_order_relaxed);
+            s.frames_written.fetch_add(frames, std::memory_order_relaxed);
+            s.bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] hub_stats snapshot() const {
+            hub_stats s;
+            s.writes         = sum(&stripe::writes);
+            s.frames_written = sum(&stripe::frames_written);
+            s.bytes_written  = sum(&stripe::bytes_written);
+
+            s.publications_in = sum(&stripe::publications_in);
+            s.bytes_in        = sum(&stripe::bytes_in);
+
+            s.frames_dropped          = sum(&stripe::frames_dropped);
+            s.frames_conflated        = sum(&stripe::frames_conflated);
+            s.consumers_disconnected  = sum(&stripe::consumers_disconnected);
+            s.publishers_paused       = sum(&stripe::publishers_paused);
+            s.queue_high_water_frames = queue_high_water_frames.load(std::memory_order_relaxed);
+            s.queue_high_water_bytes  = queue_high_water_bytes.load(std::memory_order_relaxed);
+            s.frames_queued           = sum(&stripe::frames_queued);
+            s.bytes_queued            = sum(&stripe::bytes_queued);
+
+            s.connections_accepted = sum(&stripe::connections_accepted);
+            s.connections_open     = s.connections_accepted - sum(&stripe::connections_closed);
+            s.accept_errors        = sum(&stripe::accept_errors);
+            s.topics_refused       = sum(&stripe::topics_refused);
+            return s;
+        }
+
+      private:
+        [[nodiscard]] std::uint64_t sum(counter stripe::*which) const {
+            std::uint64_t total = 0;
+            for (auto const& s : stripes_)
+                total += (s.*which).load(std::memory_order_relaxed);
+            return total;
+        }
+
+        std::array<stripe, 16> stripes_;
+    };
+
+    // Per topic state by topic id, for any thread. The table grows a chunk
+    // at a time and never moves, so nobody waits for it to grow.
+    template <typename Entry, std::size_t ChunkSize = 1024>
+    class topic_table
+    {
+      public:
+        topic_table() = default;
+        topic_table(topic_table const&)            = delete;
+        topic_table& operator=(topic_table const&) = delete;
+        ~topic_table() {
+            for (auto& c : chunks_)
+                delete[] c.load(std::memory_order_relaxed);
+        }
+
+        // Null for ids beyond the table's reach
+        Entry* at(topic_id id) { return lookup(id, true); }
+        // Null if nothing was there for `id` yet
+        [[nodiscard]] Entry const* find(topic_id id) const {
+            return const_cast<topic_table*>(this)->lookup(id, false);
+        }
+
+      private:
+        static constexpr std::size_t max_chunks = 4096; // topics beyond aren't tracked
+
+        Entry* lookup(topic_id id, bool grow) {
+            auto const c = id / ChunkSize;
+            if (c >= max_chunks)
+                return nullptr;
+
+            auto* chunk = chunks_[c].load(std::memory_order_acquire);
+            if (!chunk && grow) {
+                auto* fresh = new Entry[ChunkSize];
+                if (chunks_[c].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+                    chunk = fresh;
+                else
+                    delete[] fresh; // someone else's got in first
+            }
+            return chunk ? &chunk[id % ChunkSize] : nullptr;
+        }
+
+        std::array<std::atomic<Entry*>, max_chunks> chunks_{};
+    };
+
+    // Publications per topic
+    struct topic_count {
+        std::atomic<std::uint64_t> publications{0};
+        std::atomic<std::uint64_t> bytes{0};
+
+        void add(std::size_t n, std::size_t size) {
+            publications.fetch_add(n, std::memory_order_relaxed);
+            bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    };
+
+    // Where traced publications to a topic spent their time, made on first
+    // use: it's sizeable, and only traced topics need it
+    class topic_latency_slot
+    {
+      public:
+        using histogram = latency_histogram<4>;
+        struct histograms {
+            histogram to_hub, in_hub, from_hub, handler;
+        };
+
+        topic_latency_slot() = default;
+        ~topic_latency_slot() { delete get(); }
+
+        histograms* get() const { return histograms_.load(std::memory_order_acquire); }
+        histograms& make() {
+            auto* current = get();
+            if (!current) {
+                auto* fresh = new histograms;
+                if (histograms_.compare_exchange_strong(current, fresh, std::memory_order_acq_rel))
+                    current = fresh;
+                else
+                    delete fresh;
+            }
+            return *current;
+        }
+
+        // Records the stages `stamps` cover, and the subscriber's callback
+        // from `started` to `handled`
+        void record(hubmessage::timestamps const& stamps, std::uint64_t started, std::uint64_t handled) {
+            auto& h = make();
+            stage(h.to_hub, stamps.published, stamps.hub_received);
+            stage(h.in_hub, stamps.hub_received, stamps.hub_sent);
+            stage(h.from_hub, stamps.hub_sent, stamps.received);
+            stage(h.handler, started, handled);
+        }
+
+        static latency_stats summary(histogram const& h) {
+            return {h.count(), h.percentile(0.5), h.percentile(0.9), h.percentile(0.99),
+                    h.percentile(0.999), h.max()};
+        }
+
+      private:
+        // clocks of different hosts don't compare, nor do unstamped stages
+        static void stage(histogram& h, std::uint64_t from, std::uint64_t to) {
+            if (from && to >= from)
+                h.record(to - from);
+        }
+
+        std::atomic<histograms*> histograms_{nullptr};
+    };
+
+} // namespace msghublib::detail
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+namespace msghublib::detail {
+
+// The executor connection strands run on: the hub's any_io_executor, with
+// the properties a strand looks at for every handler answered in place.
+// Through any_io_executor, Boost 1.74 heap allocates the answer to a
+// blocking query, and ignores the allocator of the handlers.
+//
+// So work for io_context and thread_pool executors, the common ones, is
+// submitted to them directly, allocated with our allocator rather than
+// wrapped for type erasure. The preferences a strand asks for are kept
+// aside rather than applied to the any_io_executor, whose target then
+// stays the plain executor_type of its context for us to recognize.
+template <typename Allocator = std::allocator<void>>
+class hub_executor
+{
+    using inner_type = boost::asio::any_io_executor;
+    using blocking_t = boost::asio::execution::blocking_t;
+    using work_t     = boost::asio::execution::outstanding_work_t;
+    using relation_t = boost::asio::execution::relationship_t;
+    template <typename> friend class hub_executor;
+
+  public:
+    // not converting, lest copies be mistaken for any_io_executor ones
+    template <typename Inner>
+        requires std::is_same_v<Inner, inner_type>
+    explicit hub_executor(Inner inner, Allocator alloc = {})
+        : inner_(std::move(inner)), alloc_(std::move(alloc)) {}
+
+    template <typename F> void execute(F&& f) const {
+        if (auto const* io = inner_.template target<boost::asio::io_context::executor_type>())
+            execute_on(*io, std::forward<F>(f));
+        else if (auto const* pool = inner_.template target<boost::asio::thread_pool::executor_type>())
+            execute_on(*pool, std::forward<F>(f));
+        else
+            execute_on(inner_, std::forward<F>(f));
+    }
+
+    boost::asio::execution_context& query(boost::asio::execution::context_t) const noexcept {
+        return boost::asio::query(inner_, boost::asio::execution::context);
+    }
+
+    blocking_t query(blocking_t) const noexcept {
+        return never_ ? blocking_t(boost::asio::execution::blocking.never)
+                      : blocking_t(boost::asio::execution::blocking.possibly);
+    }
+
+    Allocator query(boost::asio::execution::allocator_t<void>) const noexcept { return alloc_; }
+
+    hub_executor require(blocking_t::never_t) const { return with([](hub_executor& e) { e.never_ = true; }); }
+    hub_executor require(blocking_t::possibly_t) const { return with([](hub_executor& e) { e.never_ = false; }); }
+
+    // forwarded as preferences
+    hub_executor require(work_t::tracked_t) const {
+        return with([](hub_executor& e) { e.work_ = boost::asio::prefer(e.inner_, work_t::tracked); });
+    }
+    hub_executor require(work_t::untracked_t) const { return with([](hub_executor& e) { e.work_ = {}; }); }
+    hub_executor require(relation_t::fork_t) const {
+        return with([](hub_executor& e) { e.continuation_ = false; });
+    }
+    hub_executor require(relation_t::continuation_t) const {
+        return with([](hub_executor& e) { e.continuation_ = true; });
+    }
+
+    template <typename OtherAllocator>
+    hub_executor<OtherAllocator> require(boost::asio::execution::allocator_t<OtherAllocator> a) const {
+        return rebind(a.value());
+    }
+
+    hub_executor<> require(boost::asio::execution::allocator_t<void>) const { return rebind(std::allocator<void>()); }
+
+    friend bool operator==(hub_executor const& a, hub_executor const& b) noexcept {
+        return a.inner_ == b.inner_ && a.never_ == b.never_ && a.continuation_ == b.continuation_ &&
+            bool(a.work_) == bool(b.work_) && a.alloc_ == b.alloc_;
+    }
+    friend bool operator!=(hub_executor const& a, hub_executor const& b) noexcept {
+        return !(a == b);
+    }
+
+  private:
+    template <typename Executor, typename F> void execute_on(Executor const& ex, F&& f) const {
+        namespace exec = boost::asio::execution;
+        auto const run = [&](auto const& e) {
+            if (continuation_)
+                exec::execute(boost::asio::prefer(e, exec::relationship.continuation), std::forward<F>(f));
+            else
+                exec::execute(e, std::forward<F>(f));
+        };
+        auto const allocated = boost::asio::prefer(ex, exec::allocator(alloc_));
+        if (never_)
+            run(boost::asio::require(allocated, exec::blocking.never));
+        else
+            run(allocated);
+    }
+
+    template <typename Edit> hub_executor with(Edit edit) const {
+        hub_executor result(*this);
+        edit(result);
+        return result;
+    }
+
+    template <typename OtherAllocator> hub_executor<OtherAllocator> rebind(OtherAllocator alloc) const {
+        hub_executor<OtherAllocator> result(inner_, std::move(alloc));
+        result.work_         = work_;
+        result.never_        = never_;
+        result.continuation_ = continuation_;
+        return result;
+    }
+
+    inner_type inner_;
+    inner_type work_; // tracking outstanding work, if asked to
+    Allocator  alloc_;
+    bool       never_        = false;
+    bool       continuation_ = false;
+};
+
+}  // namespace msghublib::detail
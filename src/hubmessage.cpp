@@ -1,10 +1,17 @@
 #include "hubmessage.h"
 #include <span.h>
+#include <chrono>
+#include <stdexcept>
 #include <string_view>
 
 namespace msghublib {
     hubmessage::hubmessage(action action_, std::string_view topic, span<char const> msg)
-        : headers_ {}, payload_(topic.size() + msg.size())
+        : headers_ {}
+    {
+        assign(action_, topic, msg);
+    }
+
+    void hubmessage::assign(action action_, std::string_view topic, span<char const> msg)
     {
         if (topic.size() + msg.size() > (messagesize - sizeof(headers_))) {
             throw std::length_error("messagesize");
@@ -14,7 +21,10 @@ namespace msghublib {
         headers_.bodylen   = msg.size();
         headers_.msgaction = action_;
         headers_.magic     = cookie;
+        topic_id_.reset();
+        stamps_.reset();
 
+        payload_.resize(topic.size() + msg.size());
         auto *out = payload_.data();
         out = std::copy_n(topic.data(), topic.size(), out);
         out = std::copy_n(msg.data(),   msg.size(),   out);
@@ -22,7 +32,35 @@ namespace msghublib {
 
     bool hubmessage::verify() const
     {
-        return headers_.magic == cookie;
+        return headers_.magic == cookie &&
+            headers_.topiclen + headers_.bodylen <= messagesize - sizeof(headers_);
+    }
+
+    std::size_t hubmessage::decode(span<char const> wire)
+    {
+        if (wire.size() < sizeof(headers_))
+            return 0;
+
+        std::copy_n(wire.data(), sizeof(headers_), reinterpret_cast<char*>(&headers_));
+        if (!verify())
+            return sizeof(headers_);
+
+        std::size_t const n = headers_.topiclen + headers_.bodylen;
+        if (wire.size() < sizeof(headers_) + n)
+            return 0;
+
+        auto const* in = wire.data() + sizeof(headers_);
+        payload_.assign(in, in + n);
+        topic_id_.reset();
+        stamps_.reset();
+        return sizeof(headers_) + n;
+    }
+
+    std::uint64_t hubmessage::monotonic_ns() {
+        // steady_clock is CLOCK_MONOTONIC: the processes on a host agree
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
     }
 
     hubmessage::action hubmessage::get_action() const {
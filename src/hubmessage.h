@@ -5,8 +5,14 @@
 #include <string_view>
 
 #include "span.h"
+#include "recycler.h"
 #include <boost/container/small_vector.hpp>
+#include <cstdint>
 #include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace msghublib {
 
@@ -14,19 +20,56 @@ class hubmessage
 {
   public:
     // the following affect on-the-wire compatiblity
-	enum action : char { subscribe, unsubscribe, publish };
-	enum { version = 0x1 };
-	enum { cookie = 0xF00D ^ (version << 8) };
+	enum action : char {
+	    subscribe, unsubscribe, publish, hello, credit, batch, fragment_begin, fragment,
+	    transport
+	};
+	enum { version = 0x2 }; // highest protocol version, negotiated per connection
+	enum { cookie_v1 = 0xF00D ^ (0x1 << 8) };
+	enum { cookie_v2 = 0xF00D ^ (0x2 << 8) };
+	enum { cookie = cookie_v1 }; // our own headers are always version 1
 	enum { messagesize = 0x2000 };
+	enum { headersize = 7 };    // of version 1 frames
     // the following does NOT affect on-the-wire compatiblity
     enum { preallocated = 196 };
 
     hubmessage(action a={}, std::string_view topic={}, span<char const> msg = {});
 
+    // Replaces the content, reusing the storage where possible
+    void assign(action a, std::string_view topic, span<char const> msg);
+
 	[[nodiscard]] bool             verify()     const;
 	[[nodiscard]] action           get_action() const;
 	[[nodiscard]] std::string_view topic()      const;
 	[[nodiscard]] span<char const> body()       const;
+	[[nodiscard]] std::size_t      wire_size()  const { return sizeof(headers_t) + payload_.size(); }
+	// publish or batch, as opposed to the control frames
+	[[nodiscard]] bool             publication() const {
+	    return headers_.msgaction == publish || headers_.msgaction == batch;
+	}
+
+    // Decodes one frame from the front of `wire` into this message. Returns
+    // the number of bytes consumed, or 0 if `wire` doesn't hold a complete
+    // frame yet. A corrupt header is consumed on its own; check verify().
+    std::size_t decode(span<char const> wire);
+
+    // Hub-wide topic id, set by the hub on frames it fans out so that
+    // connections can alias the topic without looking it up
+    void set_topic_id(std::uint32_t id) { topic_id_ = id; }
+    [[nodiscard]] std::optional<std::uint32_t> topic_id() const { return topic_id_; }
+
+    // Where a traced publication was when (see hub_options::trace_latency),
+    // in monotonic_ns(); 0 where it hasn't been yet
+    struct timestamps {
+        std::uint64_t published    = 0; // publish() called
+        std::uint64_t hub_received = 0; // read by the hub
+        std::uint64_t hub_sent     = 0; // written by the hub, or its sender
+        std::uint64_t received     = 0; // read from the connection, here
+    };
+    void set_stamps(timestamps const& stamps) { stamps_ = stamps; }
+    [[nodiscard]] std::optional<timestamps> const& stamps() const { return stamps_; }
+
+    static std::uint64_t monotonic_ns();
 
   private:
 	#pragma pack(push, 1)
@@ -37,21 +80,14 @@ class hubmessage
         uint16_t	magic;
     };
 	#pragma pack(pop)
+    static_assert(sizeof(headers_t) == headersize);
 
     headers_t headers_;
     boost::container::small_vector<char, preallocated> payload_;
+    std::optional<std::uint32_t> topic_id_;
+    std::optional<timestamps>    stamps_;
 
   public:
-    // input buffer views
-    auto header_buf() {
-        return boost::asio::buffer(&headers_, sizeof(headers_));
-    }
-
-    auto payload_area() {
-        payload_.resize(headers_.topiclen + headers_.bodylen);
-        return boost::asio::buffer(payload_.data(), payload_.size());
-    }
-
     // output buffer views
     [[nodiscard]] auto on_the_wire() const {
         return std::array<boost::asio::const_buffer, 2> { 
@@ -61,6 +97,17 @@ class hubmessage
     }
 };
 
-using hubmessage_queue = std::deque<hubmessage>;
+// Outbound frames are immutable once built, so a single instance can be
+// shared by every subscriber queue it is fanned out to.
+using shared_hubmessage = std::shared_ptr<hubmessage const>;
+using hubmessage_queue  = std::deque<shared_hubmessage, detail::recycling_allocator<shared_hubmessage>>;
+
+// A publication too large for a single frame; it travels in fragments
+struct large_message {
+    std::string                  topic;
+    std::vector<char>            body;
+    std::optional<std::uint32_t> topic_id; // as for hubmessage
+};
+using shared_large_message = std::shared_ptr<large_message const>;
 
 }  // namespace msghublib
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "mpscqueue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace msghublib::detail {
+
+// Work for the topics of one shard (see hub_options::shards), queued by any
+// thread and served in order by one thread at a time. Whoever queues to an
+// idle shard schedules a drain; the drain keeps the shard busy until it
+// served everything queued before it let go.
+template <typename Item>
+class hub_shard
+{
+  public:
+    explicit hub_shard(std::shared_ptr<recycler> nodes) : queue_(std::move(nodes)) {}
+
+    // Returns whether the caller must schedule a drain
+    [[nodiscard]] bool push(Item item) {
+        // counted first, so a drain never serves more than it knows of
+        bool const idle = pending_.fetch_add(1, std::memory_order_acq_rel) == 0;
+        queue_.push(std::move(item));
+        return idle;
+    }
+
+    // Drain only: serves up to `budget` items with `serve`. Returns whether
+    // to schedule another drain, to serve what is left.
+    template <typename Serve> [[nodiscard]] bool drain(std::size_t budget, Serve&& serve) {
+        std::size_t served = 0;
+        for (; served < budget; ++served) {
+            auto item = queue_.pop();
+            if (!item)
+                break; // or halfway queued
+            serve(*item);
+        }
+        // the shard is someone else's once this drops to zero
+        return pending_.fetch_sub(served, std::memory_order_acq_rel) != served;
+    }
+
+  private:
+    mpsc_queue<Item>         queue_;
+    std::atomic<std::size_t> pending_{0}; // queued and not served
+};
+
+}  // namespace msghublib::detail
@@ -1,18 +1,38 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <string_view>
+
+#include "span.h"
 
 namespace msghublib {
     class hubmessage;
+    struct hub_options;
+    struct large_message;
 
     namespace detail {
         class hubclient;
         class hubconnection;
+        struct hub_counters;
 
         struct ihub
         {
             virtual void distribute(std::shared_ptr<hubclient> const& subscriber, hubmessage const& msg) = 0;
             virtual void deliver(hubmessage const& msg) = 0;
+
+            // Large publications, reassembled from fragments
+            virtual void distribute(std::shared_ptr<hubclient> const& publisher,
+                                    std::shared_ptr<large_message> msg) = 0;
+            virtual void deliver(large_message const& msg) = 0;
+            // Streams a chunk of a large publication to the subscribers that
+            // take it piecewise; returns whether others need the whole body
+            virtual bool deliver_chunk(std::string_view topic, span<char const> chunk,
+                                       std::size_t offset, std::size_t total) = 0;
+
+            virtual hub_options const& options() const = 0;
+            // shared: outbound queues settle their counts as they go
+            virtual std::shared_ptr<hub_counters> const& counters() = 0;
         };
     }
 }  // namespace msghublib
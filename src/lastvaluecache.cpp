@@ -0,0 +1,58 @@
+#include "lastvaluecache.h"
+
+namespace msghublib::detail {
+
+    void last_value_cache::store(topic_id id, std::size_t depth, shared_hubmessage frame)
+    {
+        std::lock_guard lk(mx_);
+        auto const size = frame->wire_size();
+        if (!depth || size > max_bytes_)
+            return;
+
+        auto [it, fresh] = topics_.try_emplace(id);
+        auto& t = it->second;
+        if (fresh) {
+            t.recent = recent_.insert(recent_.begin(), id);
+        } else {
+            recent_.splice(recent_.begin(), recent_, t.recent);
+        }
+
+        t.frames.push_back(std::move(frame));
+        t.bytes += size;
+        bytes_ += size;
+
+        while (t.frames.size() > depth)
+            pop_oldest(t);
+
+        // the least recent topics go first, then this one's older frames
+        while (bytes_ > max_bytes_) {
+            if (recent_.back() != id)
+                erase(topics_.find(recent_.back()));
+            else
+                pop_oldest(t);
+        }
+    }
+
+    void last_value_cache::drop(topic_id id)
+    {
+        std::lock_guard lk(mx_);
+        if (auto it = topics_.find(id); it != topics_.end())
+            erase(it);
+    }
+
+    void last_value_cache::pop_oldest(topic& t)
+    {
+        auto const n = t.frames.front()->wire_size();
+        t.frames.erase(t.frames.begin());
+        t.bytes -= n;
+        bytes_ -= n;
+    }
+
+    void last_value_cache::erase(std::unordered_map<topic_id, topic>::iterator it)
+    {
+        bytes_ -= it->second.bytes;
+        recent_.erase(it->second.recent);
+        topics_.erase(it);
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "topicregistry.h"
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include <boost/container/small_vector.hpp>
+
+namespace msghublib::detail {
+
+// The latest publications to retained topics (see msghub::retain), by
+// topic id, within a byte budget: once over it, the topics published to
+// least recently lose theirs first. Frames are kept as built for the
+// fan-out, so replaying them shares them as well.
+class last_value_cache
+{
+  public:
+    explicit last_value_cache(std::size_t max_bytes) : max_bytes_(max_bytes) {}
+    last_value_cache(last_value_cache const&)            = delete;
+    last_value_cache& operator=(last_value_cache const&) = delete;
+
+    // Keeps `frame` as the latest of `id`, with at most `depth - 1` before it
+    void store(topic_id id, std::size_t depth, shared_hubmessage frame);
+    void drop(topic_id id);
+
+    // Invokes `f` with the frames kept for `id`, oldest first
+    template <typename F> void replay(topic_id id, F f) const {
+        std::lock_guard lk(mx_);
+        if (auto it = topics_.find(id); it != topics_.end())
+            for (auto const& frame : it->second.frames)
+                f(frame);
+    }
+
+    [[nodiscard]] std::size_t bytes() const {
+        std::lock_guard lk(mx_);
+        return bytes_;
+    }
+
+  private:
+    struct topic {
+        boost::container::small_vector<shared_hubmessage, 1> frames; // oldest first
+        std::size_t                                          bytes = 0;
+        std::list<topic_id>::iterator                        recent;
+    };
+
+    void pop_oldest(topic& t);
+    void erase(std::unordered_map<topic_id, topic>::iterator it);
+
+    mutable std::mutex                  mx_;
+    std::size_t                         max_bytes_, bytes_ = 0;
+    std::unordered_map<topic_id, topic> topics_;
+    std::list<topic_id>                 recent_; // most recently stored first
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,477 @@
+#include "messagelog.h"
+#include "hubcounters.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace msghublib::detail {
+
+    namespace {
+        struct record {
+            std::uint32_t marker;
+            std::uint32_t size;
+            std::uint64_t sequence;
+            std::int64_t  time;
+        };
+        static_assert(sizeof(record) == 24);
+
+        constexpr std::uint32_t record_marker = 0x474F4C4D; // "MLOG"
+
+        std::size_t footprint(std::size_t body) {
+            return (sizeof(record) + body + 7) & ~std::size_t(7);
+        }
+
+        // Invokes `f(record, body)` for the records in `data`, while it
+        // returns true; returns the extent of the records
+        template <typename F> std::size_t for_each_record(char const* data, std::size_t size, F f) {
+            std::size_t at = 0;
+            while (size - at >= sizeof(record)) {
+                record r;
+                std::memcpy(&r, data + at, sizeof(r));
+                if (r.marker != record_marker || r.size > size - at - sizeof(record))
+                    break;
+                if (!f(r, data + at + sizeof(record)))
+                    break;
+                at += std::min(footprint(r.size), size - at);
+            }
+            return at;
+        }
+
+        // Topics become directory names: bytes other than letters, digits,
+        // '_', '-' and non-leading '.' are escaped as %XX
+        std::string encode(std::string_view topic) {
+            std::string name;
+            for (std::size_t i = 0; i < topic.size(); ++i) {
+                auto const c = static_cast<unsigned char>(topic[i]);
+                if (std::isalnum(c) || c == '_' || c == '-' || (c == '.' && i)) {
+                    name += static_cast<char>(c);
+                } else {
+                    char escaped[4];
+                    std::snprintf(escaped, sizeof(escaped), "%%%02X", c);
+                    name += escaped;
+                }
+            }
+            return name.empty() ? "%" : name; // the empty topic
+        }
+
+        std::string decode(std::string_view name) {
+            if (name == "%")
+                return {};
+            std::string topic;
+            for (std::size_t i = 0; i < name.size(); ++i) {
+                unsigned c = static_cast<unsigned char>(name[i]), escaped = 0;
+                if (name[i] == '%' && i + 2 < name.size()) {
+                    // not ours if it isn't two hex digits: taken literally
+                    auto const [end, error] =
+                        std::from_chars(name.data() + i + 1, name.data() + i + 3, escaped, 16);
+                    if (error == std::errc{} && end == name.data() + i + 3) {
+                        c = escaped;
+                        i += 2;
+                    }
+                }
+                topic += static_cast<char>(c);
+            }
+            return topic;
+        }
+
+        std::filesystem::path segment_path(std::filesystem::path const& directory, std::uint64_t first) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.log", static_cast<unsigned long long>(first));
+            return directory / name;
+        }
+
+        // First sequence numbers of the segments in `directory`, ascending
+        std::vector<std::uint64_t> segments(std::filesystem::path const& directory) {
+            std::vector<std::uint64_t> firsts;
+            std::error_code ec;
+            for (auto const& entry : std::filesystem::directory_iterator(directory, ec)) {
+                auto const name = entry.path().filename().string();
+                std::uint64_t first;
+                if (entry.path().extension() == ".log" &&
+                    std::from_chars(name.data(), name.data() + name.size() - 4, first).ptr ==
+                        name.data() + name.size() - 4)
+                    firsts.push_back(first);
+            }
+            std::sort(firsts.begin(), firsts.end());
+            return firsts;
+        }
+
+        // Maps a segment file, creating it `size` bytes long if writable.
+        // Its blocks are allocated up front: writing to a hole of a shared
+        // mapping on a full disk raises SIGBUS, failing here drops a frame.
+        std::pair<char*, std::size_t> map(std::filesystem::path const& path, std::size_t size, bool writable) {
+            int const fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return {nullptr, 0};
+
+            struct stat st {};
+            bool ok = ::fstat(fd, &st) == 0;
+            if (ok && writable) {
+                size = std::max(size, static_cast<std::size_t>(st.st_size));
+                ok   = ::posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+            } else if (ok) {
+                size = st.st_size;
+            }
+
+            void* data = ok && size ? ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                                             MAP_SHARED, fd, 0)
+                                    : MAP_FAILED;
+            ::close(fd);
+            if (data == MAP_FAILED)
+                return {nullptr, 0};
+            return {static_cast<char*>(data), size};
+        }
+
+        // Time of the first record in a segment file, if any
+        std::optional<std::int64_t> first_time(std::filesystem::path const& path) {
+            int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return std::nullopt;
+            record r{};
+            bool const read = ::pread(fd, &r, sizeof(r), 0) == sizeof(r);
+            ::close(fd);
+            if (!read || r.marker != record_marker)
+                return std::nullopt;
+            return r.time;
+        }
+
+        std::size_t page_size() {
+            static std::size_t const size = ::sysconf(_SC_PAGESIZE);
+            return size;
+        }
+    }
+
+    message_log::message_log(std::filesystem::path directory, std::size_t segment_size,
+                             std::chrono::milliseconds sync_interval, std::size_t backlog,
+                             std::shared_ptr<hub_counters> counters)
+        : directory_(std::move(directory))
+        , segment_size_(segment_size)
+        , sync_interval_(sync_interval)
+        , backlog_(backlog)
+        , counters_(std::move(counters))
+        , last_sync_(std::chrono::steady_clock::now())
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    message_log::~message_log()
+    {
+        {
+            std::lock_guard lk(mx_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        room_.notify_all();
+        thread_.join();
+
+        for (auto& [id, log] : logs_)
+            if (log.current.data)
+                ::munmap(log.current.data, log.current.size);
+    }
+
+    std::vector<std::string> message_log::topics() const
+    {
+        std::vector<std::string> found;
+        std::error_code ec;
+        for (auto const& entry : std::filesystem::directory_iterator(directory_, ec))
+            if (entry.is_directory(ec))
+                found.push_back(decode(entry.path().filename().string()));
+        return found;
+    }
+
+    bool message_log::append(topic_id id, shared_hubmessage frame, std::int64_t time)
+    {
+        auto const queued = appends_.fetch_add(1, std::memory_order_relaxed) + 1;
+        push({id, std::move(frame), nullptr, time});
+        return !backlog_ || queued < backlog_;
+    }
+
+    void message_log::when_room(std::function<void()> resume)
+    {
+        {
+            std::lock_guard lk(mx_);
+            if (crowded() && !stopping_) {
+                waiting_.push_back(std::move(resume));
+                return;
+            }
+        }
+        resume();
+    }
+
+    void message_log::wait_for_room()
+    {
+        // the publisher waits for the disk, rather than the queue growing
+        if (backlog_ && appends_.load(std::memory_order_relaxed) >= backlog_) {
+            counters_->local().publishers_paused.fetch_add(1, std::memory_order_relaxed);
+            std::unique_lock lk(mx_);
+            room_.wait(lk, [this] { return appends_.load() < backlog_ || stopping_; });
+        }
+    }
+
+    void message_log::replay(std::vector<std::pair<topic_id, std::string>> topics, log_position from,
+                             sender send, std::function<bool()> ready, std::function<void()> done)
+    {
+        auto request = std::make_shared<replay_request>();
+        request->topics = std::move(topics);
+        request->from   = from;
+        request->send   = std::move(send);
+        request->ready  = std::move(ready);
+        request->done   = std::move(done);
+        push({0, nullptr, std::move(request), 0});
+    }
+
+    void message_log::push(item i)
+    {
+        if (queue_.push(std::move(i))) {
+            std::lock_guard lk(mx_);
+            scheduled_ = true;
+            wake_.notify_one();
+        }
+    }
+
+    void message_log::release_room()
+    {
+        std::vector<std::function<void()>> resumed;
+        {
+            std::lock_guard lk(mx_);
+            room_.notify_all();
+            if (!crowded())
+                resumed.swap(waiting_);
+        }
+        for (auto& resume : resumed)
+            resume();
+    }
+
+    void message_log::run()
+    {
+        for (;;) {
+            {
+                std::unique_lock lk(mx_);
+                auto const woken = [this] { return scheduled_ || stopping_; };
+                auto deadline = std::chrono::steady_clock::time_point::max();
+                if (unsynced_)
+                    deadline = last_sync_ + sync_interval_;
+                if (!paused_.empty())
+                    deadline = std::min(deadline, std::chrono::steady_clock::now() + replay_poll);
+                if (deadline != std::chrono::steady_clock::time_point::max())
+                    wake_.wait_until(lk, deadline, woken);
+                else
+                    wake_.wait(lk, woken);
+
+                if (stopping_ && !scheduled_)
+                    break;
+                scheduled_ = false;
+            }
+
+            // after every batch, the last one included
+            for (bool more = true; more;) {
+                more = queue_.drain(256, [this](item& i) { serve(i); });
+                if (backlog_)
+                    release_room();
+            }
+
+            // replays whose subscribers took in what they were sent
+            for (auto& request : std::exchange(paused_, {})) {
+                if (request->ready())
+                    replay(std::move(request));
+                else
+                    paused_.push_back(std::move(request));
+            }
+
+            if (unsynced_ && std::chrono::steady_clock::now() >= last_sync_ + sync_interval_)
+                sync();
+        }
+        sync();
+    }
+
+    void message_log::serve(item& i)
+    {
+        if (i.replay) {
+            replay(std::move(i.replay));
+        } else {
+            append(open(i.id, i.frame->topic()), *i.frame, i.time);
+            appends_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    message_log::topic_log& message_log::open(topic_id id, std::string_view name)
+    {
+        auto [it, fresh] = logs_.try_emplace(id);
+        auto& log = it->second;
+        if (!fresh)
+            return log;
+
+        log.directory = directory_ / encode(name);
+        std::error_code ec;
+        std::filesystem::create_directories(log.directory, ec);
+
+        // appending goes on in the last segment, after its last record
+        if (auto const firsts = segments(log.directory); !firsts.empty()) {
+            auto const [data, size] = map(segment_path(log.directory, firsts.back()), 0, true);
+            log.next = firsts.back();
+            if (data) {
+                log.current = {firsts.back(), data, size, 0, 0};
+                log.current.used = log.current.synced = for_each_record(data, size, [&](record const& r, char const*) {
+                    log.next = r.sequence + 1;
+                    return true;
+                });
+            }
+        }
+        return log;
+    }
+
+    void message_log::append(topic_log& log, hubmessage const& frame, std::int64_t time)
+    {
+        auto const body = frame.body();
+        auto const need = footprint(body.size());
+
+        auto& s = log.current;
+        if (!s.data || s.size - s.used < need) {
+            if (s.data) {
+                auto const from = s.synced & ~(page_size() - 1);
+                ::msync(s.data + from, s.used - from, MS_SYNC);
+                ::munmap(s.data, s.size);
+                s = {};
+            }
+
+            auto const [data, size] =
+                map(segment_path(log.directory, log.next), std::max(segment_size_, need), true);
+            if (!data) {
+                // lost, but the sequence stays gapless
+                counters_->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            s = {log.next, data, size, 0, 0};
+        }
+
+        // the marker goes last, so a torn record doesn't show
+        auto* at = s.data + s.used;
+        record r{0, static_cast<std::uint32_t>(body.size()), log.next, time};
+        std::memcpy(at + sizeof(record), body.data(), body.size());
+        std::memcpy(at, &r, sizeof(r));
+        r.marker = record_marker;
+        std::memcpy(at, &r.marker, sizeof(r.marker));
+
+        s.used += need;
+        ++log.next;
+        log.dirty = unsynced_ = true;
+    }
+
+    void message_log::replay(std::shared_ptr<replay_request> request)
+    {
+        // what was appended before the replay was queued, and no more
+        if (request->until.empty()) {
+            for (auto const& [id, name] : request->topics)
+                request->until.push_back(open(id, name).next);
+        }
+
+        std::vector<shared_hubmessage> batch;
+        bool const finished = collect(*request, batch);
+        if (!batch.empty() && !request->send(std::move(batch)))
+            return request->done();
+        if (finished)
+            request->done();
+        else
+            paused_.push_back(std::move(request));
+    }
+
+    message_log::mapping::~mapping()
+    {
+        if (data)
+            ::munmap(data, size);
+    }
+
+    bool message_log::collect(replay_request& request, std::vector<shared_hubmessage>& batch)
+    {
+        auto const& from = request.from;
+        for (; request.topic < request.topics.size(); ++request.topic, request.started = false) {
+            auto const& [id, name] = request.topics[request.topic];
+            auto const until       = request.until[request.topic];
+
+            if (!request.started) {
+                // the topic's segments, less those wholly before `from`
+                auto& log = open(id, name);
+                request.segments = segments(log.directory);
+                std::size_t i = 0;
+                for (; i + 1 < request.segments.size(); ++i) {
+                    auto const next = request.segments[i + 1];
+                    if (from.kind == log_position::by::sequence && next > from.value)
+                        break;
+                    if (from.kind == log_position::by::time) {
+                        auto const time = first_time(segment_path(log.directory, next));
+                        if (!time || *time > static_cast<std::int64_t>(from.value))
+                            break;
+                    }
+                }
+                request.segments.erase(request.segments.begin(), request.segments.begin() + i);
+                request.segment = 0;
+                request.mapped  = {};
+                request.offset  = 0;
+                request.started = true;
+            }
+
+            bool stop = false, full = false; // past `until`, resp. the batch is
+            for (; request.segment < request.segments.size() && !stop; ++request.segment, request.mapped = {}) {
+                auto const first = request.segments[request.segment];
+                if (first >= until)
+                    break;
+
+                if (!request.mapped.data) {
+                    auto const [data, size] = map(segment_path(open(id, name).directory, first), 0, false);
+                    if (!data)
+                        continue;
+                    request.mapped = {data, size};
+                    request.offset = 0;
+                }
+
+                auto const& m = request.mapped;
+                request.offset += for_each_record(m.data + request.offset, m.size - request.offset,
+                                                  [&](record const& r, char const* body) {
+                    if (r.sequence >= until)
+                        return !(stop = true);
+                    bool const wanted = from.kind == log_position::by::sequence
+                        ? r.sequence >= from.value
+                        : r.time >= static_cast<std::int64_t>(from.value);
+                    if (wanted) {
+                        if (batch.size() == replay_batch)
+                            return !(stop = full = true);
+                        auto frame = std::make_shared<hubmessage>(hubmessage::action::publish, name,
+                                                                  span<char const>(body, r.size));
+                        frame->set_topic_id(id);
+                        batch.push_back(std::move(frame));
+                    }
+                    return true;
+                });
+
+                if (full)
+                    return false; // goes on at this record
+            }
+        }
+        return true;
+    }
+
+    void message_log::sync()
+    {
+        for (auto& [id, log] : logs_) {
+            auto& s = log.current;
+            if (!log.dirty || !s.data)
+                continue;
+            auto const from = s.synced & ~(page_size() - 1);
+            ::msync(s.data + from, s.used - from, MS_SYNC);
+            s.synced  = s.used;
+            log.dirty = false;
+        }
+        unsynced_  = false;
+        last_sync_ = std::chrono::steady_clock::now();
+    }
+
+}  // namespace msghublib::detail
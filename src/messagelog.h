@@ -0,0 +1,177 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "hubshard.h"
+#include "topicregistry.h"
+#include "wireprotocol.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace msghublib::detail {
+
+struct hub_counters;
+
+// Durable, append-only log of the publications to persisted topics (see
+// msghub::persist): a directory per topic, holding segment files named by
+// the sequence number of their first record. Segments are memory mapped
+// and written sequentially, a record being
+//
+//   uint32  marker     record_marker; 0 past the last record
+//   uint32  bodylen
+//   uint64  sequence   per topic, from 0
+//   int64   time       nanoseconds since the epoch, when the hub served it
+//   body               padded to a multiple of 8 bytes
+//
+// Appends and replays are queued to a thread of the log's own and served
+// in order: once `backlog` appends are queued, publishers are to hold off
+// until the thread worked through half of them, and a replay covers exactly
+// what was appended before it was queued. The thread flushes what it wrote at most every `sync_interval`
+// (0: after every batch it served), and once more when the log is
+// destroyed; a crash loses what wasn't. Appends it fails to write count as
+// dropped frames.
+class message_log
+{
+  public:
+    // Takes a batch of replayed frames; false if they have nowhere to go
+    using sender = std::function<bool(std::vector<shared_hubmessage>)>;
+
+    message_log(std::filesystem::path directory, std::size_t segment_size,
+                std::chrono::milliseconds sync_interval, std::size_t backlog,
+                std::shared_ptr<hub_counters> counters);
+    message_log(message_log const&)            = delete;
+    message_log& operator=(message_log const&) = delete;
+    ~message_log();
+
+    // Topics with a log on disk, from any thread
+    [[nodiscard]] std::vector<std::string> topics() const;
+
+    // Queues `frame`, a publication to the topic interned as `id`. Returns
+    // false once the backlog is full: its publisher should hold off until
+    // when_room().
+    bool append(topic_id id, shared_hubmessage frame, std::int64_t time);
+    // Invokes `resume` once the backlog is down to half: right away if it
+    // is, otherwise on the log's thread
+    void when_room(std::function<void()> resume);
+    // Blocks until the backlog isn't full, for publishers that can't hold
+    // off otherwise; never call it under a lock the log's thread takes
+    void wait_for_room();
+    // Queues a replay of `topics` (ids and names), each from `from` on:
+    // `send` gets frames of their records in batches, one topic after the
+    // other, the next batch once `ready()` (polled meanwhile), then `done`
+    // is invoked, all on the log's thread
+    void replay(std::vector<std::pair<topic_id, std::string>> topics, log_position from,
+                sender send, std::function<bool()> ready, std::function<void()> done);
+
+  private:
+    static constexpr std::size_t replay_batch = 256; // records
+    static constexpr std::chrono::milliseconds replay_poll{1};
+
+    // A segment file mapped for reading, unmapped when let go
+    struct mapping {
+        char*       data = nullptr;
+        std::size_t size = 0;
+
+        mapping() = default;
+        mapping(char* d, std::size_t s) : data(d), size(s) {}
+        mapping(mapping&& other) noexcept
+            : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+        mapping& operator=(mapping&& other) noexcept {
+            mapping(std::move(other)).swap(*this);
+            return *this;
+        }
+        ~mapping();
+        void swap(mapping& other) noexcept {
+            std::swap(data, other.data);
+            std::swap(size, other.size);
+        }
+    };
+
+    struct replay_request {
+        std::vector<std::pair<topic_id, std::string>> topics;
+        log_position                                  from;
+        sender                                        send;
+        std::function<bool()>                         ready;
+        std::function<void()>                         done;
+        // progress: the sequence number past each topic's replay, fixed
+        // when first served, and the topic being replayed. Within it, its
+        // segments from the first holding `from` on, the one being read,
+        // kept mapped between batches, and the offset of the next record
+        // in it, so that a batch picks up where the last one stopped.
+        std::vector<std::uint64_t> until;
+        std::size_t                topic = 0;
+        std::vector<std::uint64_t> segments; // first sequence numbers
+        std::size_t                segment = 0;
+        mapping                    mapped;
+        std::size_t                offset  = 0;
+        bool                       started = false; // the topic
+    };
+    struct item {
+        topic_id                        id = 0;
+        shared_hubmessage               frame; // or:
+        std::shared_ptr<replay_request> replay;
+        std::int64_t                    time = 0;
+    };
+
+    // A mapped segment file
+    struct segment {
+        std::uint64_t first = 0; // sequence number of its first record
+        char*         data  = nullptr;
+        std::size_t   size = 0, used = 0, synced = 0;
+    };
+    struct topic_log {
+        std::filesystem::path directory;
+        std::uint64_t         next = 0; // sequence number of the next append
+        segment               current;  // being appended to, if mapped
+        bool                  dirty = false;
+    };
+
+    void        run();
+    void        push(item i);
+    void        serve(item& i);
+    topic_log&  open(topic_id id, std::string_view name);
+    void        append(topic_log& log, hubmessage const& frame, std::int64_t time);
+    void        replay(std::shared_ptr<replay_request> request);
+    bool        collect(replay_request& request, std::vector<shared_hubmessage>& batch);
+    void        sync();
+    void        release_room();
+    [[nodiscard]] bool crowded() const { return appends_.load() > backlog_ / 2; }
+
+    std::filesystem::path     directory_;
+    std::size_t               segment_size_;
+    std::chrono::milliseconds sync_interval_;
+    std::size_t               backlog_;
+    std::shared_ptr<hub_counters> counters_;
+
+    hub_shard<item>          queue_{std::make_shared<recycler>()};
+    std::atomic<std::size_t> appends_{0}; // queued
+    std::mutex               mx_;
+    std::condition_variable  wake_;
+    std::condition_variable  room_; // for appends, under the backlog again
+    std::vector<std::function<void()>> waiting_; // until not crowded()
+    bool                    scheduled_ = false; // items queued since the thread last looked
+    bool                    stopping_  = false;
+
+    // the log's thread only
+    std::unordered_map<topic_id, topic_log> logs_;
+    std::vector<std::shared_ptr<replay_request>> paused_; // replays not ready for more
+    bool                                    unsynced_ = false;
+    std::chrono::steady_clock::time_point   last_sync_;
+
+    std::thread thread_; // last, it uses all of the above
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,49 @@
+#include "messagepool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace msghublib::detail {
+
+    std::shared_ptr<hubmessage> message_pool::make(hubmessage::action action, std::string_view topic,
+                                                   span<char const> body)
+    {
+        if (auto frame = recycle()) {
+            frame->assign(action, topic, body);
+            return frame;
+        }
+        return std::make_shared<hubmessage>(action, topic, body);
+    }
+
+    std::shared_ptr<hubmessage> message_pool::make(hubmessage const& msg)
+    {
+        if (auto frame = recycle()) {
+            *frame = msg;
+            return frame;
+        }
+        return std::make_shared<hubmessage>(msg);
+    }
+
+    std::shared_ptr<hubmessage> message_pool::recycle()
+    {
+        std::lock_guard lk(mx_);
+        if (!capacity_)
+            return nullptr;
+
+        if (frames_.size() < capacity_)
+            return frames_.emplace_back(std::make_shared<hubmessage>());
+
+        // skip the frames still queued somewhere, oldest first
+        for (std::size_t n = 0; n < std::min(probes, capacity_); ++n) {
+            auto& frame = frames_[next_];
+            next_ = (next_ + 1) % capacity_;
+            if (frame.use_count() == 1) {
+                // the last other owner released it with acq_rel, see its writes
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return frame;
+            }
+        }
+        return nullptr;
+    }
+
+}  // namespace msghublib::detail
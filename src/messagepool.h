@@ -0,0 +1,39 @@
+#pragma once
+
+#include "hubmessage.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Recycles the frames built for one connection (or the hub's own
+// publications). Frames are shared by the queues they are fanned out to; a
+// frame is reused, with its payload storage, once the pool holds the only
+// reference left. Frames are handed out round robin, so the oldest is tried
+// first; busy ones are skipped, and should the next few all be in use (the
+// rest, being younger, most likely are too) a new one is made, outside the
+// pool. A backlog thus costs each frame a few probes, not a pass over all.
+class message_pool
+{
+  public:
+    explicit message_pool(std::size_t capacity) : capacity_(capacity) {}
+
+    std::shared_ptr<hubmessage> make(hubmessage::action action, std::string_view topic,
+                                     span<char const> body);
+    std::shared_ptr<hubmessage> make(hubmessage const& msg);
+
+  private:
+    std::shared_ptr<hubmessage> recycle();
+
+    static constexpr std::size_t probes = 8; // frames tried per make
+
+    std::mutex                               mx_;
+    std::size_t                              capacity_;
+    std::vector<std::shared_ptr<hubmessage>> frames_;
+    std::size_t                              next_ = 0;
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "recycler.h"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace msghublib::detail {
+
+// Unbounded multiple producer, single consumer queue (Vyukov's): a push is
+// a single exchange, a pop touches no shared cache line unless the queue
+// runs empty. Nodes come from a recycler.
+template <typename T>
+class mpsc_queue
+{
+  public:
+    explicit mpsc_queue(std::shared_ptr<recycler> nodes) : alloc_(std::move(nodes)) {}
+    mpsc_queue(mpsc_queue const&)            = delete;
+    mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+    ~mpsc_queue() {
+        while (pop())
+            ;
+    }
+
+    // From any thread
+    void push(T value) {
+        node* n = alloc_.allocate(1);
+        ::new (n) node{{nullptr}, std::move(value)};
+        link(n);
+    }
+
+    // Consumer only. Comes up empty while a push is halfway, too.
+    std::optional<T> pop() {
+        node* tail = tail_;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next)
+                return std::nullopt;
+            tail_ = tail = next;
+            next  = next->next.load(std::memory_order_acquire);
+        }
+
+        if (!next) {
+            if (tail != head_.load(std::memory_order_acquire))
+                return std::nullopt; // a producer is about to link next
+            link(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if (!next)
+                return std::nullopt;
+        }
+
+        tail_ = next;
+        std::optional<T> value(std::move(tail->value));
+        tail->~node();
+        alloc_.deallocate(tail, 1);
+        return value;
+    }
+
+  private:
+    struct node {
+        std::atomic<node*> next;
+        T                  value;
+    };
+
+    void link(node* n) {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    recycling_allocator<node> alloc_;
+    node                      stub_{{nullptr}, T{}};
+    std::atomic<node*>        head_{&stub_}; // producers
+    node*                     tail_ = &stub_; // consumer
+};
+
+}  // namespace msghublib::detail
@@ -1,12 +1,52 @@
 #include "msghub.h"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <utility>
 
+#include <pthread.h>
+#include <sched.h>
+
 #include "hubclient.h"
 #include "hubconnection.h"
+#include "endpoints.h"
+#include "hubcounters.h"
+#include "hubshard.h"
 #include "ihub.h"
+#include "lastvaluecache.h"
+#include "messagelog.h"
+#include "rcu.h"
+#include "sysreport.h"
+#include "topicregistry.h"
+#include "topictrie.h"
+#include "wireprotocol.h"
+
+#include <boost/container/small_vector.hpp>
 
 using boost::asio::ip::tcp;
+using local_acceptor = boost::asio::local::stream_protocol::acceptor;
+
+namespace {
+    // SO_REUSEPORT, which asio has no option for
+    class reuse_port {
+      public:
+        explicit reuse_port(bool on) : value_(on) {}
+
+        template <typename Protocol> int         level(Protocol const&) const { return SOL_SOCKET; }
+        template <typename Protocol> int         name(Protocol const&) const { return SO_REUSEPORT; }
+        template <typename Protocol> int const*  data(Protocol const&) const { return &value_; }
+        template <typename Protocol> std::size_t size(Protocol const&) const { return sizeof(value_); }
+
+      private:
+        int value_;
+    };
+}
 
 namespace msghublib {
 
@@ -18,24 +58,296 @@ namespace msghublib {
         using hubconnection = detail::hubconnection;
 
       private:
+        hub_options const options_;
+        std::shared_ptr<detail::hub_counters> counters_ = std::make_shared<detail::hub_counters>();
+        detail::topic_table<detail::topic_count>        topic_counts_; // by topic id
+        detail::topic_table<detail::topic_latency_slot> latencies_;    // of our own subscribers
         any_io_executor executor_;
         boost::asio::executor_work_guard<any_io_executor> work_ =
             make_work_guard(executor_);
         tcp::acceptor acceptor_;
+        local_acceptor local_acceptor_; // same host clients, alongside TCP
+        std::string local_path_;        // socket file to remove on stop
         std::shared_ptr<hubconnection> remote_hub_; // using std::atomic_* accessors
+        // set once this instance serves the hub: local subscriptions are then
+        // served in-process instead of through a loopback connection
+        std::atomic_bool owner_{false};
+
+        // Subscriptions are read on every message by every io thread, and
+        // change rarely: readers pin a snapshot, writers publish a new one.
+        // Topics are interned, per-topic state is indexed by topic id; both
+        // the registry and the entries are shared between snapshots until
+        // a writer changes them.
+        //
+        // Wildcard subscriptions are entries too, their patterns are indexed
+        // by a trie; entries cache the ids of the patterns they match.
+        // Published topics only get an entry when something keeps state for
+        // them: a retain() or persist() rule, or a conflated wildcard
+        // subscription (see hubclient). Others are matched anew on every
+        // publication, so any number of them costs nothing to keep. Entries
+        // are never released (ids index per-topic state everywhere, and
+        // connections alias topics by id), hence hub_options::max_topics.
+        struct topic_entry {
+            msghub::onmessage                     local;
+            msghub::onchunk                       streamed; // instead of local
+            std::vector<std::weak_ptr<hubclient>> remote;
+            std::vector<detail::topic_id>         matches; // wildcard entries
+            std::size_t                           retained = 0; // see retain()
+            bool                                  logged   = false; // see persist()
+            std::optional<std::chrono::milliseconds> conflation; // asked of the hub
+
+            [[nodiscard]] bool subscribed() const { return local || streamed || !remote.empty(); }
+            [[nodiscard]] bool local_subscribed() const { return local || streamed; }
+
+            void invoke(std::string_view topic, span<char const> body) const {
+                if (local)
+                    local(topic, body);
+                if (streamed)
+                    streamed(topic, body, 0, body.size());
+            }
+        };
+        struct subscriptions {
+            std::shared_ptr<detail::topic_registry const> topics =
+                std::make_shared<detail::topic_registry>();
+            std::shared_ptr<detail::topic_trie const> patterns =
+                std::make_shared<detail::topic_trie>();
+            std::vector<std::shared_ptr<topic_entry const>> entries; // by topic id
+
+            // retain() rules, their topics (or patterns) indexed by a trie
+            std::vector<std::pair<std::string, std::size_t>> retain_rules;
+            std::shared_ptr<detail::topic_trie const> retains =
+                std::make_shared<detail::topic_trie>();
+
+            // persist() rules, likewise
+            std::vector<std::string>                  log_rules;
+            std::shared_ptr<detail::topic_trie const> logs =
+                std::make_shared<detail::topic_trie>();
+
+            // patterns remote subscribers ever asked to conflate: connections
+            // conflate by topic id
+            std::vector<std::string>                  conflated_patterns;
+            std::shared_ptr<detail::topic_trie const> conflated =
+                std::make_shared<detail::topic_trie>();
+
+            void conflate(std::string_view pattern) {
+                auto& rules = conflated_patterns;
+                if (std::find(rules.begin(), rules.end(), pattern) != rules.end())
+                    return;
+                rules.emplace_back(pattern);
+
+                auto trie = std::make_shared<detail::topic_trie>(*conflated);
+                trie->insert(pattern, rules.size() - 1);
+                conflated = std::move(trie);
+            }
+
+            // Whether publications to `topic` need an entry
+            [[nodiscard]] bool keeps(std::string_view topic) const {
+                return !retains->match(topic).empty() || !logs->match(topic).empty() ||
+                    !conflated->match(topic).empty();
+            }
+
+            [[nodiscard]] std::size_t retain_depth(std::string_view topic) const {
+                std::size_t depth = 0;
+                for (auto rule : retains->match(topic))
+                    depth = std::max(depth, retain_rules[rule].second);
+                return depth;
+            }
+
+            topic_entry const* find(std::string_view topic) const {
+                auto id = topics->find(topic);
+                return id ? entries[*id].get() : nullptr;
+            }
+
+            // Copy of the entry for `topic`, interning it if necessary
+            topic_entry& edit(std::string_view topic) {
+                auto id = topics->find(topic);
+                if (!id) {
+                    auto grown = std::make_shared<detail::topic_registry>(*topics);
+                    id = grown->intern(topic);
+                    topics = std::move(grown);
+                    entries.resize(*id + 1);
+
+                    auto& entry = edit(*id);
+                    entry.matches  = patterns->match(topic);
+                    entry.retained = retain_depth(topic);
+                    entry.logged   = !logs->match(topic).empty();
+                    return entry;
+                }
+                return edit(*id);
+            }
+
+            topic_entry& edit(detail::topic_id id) {
+                auto& slot = entries[id];
+                auto copy = slot ? std::make_shared<topic_entry>(*slot)
+                                 : std::make_shared<topic_entry>();
+                slot = copy;
+                return *copy;
+            }
+
+            // Indexes pattern `id` once it has subscribers, or drops it
+            // once it has none, updating the cached matches of the entries
+            // it matches. Only a change there costs a pass over the entries.
+            void refresh_pattern(detail::topic_id id) {
+                auto const name = topics->name(id);
+                bool const live = entries[id] && entries[id]->subscribed();
+                if (!detail::topic_trie::is_pattern(name) || live == patterns->contains(id))
+                    return;
+
+                auto trie = std::make_shared<detail::topic_trie>(*patterns);
+                if (live)
+                    trie->insert(name, id);
+                else
+                    trie->erase(name, id);
+                patterns = std::move(trie);
 
-        // the subscriptions are under mutex
-        std::mutex mutable mutex_;
-        std::map<std::string, msghub::onmessage> local_subs_;
-        std::multimap<std::string, std::weak_ptr<hubclient>> remote_subs_;
+                detail::topic_trie alone;
+                alone.insert(name, id);
+                for (detail::topic_id t = 0; t < entries.size(); ++t) {
+                    if (!entries[t] || alone.match(topics->name(t)).empty())
+                        continue;
+                    auto& matches = edit(t).matches;
+                    if (live)
+                        matches.insert(std::upper_bound(matches.begin(), matches.end(), id), id);
+                    else
+                        std::erase(matches, id);
+                }
+            }
+
+            void refresh_pattern(std::string_view topic) {
+                if (auto id = topics->find(topic))
+                    refresh_pattern(*id);
+            }
+        };
+        detail::rcu_value<subscriptions> subs_;
+
+        // Where publications to a topic go: its entry, if it has one, and
+        // the wildcard entries it matches (cached by the entry otherwise)
+        struct route {
+            std::optional<detail::topic_id> id;
+            detail::topic_trie::match_list  matches;
+        };
+        // Publications to retained or persisted topics are kept (resp.
+        // queued to the log), and fanned out, under the lock for their topic
+        // that new subscribers register under, so a subscriber gets each
+        // either replayed or live
+        detail::last_value_cache         retained_{options_.retain_bytes};
+        std::array<std::mutex, 64>       topic_locks_;
+        std::unique_ptr<detail::message_log> log_ = options_.log_directory.empty()
+            ? nullptr
+            : std::make_unique<detail::message_log>(options_.log_directory, options_.log_segment_size,
+                                                    options_.log_sync_interval, options_.log_backlog,
+                                                    counters_);
+        detail::message_pool             pool_{options_.message_pool_size}; // our own publications
+        std::atomic_bool purge_pending_{false};
+
+        // Publications from clients, framed, handed to the shard of their
+        // topic when sharding. Only the topic's id travels with them; the
+        // shard matches the topics without one by itself.
+        struct shard_item {
+            std::shared_ptr<hubclient>      publisher;
+            std::shared_ptr<hubmessage>     frame;
+            std::shared_ptr<large_message>  large; // instead of a frame
+            std::optional<detail::topic_id> id;
+        };
+        using shard = detail::hub_shard<shard_item>;
+        std::vector<std::unique_ptr<shard>> shards_;
+
+        // With hub_options::io_contexts, TCP clients are served by lanes: an
+        // io_context and its thread, with an acceptor of its own. Lanes are
+        // joined on stop and before we go, so their handlers need not keep
+        // us alive; a stopped lane is replaced by a fresh one on create.
+        struct lane_context : boost::asio::io_context {
+            using io_context::io_context;
+            using io_context::shutdown; // destroys the handlers left
+        };
+        struct lane {
+            lane_context  context{1}; // the only thread to run it
+            boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work =
+                make_work_guard(context);
+            tcp::acceptor acceptor{context};
+            std::thread   thread;
+            bool          down = false; // shut down, its clients gone
+        };
+        std::vector<std::unique_ptr<lane>> lanes_;
+        static constexpr std::chrono::milliseconds accept_pause{100}; // after a failed accept
+        error_code                         pin_error_; // of the lane threads, see create
+
+        // "$SYS" reports (hub_options::sys_interval), on the timer's strand
+        struct topic_tally {
+            std::uint64_t publications = 0, bytes = 0;
+        };
+        boost::asio::steady_timer sys_timer_;
+        std::atomic_bool          sys_started_{false};
+        std::vector<topic_tally>  sys_reported_; // by topic id, as of the last report
 
       public:
-        explicit impl(any_io_executor const& executor)
-            : executor_(executor)
+        explicit impl(any_io_executor const& executor, hub_options options)
+            : options_(std::move(options))
+            , executor_(executor)
             , acceptor_(make_strand(executor))
-        {}
+            , local_acceptor_(make_strand(executor))
+            , sys_timer_(make_strand(executor))
+        {
+            // a node pool each, so the shards share no lock
+            for (std::size_t i = 0; i < options_.shards; ++i)
+                shards_.push_back(std::make_unique<shard>(std::make_shared<detail::recycler>(1024)));
+
+            for (std::size_t i = 0; i < options_.io_contexts; ++i) {
+                lanes_.push_back(std::make_unique<lane>());
+                start_lane(i);
+            }
+        }
+
+        // Runs lane `i` on a thread of its own, pinned round robin to the
+        // CPUs we may run on if so configured
+        void start_lane(std::size_t i) {
+            auto& l  = *lanes_[i];
+            l.thread = std::thread([&context = l.context] { context.run(); });
+            if (!options_.pin_io_contexts)
+                return;
+
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (int err = ::sched_getaffinity(0, sizeof(allowed), &allowed) ? errno : 0) {
+                pin_error_.assign(err, boost::system::system_category());
+                return;
+            }
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+
+            cpu_set_t cpu;
+            CPU_ZERO(&cpu);
+            CPU_SET(cpus[i % cpus.size()], &cpu);
+            if (int err = ::pthread_setaffinity_np(l.thread.native_handle(), sizeof(cpu), &cpu))
+                pin_error_.assign(err, boost::system::system_category());
+        }
+
+        // Stops the lanes, and their clients with them: all are stopped
+        // before any client is destroyed, lest it hand work to a lane gone.
+        // A lane stopped from its own thread is left to the destructor.
+        void stop_lanes() {
+            for (auto& l : lanes_)
+                l->context.stop();
+
+            std::vector<lane*> joined;
+            for (auto& l : lanes_) {
+                if (!l->thread.joinable() || l->thread.get_id() == std::this_thread::get_id())
+                    continue;
+                l->thread.join();
+                joined.push_back(l.get());
+            }
+            for (auto* l : joined) {
+                close(l->acceptor);
+                l->context.shutdown();
+                l->down = true;
+            }
+        }
 
         void stop() {
+            owner_ = false;
+            stop_lanes();
             {
                 std::shared_ptr<hubconnection> rhub;
                 if (auto p = std::atomic_exchange(&remote_hub_, rhub)) {
@@ -43,21 +355,86 @@ namespace msghublib {
                 }
             }
 
+            // closed rather than cancelled: an accept completing meanwhile
+            // would start the next one
             if (!weak_from_this().expired()) {
                 post(acceptor_.get_executor(),
                      [this, self = shared_from_this()] {
-                         if (acceptor_.is_open()) {
-                             acceptor_.cancel();
-                         }
+                         close(acceptor_);
+                     });
+                post(local_acceptor_.get_executor(),
+                     [this, self = shared_from_this()] {
+                         close(local_acceptor_);
                      });
-            } else if (acceptor_.is_open()) {
-                acceptor_.cancel();
+                post(sys_timer_.get_executor(),
+                     [this, self = shared_from_this()] { sys_timer_.cancel(); });
+            } else {
+                close(acceptor_);
+                close(local_acceptor_);
+                sys_timer_.cancel();
+            }
+
+            if (!local_path_.empty()) {
+                std::error_code ignored;
+                std::filesystem::remove(std::exchange(local_path_, {}), ignored);
             }
 
             work_.reset();
         }
 
-        ~impl() { stop(); }
+        ~impl() {
+            stop();
+        }
+
+        hub_stats stats() const {
+            auto s    = counters_->snapshot();
+            auto subs = subs_.read();
+            for (auto const& entry : subs->entries) {
+                if (auto n = entry ? subscribers(*entry) : 0) {
+                    s.topics += 1;
+                    s.subscriptions += n;
+                }
+            }
+            return s;
+        }
+
+        // Topics with an entry on the hub: subscribed to, or kept (see resolve)
+        std::vector<topic_stats> stats_by_topic() const {
+            std::vector<topic_stats> result;
+            auto subs = subs_.read();
+            for (detail::topic_id id = 0; id < subs->entries.size(); ++id) {
+                topic_stats t;
+                if (auto const& entry = subs->entries[id])
+                    t.subscribers = subscribers(*entry);
+                if (auto const* counted = topic_counts_.find(id)) {
+                    t.publications = counted->publications.load(std::memory_order_relaxed);
+                    t.bytes        = counted->bytes.load(std::memory_order_relaxed);
+                }
+                if (t.subscribers || t.publications) {
+                    t.topic = subs->topics->name(id);
+                    result.push_back(std::move(t));
+                }
+            }
+            return result;
+        }
+
+        // Topics whose traced publications reached our subscribers
+        std::vector<topic_latency> latency_by_topic() const {
+            using slot = detail::topic_latency_slot;
+
+            std::vector<topic_latency> result;
+            auto subs = subs_.read();
+            for (detail::topic_id id = 0; id < subs->entries.size(); ++id) {
+                auto const* traced = latencies_.find(id);
+                auto const* h      = traced ? traced->get() : nullptr;
+                if (!h)
+                    continue;
+                result.push_back({std::string(subs->topics->name(id)), slot::summary(h->to_hub),
+                                  slot::summary(h->in_hub), slot::summary(h->from_hub),
+                                  slot::summary(h->handler)});
+            }
+            return result;
+        }
 
         void connect(const std::string& hostip, uint16_t port, error_code& ec) {
             ec = {};
@@ -68,22 +445,158 @@ namespace msghublib {
             }
         }
 
+        void connect(const std::string& hostip, uint16_t port, completion connected) {
+            auto p = std::make_shared<hubconnection>(executor_, *this);
+
+            p->async_init(hostip, port, [this, p, connected, self = shared_from_this()](error_code ec) {
+                if (!ec)
+                    atomic_store(&remote_hub_, p);
+                connected(ec);
+            });
+        }
+
+        void connect(std::string const& uri, error_code& ec) {
+            auto ep = detail::parse_endpoint(uri, ec);
+            if (ec)
+                return;
+
+            auto p = std::make_shared<hubconnection>(executor_, *this);
+            std::visit([&](auto const& target) { p->init(target, ec); }, ep);
+            if (!ec) {
+                atomic_store(&remote_hub_, p);
+            }
+        }
+
+        void connect(std::string const& uri, completion connected) {
+            error_code ec;
+            auto ep = detail::parse_endpoint(uri, ec);
+            if (ec)
+                return connected(ec);
+
+            auto p = std::make_shared<hubconnection>(executor_, *this);
+            std::visit([&](auto const& target) {
+                p->async_init(target, [this, p, connected, self = shared_from_this()](error_code ec) {
+                    if (!ec)
+                        atomic_store(&remote_hub_, p);
+                    connected(ec);
+                });
+            }, ep);
+        }
+
         void create(uint16_t port, error_code& ec) {
+            create(tcp::endpoint{ tcp::v4(), port }, ec);
+        }
+
+        void create(std::string const& uri, error_code& ec) {
+            auto ep = detail::parse_endpoint(uri, ec);
+            if (ec)
+                return;
+            if (auto const* local_ep = std::get_if<detail::local_endpoint>(&ep))
+                return create(*local_ep, ec);
+            if (auto const* shm_ep = std::get_if<detail::shm_endpoint>(&ep))
+                return create(shm_ep->control, ec); // any local socket offers it
+
+            auto const& [host, port] = std::get<detail::tcp_endpoint>(ep);
+            auto const address = host.empty() ? boost::asio::ip::address(boost::asio::ip::address_v4::any())
+                                              : boost::asio::ip::make_address(host, ec);
+            if (!ec)
+                create(tcp::endpoint{ address, port }, ec);
+        }
+
+        void create(tcp::endpoint const& ep, error_code& ec) {
             ec = {};
+            if (!lanes_.empty())
+                return create_lanes(ep, ec);
             try {
-                acceptor_.open(tcp::v4(), ec);
+                acceptor_.open(ep.protocol(), ec);
                 if (!ec) acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
-                if (!ec) acceptor_.bind({ {}, port }, ec);
+                if (!ec) acceptor_.bind(ep, ec);
                 if (!ec) acceptor_.listen(acceptor_.max_listen_connections, ec);
 
                 if (!ec) {
-                    accept_next();
+                    owner_ = true;
+                    accept_next(acceptor_);
+                    start_sys_reports();
+                }
+            } catch (system_error const& se) {
+                ec = se.code();
+            }
+        }
 
-                    auto p = std::make_shared<hubconnection>(executor_, *this);
+        // Every lane listens on the same port, the kernel spreads the
+        // connects between them
+        void create_lanes(tcp::endpoint ep, error_code& ec) {
+            // those of a stopped hub are replaced
+            for (std::size_t i = 0; i < lanes_.size(); ++i) {
+                if (lanes_[i]->down) {
+                    if (!i)
+                        pin_error_ = {};
+                    lanes_[i] = std::make_unique<lane>();
+                    start_lane(i);
+                }
+            }
+            if (pin_error_) {
+                ec = pin_error_;
+                return;
+            }
 
-                    if (p->init("localhost", port, ec); !ec) {
-                        atomic_store(&remote_hub_, p);
+            for (auto& l : lanes_) {
+                auto& acceptor = l->acceptor;
+                acceptor.open(ep.protocol(), ec);
+                if (!ec) acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+                if (!ec) acceptor.set_option(reuse_port(true), ec);
+                if (!ec) acceptor.bind(ep, ec);
+                if (!ec) acceptor.listen(acceptor.max_listen_connections, ec);
+                if (!ec && ep.port() == 0)
+                    ep = acceptor.local_endpoint(ec); // the others join it
+
+                if (ec) {
+                    error_code ignored;
+                    for (auto& opened : lanes_)
+                        opened->acceptor.close(ignored);
+                    return;
+                }
+            }
+
+            owner_ = true;
+            for (auto& l : lanes_)
+                accept_next(*l);
+            start_sys_reports();
+        }
+
+        void create(detail::local_endpoint const& ep, error_code& ec) {
+            ec = {};
+            if (local_acceptor_.is_open()) {
+                ec = boost::asio::error::already_open; // before touching its file
+                return;
+            }
+            try {
+                // a previous hub may have left its socket file behind, to
+                // be removed unless a hub still answers on it; an abstract
+                // name (leading NUL) goes away with its socket
+                auto const path = ep.path();
+                bool const named = !path.empty() && path.front() != '\0';
+                if (std::error_code fec; named && std::filesystem::is_socket(path, fec)) {
+                    boost::asio::local::stream_protocol::socket probe(local_acceptor_.get_executor());
+                    error_code refused;
+                    probe.connect(ep, refused);
+                    if (!refused) {
+                        ec = boost::asio::error::address_in_use;
+                        return;
                     }
+                    std::filesystem::remove(path, fec);
+                }
+
+                local_acceptor_.open(ep.protocol(), ec);
+                if (!ec) local_acceptor_.bind(ep, ec);
+                if (!ec) local_acceptor_.listen(local_acceptor_.max_listen_connections, ec);
+
+                if (!ec) {
+                    if (named)
+                        local_path_ = path;
+                    owner_ = true;
+                    accept_next(local_acceptor_);
+                    start_sys_reports();
                 }
             } catch (system_error const& se) {
                 ec = se.code();
@@ -92,87 +605,750 @@ namespace msghublib {
 
         void publish(std::string_view topic, span<char const> message, error_code& ec) {
             ec = {};
-            if (auto p = atomic_load(&remote_hub_)) {
-                p->async_send({ hubmessage::action::publish, topic, message });
+            if (!sendable(topic, message)) {
+                ec = boost::asio::error::message_size;
+            } else if (large(topic, message)) {
+                auto msg = make_large(topic, message);
+                if (owner_)
+                    dispatch(nullptr, std::move(msg));
+                else if (auto p = atomic_load(&remote_hub_))
+                    p->async_send(std::move(msg));
+                else
+                    ec = hub_errc::hub_not_connected;
+            } else if (owner_) {
+                // fast path: no serialization, no socket hop for local
+                // subscribers; remote ones share a single frame
+                dispatch(nullptr, topic, {&message, 1}, own_stamps(), [&](span<char const> body) {
+                    return pool_.make(hubmessage::action::publish, topic, body);
+                });
+            } else if (auto p = atomic_load(&remote_hub_)) {
+                p->async_send(stamped(p->pool().make(hubmessage::action::publish, topic, message)));
             } else {
                 ec = hub_errc::hub_not_connected;
             }
         }
 
+        // Messages too large for a frame go in fragments, as with publish().
+        // None goes if any is too large for that.
+        void publish_batch(span<message_view const> messages, error_code& ec) {
+            ec = {};
+            if (!std::all_of(messages.begin(), messages.end(),
+                             [this](auto const& m) { return sendable(m.first, m.second); })) {
+                ec = boost::asio::error::message_size;
+            } else if (owner_) {
+                // served per topic, like batches from remote publishers, up
+                // to each large one
+                detail::wire::batch batch;
+                auto const flush = [&] {
+                    batch.stamps = own_stamps();
+                    dispatch(nullptr, batch);
+                    batch = {};
+                };
+                for (auto const& [topic, body] : messages) {
+                    if (large(topic, body)) {
+                        flush();
+                        dispatch(nullptr, make_large(topic, body));
+                        continue;
+                    }
+                    auto t = std::find(batch.topics.begin(), batch.topics.end(), topic);
+                    if (t == batch.topics.end())
+                        t = batch.topics.insert(t, topic);
+                    batch.entries.emplace_back(t - batch.topics.begin(), body);
+                }
+                flush();
+            } else if (auto p = atomic_load(&remote_hub_)) {
+                // as few frames as the messages fit in, handed over at once
+                // up to each large one
+                std::vector<shared_hubmessage> frames;
+                detail::wire::batch_writer writer;
+                auto const flush = [&] {
+                    if (!writer.empty())
+                        frames.push_back(stamped(std::make_shared<hubmessage>(writer.take())));
+                };
+                for (auto const& [topic, body] : messages) {
+                    if (large(topic, body)) {
+                        flush();
+                        if (!frames.empty())
+                            p->async_send(std::exchange(frames, {}));
+                        p->async_send(make_large(topic, body));
+                        continue;
+                    }
+                    if (writer.add(topic, body))
+                        continue;
+                    flush();
+                    if (!writer.add(topic, body)) // nearly large, no room for the batch's own
+                        frames.push_back(stamped(p->pool().make(hubmessage::action::publish, topic, body)));
+                }
+                flush();
+                if (!frames.empty())
+                    p->async_send(std::move(frames));
+            } else {
+                ec = hub_errc::hub_not_connected;
+            }
+        }
+
+        void publish(std::string_view topic, span<char const> message, completion accepted) {
+            if (owner_ || !sendable(topic, message)) {
+                error_code ec;
+                publish(topic, message, ec);
+                accepted(ec);
+            } else if (auto p = atomic_load(&remote_hub_)) {
+                if (large(topic, message))
+                    p->async_send(make_large(topic, message), std::move(accepted));
+                else
+                    p->async_send(stamped(p->pool().make(hubmessage::action::publish, topic, message)),
+                                  std::move(accepted));
+            } else {
+                accepted(hub_errc::hub_not_connected);
+            }
+        }
+
+        any_io_executor const& get_executor() const { return executor_; }
+
         void unsubscribe(const std::string& topic, error_code& ec) {
             ec = {};
-            std::unique_lock lk(mutex_);
-            if (auto it = local_subs_.find(topic); it != local_subs_.end()) {
-                /*it =*/local_subs_.erase(it);
-                lk.unlock();
+            if (unsubscribe_local(topic)) {
+                notify_hub({ hubmessage::action::unsubscribe, topic }, ec);
+            }
+        }
 
-                if (auto p = atomic_load(&remote_hub_)) {
-                    p->send({ hubmessage::action::unsubscribe, topic }, ec);
-                } else {
-                    ec = hub_errc::hub_not_connected;
-                }
+        void unsubscribe(const std::string& topic, completion queued) {
+            if (unsubscribe_local(topic)) {
+                notify_hub({ hubmessage::action::unsubscribe, topic }, std::move(queued));
+            } else {
+                queued({});
             }
         }
 
         void subscribe(const std::string& topic, const msghub::onmessage& handler, error_code& ec) {
             ec = {};
-            std::unique_lock lk(mutex_);
-            if (auto [it, ins] = local_subs_.emplace(topic, handler); ins) {
-                lk.unlock();
-                if (auto p = atomic_load(&remote_hub_)) {
-                    p->send({ hubmessage::action::subscribe, topic }, ec);
-                    // TODO(sehe): wait feedback from server here?
+            if (subscribe_local(topic, handler, ec)) {
+                notify_hub({ hubmessage::action::subscribe, topic }, ec);
+                // TODO(sehe): wait feedback from server here?
+            }
+        }
+
+        void subscribe_stream(const std::string& topic, const msghub::onchunk& handler, error_code& ec) {
+            ec = {};
+            if (subscribe_local(topic, handler, ec)) {
+                notify_hub({ hubmessage::action::subscribe, topic }, ec);
+            }
+        }
+
+        void subscribe_conflated(const std::string& topic, const msghub::onmessage& handler,
+                                 std::chrono::milliseconds min_interval, error_code& ec) {
+            ec = {};
+            if (subscribe_local(topic, handler, ec, min_interval)) {
+                notify_hub(detail::wire::subscribe(topic, {min_interval, std::nullopt}), ec);
+            }
+        }
+
+        void subscribe_from(const std::string& topic, const msghub::onmessage& handler,
+                            detail::log_position from, error_code& ec) {
+            ec = {};
+            if (subscribe_local(topic, handler, ec)) {
+                notify_hub(detail::wire::subscribe(topic, {std::nullopt, from}), ec);
+            }
+        }
+
+        void subscribe(const std::string& topic, const msghub::onmessage& handler, completion queued) {
+            error_code ec;
+            if (subscribe_local(topic, handler, ec)) {
+                notify_hub({ hubmessage::action::subscribe, topic }, std::move(queued));
+            } else {
+                queued(ec);
+            }
+        }
+
+        void retain(std::string const& topic, std::size_t depth) {
+            auto const dropped = subs_.update([&](subscriptions& subs) {
+                auto& rules = subs.retain_rules;
+                auto rule = std::find_if(rules.begin(), rules.end(),
+                                         [&](auto const& r) { return r.first == topic; });
+                if (rule == rules.end())
+                    rules.emplace_back(topic, depth);
+                else
+                    rule->second = depth;
+
+                auto trie = std::make_shared<detail::topic_trie>();
+                for (detail::topic_id i = 0; i < rules.size(); ++i)
+                    trie->insert(rules[i].first, i);
+                subs.retains = std::move(trie);
+
+                std::vector<detail::topic_id> dropped;
+                for (detail::topic_id id = 0; id < subs.entries.size(); ++id) {
+                    auto const kept = subs.retain_depth(subs.topics->name(id));
+                    if (!subs.entries[id] || subs.entries[id]->retained == kept)
+                        continue;
+                    subs.edit(id).retained = kept;
+                    if (!kept)
+                        dropped.push_back(id);
+                }
+                return dropped;
+            });
+
+            for (auto id : dropped)
+                retained_.drop(id);
+        }
+
+        void persist(std::string const& topic, error_code& ec) {
+            ec = {};
+            if (!log_) {
+                ec = boost::asio::error::operation_not_supported;
+                return;
+            }
+
+            std::error_code created;
+            std::filesystem::create_directories(options_.log_directory, created);
+            if (created) {
+                ec = {created.value(), boost::system::system_category()};
+                return;
+            }
+            auto const on_disk = log_->topics();
+
+            subs_.update([&](subscriptions& subs) {
+                auto& rules = subs.log_rules;
+                if (std::find(rules.begin(), rules.end(), topic) != rules.end())
+                    return;
+                rules.push_back(topic);
+
+                auto trie = std::make_shared<detail::topic_trie>(*subs.logs);
+                trie->insert(topic, rules.size() - 1);
+                subs.logs = std::move(trie);
+
+                for (detail::topic_id id = 0; id < subs.entries.size(); ++id) {
+                    auto const& entry = subs.entries[id];
+                    if (entry && !entry->logged && !subs.logs->match(subs.topics->name(id)).empty())
+                        subs.edit(id).logged = true;
+                }
+                // logged by an earlier run: to be replayed before published to
+                for (auto const& t : on_disk)
+                    if (!subs.topics->find(t) && !subs.logs->match(t).empty() && !refuses(subs, t))
+                        subs.edit(t);
+            });
+        }
+
+      private:
+        // Returns whether the hub needs to know; past max_topics, fails
+        // with no_buffer_space
+        template <typename Handler>
+        bool subscribe_local(const std::string& topic, Handler const& handler, error_code& ec,
+                             std::optional<std::chrono::milliseconds> conflation = std::nullopt) {
+            return subs_.update([&](subscriptions& subs) {
+                if (refuses(subs, topic)) {
+                    ec = boost::asio::error::no_buffer_space;
+                    return false;
+                }
+                // just update the handler if already subscribed as such
+                auto& entry = subs.edit(topic);
+                bool const inserted = !entry.local_subscribed() ||
+                    std::exchange(entry.conflation, conflation) != conflation;
+                if constexpr (std::is_same_v<Handler, msghub::onchunk>) {
+                    entry.local    = nullptr;
+                    entry.streamed = handler;
                 } else {
-                    ec = hub_errc::hub_not_connected;
+                    entry.local    = handler;
+                    entry.streamed = nullptr;
                 }
+                subs.refresh_pattern(topic);
+                return inserted;
+            });
+        }
+
+        bool unsubscribe_local(const std::string& topic) {
+            return subs_.update([&](subscriptions& subs) {
+                auto const* entry = subs.find(topic);
+                if (!entry || !entry->local_subscribed())
+                    return false;
+                auto& edited      = subs.edit(topic);
+                edited.local      = nullptr;
+                edited.streamed   = nullptr;
+                edited.conflation = std::nullopt;
+                subs.refresh_pattern(topic);
+                return true;
+            });
+        }
+
+        // Whether a publication needs fragments
+        static bool large(std::string_view topic, span<char const> body) {
+            return topic.size() + body.size() >
+                std::size_t(hubmessage::messagesize) - hubmessage::headersize;
+        }
+
+        // Whether a publication can go at all, in fragments if need be
+        bool sendable(std::string_view topic, span<char const> body) const {
+            return !large(topic, body) ||
+                (topic.size() <= detail::wire::max_fragment_topic && body.size() <= options_.max_message_size);
+        }
+
+        // Only for sendable() publications
+        std::shared_ptr<large_message> make_large(std::string_view topic, span<char const> body) const {
+            return std::make_shared<large_message>(
+                large_message{std::string(topic), {body.begin(), body.end()}, std::nullopt});
+        }
+
+        // Tracing (hub_options::trace_latency): a publication to the hub is
+        // stamped when published, the hub's own when received as well
+        using stamps_t = std::optional<hubmessage::timestamps>;
+
+        std::shared_ptr<hubmessage> stamped(std::shared_ptr<hubmessage> frame) const {
+            if (options_.trace_latency)
+                frame->set_stamps({hubmessage::monotonic_ns()});
+            return frame;
+        }
+
+        stamps_t own_stamps() const {
+            if (!options_.trace_latency)
+                return std::nullopt;
+            auto const now = hubmessage::monotonic_ns();
+            return hubmessage::timestamps{now, now};
+        }
+
+        // The stamps a publication from a client goes on with
+        static stamps_t relayed(stamps_t const& stamps) {
+            if (!stamps)
+                return std::nullopt;
+            return hubmessage::timestamps{stamps->published, stamps->received};
+        }
+
+        // Forwards a (un)subscription to the hub, unless we are the hub. It is
+        // queued on the connection's strand like everything else we send.
+        void notify_hub(hubmessage const& msg, error_code& ec) {
+            if (owner_)
+                return; // served in-process
+
+            if (auto p = atomic_load(&remote_hub_)) {
+                p->async_send(msg);
             } else {
-                // just update the handler
-                it->second = handler; // overwrite
+                ec = hub_errc::hub_not_connected;
             }
         }
 
-      private:
-        msghub::onmessage const& lookup_handler(std::string_view topic) const {
-            static const msghub::onmessage no_handler = [](auto... /*unused*/) {};
+        void notify_hub(hubmessage const& msg, completion queued) {
+            if (owner_)
+                return queued({});
 
-            std::lock_guard lk(mutex_);
-            auto it = local_subs_.find(std::string(topic));
-            return (it == local_subs_.end()) ? no_handler : it->second;
+            if (auto p = atomic_load(&remote_hub_)) {
+                p->async_send(msg, std::move(queued));
+            } else {
+                queued(hub_errc::hub_not_connected);
+            }
         }
 
-        void distribute(std::shared_ptr<hubclient> const& subscriber, hubmessage const& msg) override {
-            std::string topic(msg.topic());
-            std::unique_lock lk(mutex_);
-            auto range = remote_subs_.equal_range(topic);
+        hub_options const& options() const override { return options_; }
+        std::shared_ptr<detail::hub_counters> const& counters() override { return counters_; }
 
-            switch (msg.get_action()) {
-            case hubmessage::action::publish:
-                for (auto it = range.first; it != range.second;) {
-                    if (auto alive = it->second.lock()) {
-                        alive->send(msg);
-                        ++it;
+        // Remote subscribers still connected, and this instance
+        static std::uint64_t subscribers(topic_entry const& entry) {
+            std::uint64_t n = entry.local_subscribed() ? 1 : 0;
+            for (auto const& w : entry.remote)
+                n += !w.expired();
+            return n;
+        }
+
+        void start_sys_reports() {
+            if (options_.sys_interval.count() && !sys_started_.exchange(true))
+                post(sys_timer_.get_executor(), [this, self = shared_from_this()] { schedule_sys_report(); });
+        }
+
+        void schedule_sys_report() {
+            sys_timer_.expires_after(options_.sys_interval);
+            sys_timer_.async_wait([this, self = shared_from_this()](error_code ec) {
+                if (ec || !owner_)
+                    return;
+                sys_report();
+                schedule_sys_report();
+            });
+        }
+
+        // Publishes the stats, and the topics busiest since the last report
+        void sys_report() {
+            error_code ec;
+            auto const stats = detail::stats_report(this->stats());
+            publish("$SYS.stats", {stats.data(), stats.size()}, ec);
+
+            std::vector<topic_stats> busiest;
+            auto const topics = subs_.read()->topics; // the ids of any snapshot since
+            for (auto& t : stats_by_topic()) {
+                auto const id = topics->find(t.topic);
+                if (!id)
+                    continue;
+                if (sys_reported_.size() <= *id)
+                    sys_reported_.resize(*id + 1);
+                auto& last = sys_reported_[*id];
+                auto const publications = t.publications - last.publications;
+                auto const bytes        = t.bytes - last.bytes;
+                last = {t.publications, t.bytes};
+
+                if (publications) {
+                    t.publications = publications;
+                    t.bytes        = bytes;
+                    busiest.push_back(std::move(t));
+                }
+            }
+
+            auto const n = std::min(busiest.size(), options_.sys_topics);
+            std::partial_sort(busiest.begin(), busiest.begin() + n, busiest.end(),
+                              [](auto const& a, auto const& b) { return a.publications > b.publications; });
+            busiest.resize(n);
+
+            auto const report = detail::topics_report(busiest);
+            publish("$SYS.topics", {report.data(), report.size()}, ec);
+        }
+
+        // Route of a published topic, if anyone takes it; interning it now
+        // if something keeps state for it
+        std::optional<route> resolve(std::string_view topic) {
+            {
+                auto subs = subs_.read();
+                if (auto id = subs->topics->find(topic))
+                    return route{id, {}};
+                if (!subs->keeps(topic) || refuses(*subs, topic)) {
+                    std::optional<route> matched(std::in_place);
+                    subs->patterns->match(topic, matched->matches);
+                    if (matched->matches.empty())
+                        return std::nullopt;
+                    return matched;
+                }
+            }
+
+            return subs_.update([&](subscriptions& subs) -> std::optional<route> {
+                if (refuses(subs, topic)) { // filled up meanwhile
+                    route matched;
+                    subs.patterns->match(topic, matched.matches);
+                    if (matched.matches.empty())
+                        return std::nullopt;
+                    return matched;
+                }
+                subs.edit(topic);
+                return route{subs.topics->find(topic), {}};
+            });
+        }
+
+        // Whether `topic` would need an entry past hub_options::max_topics,
+        // counting it if so
+        bool refuses(subscriptions const& subs, std::string_view topic) const {
+            auto const limit = options_.max_topics;
+            if (!limit || subs.topics->size() < limit || subs.topics->find(topic))
+                return false;
+            counters_->local().topics_refused.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void deliver_local(std::string_view topic, span<char const> body, stamps_t const& stamps) {
+            auto const where = resolve(topic);
+            if (!where)
+                return;
+
+            auto subs = subs_.read();
+            invoke_local(*subs, *where, topic, body, stamps);
+        }
+
+        // Invokes our subscribers to `where`, timing them for traced
+        // publications
+        void invoke_local(subscriptions const& subs, route const& where, std::string_view topic,
+                          span<char const> body, stamps_t const& stamps) {
+            if (!stamps)
+                return for_each_match(subs, where, [&](topic_entry const& e) { e.invoke(topic, body); });
+
+            bool invoked = false;
+            auto const started = hubmessage::monotonic_ns();
+            for_each_match(subs, where, [&](topic_entry const& e) {
+                invoked = invoked || e.local_subscribed();
+                e.invoke(topic, body);
+            });
+            if (!invoked)
+                return;
+
+            auto traced = *stamps;
+            if (!traced.hub_sent)
+                traced.hub_sent = started; // we're the hub
+            if (auto* slot = where.id ? latencies_.at(*where.id) : nullptr)
+                slot->record(traced, started, hubmessage::monotonic_ns());
+        }
+
+        // Invokes `f` with the entry of the topic, if any, then those of the
+        // wildcard subscriptions it matches
+        template <typename F>
+        static void for_each_match(subscriptions const& subs, route const& where, F f) {
+            if (!where.id) {
+                for (auto m : where.matches)
+                    f(*subs.entries[m]);
+                return;
+            }
+
+            auto const  id    = *where.id;
+            auto const& entry = *subs.entries[id];
+            f(entry);
+            for (auto m : entry.matches)
+                if (m != id)
+                    f(*subs.entries[m]);
+        }
+
+        // Live remote subscribers to the topic, directly or by wildcard,
+        // each once
+        using targets_t = boost::container::small_vector<std::shared_ptr<hubclient>, 16>;
+        static targets_t collect_targets(subscriptions const& subs, route const& where, bool& stale) {
+            targets_t targets;
+            for_each_match(subs, where, [&](topic_entry const& e) {
+                for (auto const& subscriber : e.remote) {
+                    if (auto alive = subscriber.lock())
+                        targets.push_back(std::move(alive));
+                    else
+                        stale = true;
+                }
+            });
+
+            // a connection subscribed through several patterns gets each
+            // frame once
+            if (where.id ? !subs.entries[*where.id]->matches.empty() : where.matches.size() > 1) {
+                std::sort(targets.begin(), targets.end());
+                targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+            }
+            return targets;
+        }
+
+        // snapshots are immutable, so departed subscribers are pruned by a
+        // writer; one is enough however many readers noticed
+        void purge_later() {
+            if (!purge_pending_.exchange(true)) {
+                subs_.update([this](subscriptions& subs) {
+                    purge_pending_ = false;
+                    purge(subs);
+                });
+            }
+        }
+
+        // Serves publications to `topic` on the hub: every live remote
+        // subscriber, directly or by wildcard, gets a frame per body, which
+        // is only built on the first one and then shared by all; local
+        // subscribers are invoked in-process. The subscribers are looked up
+        // once for all bodies.
+        //
+        // A `publisher` connection is asked to wait for subscribers that are
+        // congested under the block_publisher policy.
+        template <typename MakeFrame>
+        void dispatch(std::shared_ptr<hubclient> const& publisher, std::string_view topic,
+                      span<span<char const> const> bodies, stamps_t const& stamps,
+                      MakeFrame make_frame) {
+            std::size_t bytes = 0;
+            for (auto const& body : bodies)
+                bytes += body.size();
+            count_in(bodies.size(), bytes);
+
+            auto where = resolve(topic);
+            if (!where)
+                return;
+            if (auto* counted = where->id ? topic_counts_.at(*where->id) : nullptr)
+                counted->add(bodies.size(), bytes);
+
+            if (publisher && !shards_.empty()) {
+                for (auto const& body : bodies) {
+                    auto frame = make_frame(body);
+                    if (where->id)
+                        frame->set_topic_id(*where->id);
+                    if (stamps)
+                        frame->set_stamps(*stamps);
+                    hand_off(topic, {publisher, std::move(frame), nullptr, where->id});
+                }
+                return;
+            }
+            fan_out(publisher, *where, topic, bodies, stamps, make_frame);
+        }
+
+        template <typename MakeFrame>
+        void fan_out(std::shared_ptr<hubclient> const& publisher, route const& where,
+                     std::string_view topic, span<span<char const> const> bodies,
+                     stamps_t const& stamps, MakeFrame make_frame) {
+            // the hub's own publications wait for the log here, not under
+            // the topic's lock; connections stop reading instead, below
+            if (!publisher && where.id && log_ && subs_.read()->entries[*where.id]->logged)
+                log_->wait_for_room();
+
+            bool stale = false;
+            bool behind = false; // the log
+            {
+                std::unique_lock<std::mutex> serialized;
+                if (where.id && kept_or_logged(*where.id))
+                    serialized = std::unique_lock(topic_lock(*where.id));
+
+                auto subs = subs_.read();
+                auto const targets = collect_targets(*subs, where, stale);
+                auto const id      = where.id.value_or(0);
+                auto const keep    = serialized ? subs->entries[id]->retained : 0;
+                bool const logging = serialized && log_ && subs->entries[id]->logged;
+                auto const now     = logging ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                   std::chrono::system_clock::now().time_since_epoch()).count()
+                                             : 0;
+
+                for (auto const& body : bodies) {
+                    shared_hubmessage frame;
+                    auto built = [&]() -> shared_hubmessage const& {
+                        if (!frame) {
+                            auto f = make_frame(body);
+                            if (where.id)
+                                f->set_topic_id(id); // lets connections alias it
+                            if (stamps)
+                                f->set_stamps(*stamps);
+                            frame = std::move(f);
+                        }
+                        return frame;
+                    };
+
+                    if (keep)
+                        retained_.store(id, keep, built());
+                    if (logging && !log_->append(id, built(), now))
+                        behind = true;
+                    for (auto const& alive : targets) {
+                        if (!alive->send(built()) && publisher && publisher != alive)
+                            publisher->wait_for(alive);
+                    }
+                }
+
+                // not under the lock: handlers may publish themselves
+                if (serialized)
+                    serialized.unlock();
+                for (auto const& body : bodies)
+                    invoke_local(*subs, where, topic, body, stamps);
+            }
+
+            if (behind && publisher) {
+                publisher->pause();
+                log_->when_room([publisher] { publisher->resume(); });
+            }
+            if (stale)
+                purge_later();
+        }
+
+        // Serves a large publication on the hub. Its fragments are queued
+        // separately, but it counts against the subscribers' queue limits
+        // like any publication.
+        void dispatch(std::shared_ptr<hubclient> const& publisher, std::shared_ptr<large_message> msg) {
+            count_in(1, msg->body.size());
+
+            auto where = resolve(msg->topic);
+            if (!where)
+                return;
+            if (auto* counted = where->id ? topic_counts_.at(*where->id) : nullptr)
+                counted->add(1, msg->body.size());
+
+            msg->topic_id = where->id; // lets connections alias it
+            if (publisher && !shards_.empty()) {
+                std::string_view const topic = msg->topic; // stays with the message
+                return hand_off(topic, {publisher, nullptr, std::move(msg), where->id});
+            }
+            fan_out(publisher, *where, std::move(msg));
+        }
+
+        void fan_out(std::shared_ptr<hubclient> const& publisher, route const& where,
+                     shared_large_message shared) {
+            bool stale = false;
+            {
+                auto subs = subs_.read();
+                for (auto const& alive : collect_targets(*subs, where, stale)) {
+                    if (!alive->send(shared) && publisher && publisher != alive)
+                        publisher->wait_for(alive);
+                }
+
+                span<char const> const body(shared->body.data(), shared->body.size());
+                for_each_match(*subs, where, [&](topic_entry const& e) { e.invoke(shared->topic, body); });
+            }
+
+            if (stale)
+                purge_later();
+        }
+
+        void count_in(std::size_t publications, std::size_t bytes) {
+            auto& local = counters_->local();
+            local.publications_in.fetch_add(publications, std::memory_order_relaxed);
+            local.bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        // Queues a publication for the shard of its topic, by name: it may
+        // be interned later
+        void hand_off(std::string_view topic, shard_item item) {
+            item.publisher->handed_off();
+            auto& target = *shards_[detail::string_hash{}(topic) % shards_.size()];
+            if (target.push(std::move(item)))
+                schedule(target);
+        }
+
+        void schedule(shard& target) {
+            post(executor_, [this, &target, self = shared_from_this()] {
+                bool const more = target.drain(64, [this](shard_item& item) {
+                    std::string_view const topic = item.large ? item.large->topic : item.frame->topic();
+                    auto const where = item.id ? std::optional<route>(route{item.id, {}}) : resolve(topic);
+                    if (!where) {
+                        // matched no longer
+                    } else if (item.large) {
+                        fan_out(item.publisher, *where, std::move(item.large));
                     } else {
-                        it = remote_subs_.erase(it);
+                        auto const body = item.frame->body();
+                        fan_out(item.publisher, *where, topic, {&body, 1}, item.frame->stamps(),
+                                [&](span<char const>) { return item.frame; });
                     }
+                    item.publisher->fanned_out();
+                });
+                if (more)
+                    schedule(target);
+            });
+        }
+
+        // Where frames published by `publisher` (or this instance) come from
+        detail::message_pool& frames_for(std::shared_ptr<hubclient> const& publisher) {
+            return publisher ? publisher->pool() : pool_;
+        }
+
+        // Serves a batch one topic at a time, keeping the order per topic
+        void dispatch(std::shared_ptr<hubclient> const& publisher, detail::wire::batch const& batch) {
+            std::vector<std::vector<span<char const>>> by_topic(batch.topics.size());
+            for (auto const& [topic, body] : batch.entries)
+                by_topic[topic].push_back(body);
+
+            auto& pool = frames_for(publisher);
+            for (std::size_t t = 0; t < by_topic.size(); ++t) {
+                auto const topic = batch.topics[t];
+                dispatch(publisher, topic, by_topic[t], batch.stamps, [&pool, topic](span<char const> body) {
+                    return pool.make(hubmessage::action::publish, topic, body);
+                });
+            }
+        }
+
+        void distribute(std::shared_ptr<hubclient> const& subscriber, hubmessage const& msg) override {
+            if (msg.get_action() == hubmessage::action::publish) {
+                auto const body = msg.body();
+                dispatch(subscriber, msg.topic(), {&body, 1}, relayed(msg.stamps()),
+                         [&](span<char const>) { return subscriber->pool().make(msg); });
+                return;
+            }
+
+            if (msg.get_action() == hubmessage::action::batch) {
+                detail::wire::batch batch;
+                if (detail::wire::read_batch(msg, batch)) {
+                    batch.stamps = relayed(batch.stamps);
+                    dispatch(subscriber, batch);
                 }
-                break;
+                return;
+            }
+
+            auto topic = msg.topic();
+
+            switch (msg.get_action()) {
 
             case hubmessage::action::subscribe:
-#if __cpp_lib_erase_if // allows us to write that in one go:
-                std::erase_if(remote_subs_, [](auto& p) { return p.second.expired(); });
-#endif
-                remote_subs_.emplace(topic, subscriber);
+                subscribe_remote(subscriber, topic, detail::wire::subscription_of(msg));
                 break;
 
             case hubmessage::action::unsubscribe:
-                for (auto it = range.first; it != range.second;) {
-                    if (auto alive = it->second.lock();
-                        !alive || alive == subscriber) {
-                        it = remote_subs_.erase(it);
-                    } else {
-                        ++it;
+                subs_.update([&](subscriptions& subs) {
+                    if (subs.find(topic)) {
+                        std::erase_if(subs.edit(topic).remote, [&](auto& w) {
+                            auto alive = w.lock();
+                            return !alive || alive == subscriber;
+                        });
+                        subs.refresh_pattern(topic);
                     }
-                }
+                });
                 break;
 
             default:
@@ -180,29 +1356,191 @@ namespace msghublib {
             }
         }
 
+        std::mutex& topic_lock(detail::topic_id id) { return topic_locks_[id % topic_locks_.size()]; }
+
+        bool kept_or_logged(detail::topic_id id) const {
+            auto subs = subs_.read();
+            return subs->entries[id]->retained || subs->entries[id]->logged;
+        }
+
+        // Registers a remote subscriber and replays to it what the retained
+        // topics it subscribes to kept, or what the log holds of persisted
+        // ones from `from` on, holding their locks from before it shows to
+        // publishers until after the replay is queued
+        void subscribe_remote(std::shared_ptr<hubclient> const& subscriber, std::string_view topic,
+                              detail::wire::subscription const& subscription) {
+            auto const& from = subscription.replay;
+            std::vector<detail::topic_id>                      replayed;
+            std::vector<std::pair<detail::topic_id, std::string>> logged;
+            std::vector<std::unique_lock<std::mutex>>          locked;
+
+            subs_.update([&](subscriptions& subs) {
+                purge(subs);
+                if (refuses(subs, topic))
+                    return;
+                if (subscription.conflation && detail::topic_trie::is_pattern(topic))
+                    subs.conflate(topic);
+                // subscribing anew changes conflation only, see hubclient
+                auto& remote = subs.edit(topic).remote;
+                if (std::any_of(remote.begin(), remote.end(),
+                                [&](auto const& w) { return w.lock() == subscriber; }))
+                    return;
+                remote.push_back(subscriber);
+                subs.refresh_pattern(topic);
+
+                // the topic itself, or the topics matching the pattern;
+                // those replayed from the log don't need their last values
+                auto const id = *subs.topics->find(topic);
+                for (detail::topic_id t = 0; t < subs.entries.size(); ++t) {
+                    auto const& entry = subs.entries[t];
+                    if (!entry ||
+                        (t != id && !std::binary_search(entry->matches.begin(), entry->matches.end(), id)))
+                        continue;
+                    if (from && log_ && entry->logged)
+                        logged.emplace_back(t, subs.topics->name(t));
+                    else if (entry->retained)
+                        replayed.push_back(t);
+                }
+
+                // in address order, as publishers only ever take one
+                std::vector<std::mutex*> locks;
+                for (auto t : replayed)
+                    locks.push_back(&topic_lock(t));
+                for (auto const& t : logged)
+                    locks.push_back(&topic_lock(t.first));
+                std::sort(locks.begin(), locks.end());
+                locks.erase(std::unique(locks.begin(), locks.end()), locks.end());
+                for (auto* mx : locks)
+                    locked.emplace_back(*mx);
+            });
+
+            for (auto t : replayed)
+                retained_.replay(t, [&](shared_hubmessage const& frame) { subscriber->send(frame); });
+
+            if (!logged.empty()) {
+                std::vector<std::uint32_t> ids;
+                for (auto const& t : logged)
+                    ids.push_back(t.first);
+                subscriber->begin_replay(ids);
+                // paced by the subscriber, which doesn't stay for it
+                std::weak_ptr<hubclient> const to = subscriber;
+                log_->replay(
+                    std::move(logged), *from,
+                    [to](std::vector<shared_hubmessage> batch) {
+                        auto s = to.lock();
+                        return s && (s->send_replayed(std::move(batch)), true);
+                    },
+                    [to] {
+                        auto s = to.lock();
+                        return !s || s->replay_ready();
+                    },
+                    [to, ids] {
+                        if (auto s = to.lock())
+                            s->end_replay(ids);
+                    });
+            }
+        }
+
+        // Drops departed remote subscribers, only copying affected entries
+        static void purge(subscriptions& subs) {
+            auto expired = [](auto& w) { return w.expired(); };
+
+            for (detail::topic_id id = 0; id < subs.entries.size(); ++id) {
+                auto const& entry = subs.entries[id];
+                if (entry && std::any_of(entry->remote.begin(), entry->remote.end(), expired)) {
+                    std::erase_if(subs.edit(id).remote, expired);
+                    subs.refresh_pattern(id);
+                }
+            }
+        }
+
+        void distribute(std::shared_ptr<hubclient> const& publisher,
+                        std::shared_ptr<large_message> msg) override {
+            dispatch(publisher, std::move(msg));
+        }
+
         void deliver(hubmessage const& msg) override {
-            lookup_handler(msg.topic())(msg.topic(), msg.body());
+            deliver_local(msg.topic(), msg.body(), msg.stamps());
+        }
+
+        // Large publications from the hub: streamed subscribers get each
+        // chunk as it arrives, the others the reassembled body
+        bool deliver_chunk(std::string_view topic, span<char const> chunk,
+                           std::size_t offset, std::size_t total) override {
+            auto const where = resolve(topic);
+            if (!where)
+                return false;
+
+            bool whole = false;
+            auto subs = subs_.read();
+            for_each_match(*subs, *where, [&](topic_entry const& e) {
+                if (e.streamed)
+                    e.streamed(topic, chunk, offset, total);
+                whole = whole || e.local;
+            });
+            return whole;
+        }
+
+        void deliver(large_message const& msg) override {
+            auto const where = resolve(msg.topic);
+            if (!where)
+                return;
+
+            span<char const> const body(msg.body.data(), msg.body.size());
+            auto subs = subs_.read();
+            for_each_match(*subs, *where, [&](topic_entry const& e) {
+                if (e.local)
+                    e.local(msg.topic, body);
+            });
+        }
+
+        template <typename Acceptor> static void close(Acceptor& acceptor) {
+            error_code ignored;
+            acceptor.close(ignored);
         }
 
-        void accept_next() {
+        // Either acceptor: clients are served alike whatever their transport
+        template <typename Acceptor> void accept_next(Acceptor& acceptor) {
             auto subscriber =
-                std::make_shared<hubclient>(acceptor_.get_executor(), *this);
+                std::make_shared<hubclient>(executor_, *this);
 
             // Schedule next accept
-            acceptor_.async_accept(
+            acceptor.async_accept(
                 subscriber->socket(),
-                [=, this, self = shared_from_this()](error_code ec) {
-                    handle_accept(subscriber, ec);
+                [=, this, &acceptor, self = shared_from_this()](error_code ec) {
+                    handle_accept(acceptor, subscriber, ec, [this, &acceptor, self] { accept_next(acceptor); });
                 });
         }
 
-        void handle_accept(std::shared_ptr<hubclient> const& client, error_code error) {
+        // A lane's clients are served on its context, for life
+        void accept_next(lane& l) {
+            auto subscriber = std::make_shared<hubclient>(any_io_executor(l.context.get_executor()), *this);
+
+            l.acceptor.async_accept(subscriber->socket(), [this, &l, subscriber](error_code ec) {
+                handle_accept(l.acceptor, subscriber, ec, [this, &l] { accept_next(l); });
+            });
+        }
+
+        // Accepts on whatever failed, unless the acceptor was closed: a
+        // connection aborted at once, anything else (running out of
+        // descriptors in a reconnect storm, say) after a pause, lest we spin
+        template <typename Acceptor, typename Next>
+        void handle_accept(Acceptor& acceptor, std::shared_ptr<hubclient> const& client, error_code error,
+                           Next next) {
             if (!error) {
                 client->start();
-                accept_next();
-            } else {
-                //// TODO: Handle IO error - on thread exit
+                return next();
             }
+            if (error == boost::asio::error::operation_aborted || !acceptor.is_open())
+                return;
+
+            counters_->local().accept_errors.fetch_add(1, std::memory_order_relaxed);
+            if (error == boost::asio::error::connection_aborted ||
+                error == boost::asio::error::connection_reset)
+                return next();
+
+            auto pause = std::make_shared<boost::asio::steady_timer>(acceptor.get_executor(), accept_pause);
+            pause->async_wait([pause, next](error_code) { next(); });
         }
     };
 
@@ -210,24 +1548,66 @@ namespace msghublib {
 
 namespace msghublib {
 
-    /*explicit*/ msghub::msghub(boost::asio::any_io_executor executor)
-        : pimpl(std::make_shared<impl>(executor)) {}
+    /*explicit*/ msghub::msghub(boost::asio::any_io_executor executor, hub_options options)
+        : pimpl(std::make_shared<impl>(executor, std::move(options))) {}
 
     msghub::~msghub() = default;
 
     // pimpl relays
     void msghub::stop()
         { return pimpl->stop();                            } 
+    hub_stats msghub::stats() const
+        { return pimpl->stats();                           } 
+    std::vector<topic_stats> msghub::stats_by_topic() const
+        { return pimpl->stats_by_topic();                  } 
+    std::vector<topic_latency> msghub::latency_by_topic() const
+        { return pimpl->latency_by_topic();                } 
+    msghub::executor_type msghub::get_executor() const
+        { return pimpl->get_executor();                    } 
     void msghub::connect(const std::string& hostip, uint16_t port, error_code& ec)
         { pimpl->connect(hostip, port, ec);                } 
     void msghub::create(uint16_t port, error_code& ec)
         { pimpl->create(port, ec);                         } 
+    void msghub::connect(const std::string& endpoint, error_code& ec)
+        { pimpl->connect(endpoint, ec);                    } 
+    void msghub::create(const std::string& endpoint, error_code& ec)
+        { pimpl->create(endpoint, ec);                     } 
     void msghub::unsubscribe(const std::string& topic, error_code& ec)
         { pimpl->unsubscribe(topic, ec);                   } 
+    void msghub::retain(const std::string& topic, std::size_t depth)
+        { pimpl->retain(topic, depth);                     } 
     void msghub::subscribe(const std::string& topic, onmessage handler, error_code& ec)
         { pimpl->subscribe(topic, std::move(handler), ec); } 
+    void msghub::subscribe_stream(const std::string& topic, onchunk handler, error_code& ec)
+        { pimpl->subscribe_stream(topic, std::move(handler), ec); } 
+    void msghub::subscribe_conflated(const std::string& topic, onmessage handler,
+                                     std::chrono::milliseconds min_interval, error_code& ec)
+        { pimpl->subscribe_conflated(topic, std::move(handler), min_interval, ec); } 
+    void msghub::persist(const std::string& topic, error_code& ec)
+        { pimpl->persist(topic, ec);                       } 
+    void msghub::subscribe_from(const std::string& topic, onmessage handler, std::uint64_t sequence,
+                                error_code& ec)
+        { pimpl->subscribe_from(topic, std::move(handler), {detail::log_position::by::sequence, sequence}, ec); } 
+    void msghub::subscribe_from(const std::string& topic, onmessage handler,
+                                std::chrono::system_clock::time_point since, error_code& ec) {
+        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(since.time_since_epoch()).count();
+        pimpl->subscribe_from(topic, std::move(handler),
+                              {detail::log_position::by::time, static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 0))}, ec);
+    }
     void msghub::publish(std::string_view topic, span<char const> message, error_code& ec)
         { pimpl->publish(topic, message, ec);              } 
+    void msghub::publish_batch(span<message_view const> messages, error_code& ec)
+        { pimpl->publish_batch(messages, ec);              } 
+    void msghub::initiate_connect(const std::string& hostip, uint16_t port, completion connected)
+        { pimpl->connect(hostip, port, std::move(connected)); } 
+    void msghub::initiate_connect(const std::string& endpoint, completion connected)
+        { pimpl->connect(endpoint, std::move(connected)); } 
+    void msghub::initiate_subscribe(const std::string& topic, onmessage handler, completion queued)
+        { pimpl->subscribe(topic, std::move(handler), std::move(queued)); } 
+    void msghub::initiate_unsubscribe(const std::string& topic, completion queued)
+        { pimpl->unsubscribe(topic, std::move(queued)); } 
+    void msghub::initiate_publish(std::string_view topic, span<char const> message, completion accepted)
+        { pimpl->publish(topic, message, std::move(accepted)); } 
 
     // convenience throwing wrappers
     void msghub::connect(const std::string& hostip, uint16_t port) {
@@ -242,6 +1622,18 @@ namespace msghublib {
         if (ec) throw system_error(ec);
     }
 
+    void msghub::connect(const std::string& endpoint) {
+        error_code ec;
+        connect(endpoint, ec);
+        if (ec) throw system_error(ec);
+    }
+
+    void msghub::create(const std::string& endpoint) {
+        error_code ec;
+        create(endpoint, ec);
+        if (ec) throw system_error(ec);
+    }
+
     void msghub::unsubscribe(const std::string& topic) {
         error_code ec;
         unsubscribe(topic, ec);
@@ -254,10 +1646,48 @@ namespace msghublib {
         if (ec) throw system_error(ec);
     }
 
+    void msghub::subscribe_stream(const std::string& topic, onchunk handler) {
+        error_code ec;
+        subscribe_stream(topic, std::move(handler), ec);
+        if (ec) throw system_error(ec);
+    }
+
+    void msghub::subscribe_conflated(const std::string& topic, onmessage handler,
+                                     std::chrono::milliseconds min_interval) {
+        error_code ec;
+        subscribe_conflated(topic, std::move(handler), min_interval, ec);
+        if (ec) throw system_error(ec);
+    }
+
+    void msghub::persist(const std::string& topic) {
+        error_code ec;
+        persist(topic, ec);
+        if (ec) throw system_error(ec);
+    }
+
+    void msghub::subscribe_from(const std::string& topic, onmessage handler, std::uint64_t sequence) {
+        error_code ec;
+        subscribe_from(topic, std::move(handler), sequence, ec);
+        if (ec) throw system_error(ec);
+    }
+
+    void msghub::subscribe_from(const std::string& topic, onmessage handler,
+                                std::chrono::system_clock::time_point since) {
+        error_code ec;
+        subscribe_from(topic, std::move(handler), since, ec);
+        if (ec) throw system_error(ec);
+    }
+
     void msghub::publish(std::string_view topic, span<char const> message) {
         error_code ec;
         publish(topic, message, ec);
         if (ec) throw system_error(ec);
     }
 
+    void msghub::publish_batch(span<message_view const> messages) {
+        error_code ec;
+        publish_batch(messages, ec);
+        if (ec) throw system_error(ec);
+    }
+
 } // namespace msghublib
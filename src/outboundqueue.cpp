@@ -0,0 +1,238 @@
+#include "outboundqueue.h"
+#include "hubcounters.h"
+#include "wireprotocol.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace msghublib::detail {
+
+    outbound_queue::~outbound_queue()
+    {
+        auto& counts = counters_->local();
+        counts.frames_queued.fetch_sub(frames_.size(), std::memory_order_relaxed);
+        counts.bytes_queued.fetch_sub(nbytes_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    bool outbound_queue::over(std::size_t divisor, bool held) const
+    {
+        auto limit = [divisor](std::size_t max) {
+            return max ? std::max<std::size_t>(max / divisor, 1) : 0;
+        };
+        auto const frames = limit(options_.max_queue_frames);
+        auto const bytes  = limit(options_.max_queue_bytes);
+
+        auto nframes = nframes_.load(std::memory_order_relaxed) + nbulk_.load(std::memory_order_relaxed);
+        auto nbytes  = nbytes_.load(std::memory_order_relaxed) + bulk_bytes_.load(std::memory_order_relaxed);
+        if (held) {
+            nframes += nheld_.load(std::memory_order_relaxed);
+            nbytes  += held_bytes_.load(std::memory_order_relaxed);
+        }
+        return (frames && nframes >= frames) || (bytes && nbytes >= bytes);
+    }
+
+    std::pair<bool, outbound_queue::verdict> outbound_queue::police(std::size_t inflight)
+    {
+        switch (options_.slow_consumer) {
+        case slow_consumer_policy::drop_newest:
+            counters_->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            return {false, verdict::dropped};
+
+        case slow_consumer_policy::drop_oldest:
+            if (auto oldest = std::find_if(
+                    frames_.begin() + inflight, frames_.end(),
+                    [](auto& f) { return f->publication(); });
+                oldest != frames_.end())
+            {
+                evicted_ = wire::publications(**oldest);
+                remove(oldest, std::next(oldest));
+            } else if (bulk_.size() > (bulk_offset_ ? 1 : 0)) {
+                // a large one not started yet, then
+                auto const at = bulk_.begin() + (bulk_offset_ ? 1 : 0);
+                bulk_bytes_.fetch_sub((*at)->body.size(), std::memory_order_relaxed);
+                bulk_.erase(at);
+                nbulk_.store(bulk_.size(), std::memory_order_relaxed);
+                evicted_ = 1;
+            } else {
+                return {true, verdict::queued};
+            }
+            counters_->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            return {true, verdict::dropped};
+
+        case slow_consumer_policy::disconnect:
+            counters_->local().consumers_disconnected.fetch_add(1, std::memory_order_relaxed);
+            return {false, verdict::overflow};
+
+        case slow_consumer_policy::block_publisher:
+            return {true, verdict::congested};
+        }
+        return {true, verdict::queued};
+    }
+
+    outbound_queue::verdict outbound_queue::push(shared_hubmessage msg, std::size_t inflight)
+    {
+        verdict result = verdict::queued;
+        evicted_ = 0;
+
+        // only publications are subject to the policy, control frames
+        // (subscriptions, negotiation, credit) always go out
+        if (congested() && msg->publication()) {
+            bool queue;
+            std::tie(queue, result) = police(inflight);
+            if (!queue)
+                return result;
+        }
+
+        auto const size = msg->wire_size();
+        nbytes_.fetch_add(size, std::memory_order_relaxed);
+        frames_.push_back(std::move(msg));
+        nframes_.store(frames_.size(), std::memory_order_relaxed);
+
+        auto& counts = counters_->local();
+        counts.frames_queued.fetch_add(1, std::memory_order_relaxed);
+        counts.bytes_queued.fetch_add(size, std::memory_order_relaxed);
+        hub_counters::raise(counters_->queue_high_water_frames, frames_.size());
+        hub_counters::raise(counters_->queue_high_water_bytes,
+                            nbytes_.load(std::memory_order_relaxed));
+        return result;
+    }
+
+    outbound_queue::verdict outbound_queue::push_conflated(shared_hubmessage msg, std::size_t inflight)
+    {
+        auto const  id     = *msg->topic_id();
+        auto const* queued = msg.get();
+        auto const  result = push(std::move(msg), inflight);
+        if (!frames_.empty() && frames_.back().get() == queued) // not dropped
+            conflated_[id] = popped_ + frames_.size() - 1;
+        return result;
+    }
+
+    bool outbound_queue::replace(shared_hubmessage const& msg, std::size_t inflight)
+    {
+        auto const pending = conflated_.find(*msg->topic_id());
+        if (pending == conflated_.end())
+            return false;
+        if (pending->second < popped_ + inflight) { // written, or being written
+            conflated_.erase(pending);
+            return false;
+        }
+
+        auto& slot = frames_[pending->second - popped_];
+        auto const old_size = slot->wire_size(), new_size = msg->wire_size();
+        slot = msg;
+        nbytes_.fetch_add(new_size - old_size, std::memory_order_relaxed); // wraps, as it should
+
+        auto& counts = counters_->local();
+        counts.frames_conflated.fetch_add(1, std::memory_order_relaxed);
+        counts.bytes_queued.fetch_add(new_size - old_size, std::memory_order_relaxed);
+        return true;
+    }
+
+    outbound_queue::verdict outbound_queue::push_bulk(shared_large_message msg, std::size_t inflight)
+    {
+        verdict result = verdict::queued;
+        evicted_ = 0;
+        if (congested()) {
+            bool queue;
+            std::tie(queue, result) = police(inflight);
+            if (!queue)
+                return result;
+        }
+
+        bulk_bytes_.fetch_add(msg->body.size(), std::memory_order_relaxed);
+        bulk_.push_back(std::move(msg));
+        nbulk_.store(bulk_.size(), std::memory_order_relaxed);
+        return result;
+    }
+
+    outbound_queue::verdict outbound_queue::hold(std::deque<held_publication>& held, held_publication msg,
+                                                 std::size_t inflight)
+    {
+        verdict result = verdict::queued;
+        if (congested()) {
+            if (options_.slow_consumer == slow_consumer_policy::drop_oldest && !held.empty()) {
+                unhold(held.front());
+                held.pop_front();
+                counters_->local().frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                result = verdict::dropped;
+            } else {
+                bool keep;
+                std::tie(keep, result) = police(inflight);
+                if (!keep)
+                    return result;
+            }
+        }
+
+        nheld_.fetch_add(1, std::memory_order_relaxed);
+        held_bytes_.fetch_add(msg.size(), std::memory_order_relaxed);
+        held.push_back(std::move(msg));
+        return result;
+    }
+
+    void outbound_queue::unhold(held_publication const& msg)
+    {
+        nheld_.fetch_sub(1, std::memory_order_relaxed);
+        held_bytes_.fetch_sub(msg.size(), std::memory_order_relaxed);
+    }
+
+    void outbound_queue::feed_bulk()
+    {
+        if (bulk_.empty())
+            return;
+
+        // fragments are never dropped, the policy was applied to the whole
+        auto const before = bulk_offset_;
+        push(std::make_shared<hubmessage const>(wire::fragment(*bulk_.front(), bulk_offset_)), 0);
+        bulk_bytes_.fetch_sub(bulk_offset_ - before, std::memory_order_relaxed);
+
+        if (bulk_offset_ == bulk_.front()->body.size()) {
+            bulk_.pop_front();
+            bulk_offset_ = 0;
+            nbulk_.store(bulk_.size(), std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t outbound_queue::discard_bulk()
+    {
+        auto const first = bulk_.begin() + (bulk_offset_ ? 1 : 0);
+        auto const n     = std::distance(first, bulk_.end());
+        for (auto it = first; it != bulk_.end(); ++it)
+            bulk_bytes_.fetch_sub((*it)->body.size(), std::memory_order_relaxed);
+        bulk_.erase(first, bulk_.end());
+        nbulk_.store(bulk_.size(), std::memory_order_relaxed);
+        return n;
+    }
+
+    void outbound_queue::pop(std::size_t n)
+    {
+        remove(frames_.begin(), frames_.begin() + n);
+    }
+
+    void outbound_queue::discard(std::size_t inflight)
+    {
+        auto const n = frames_.size() - std::min(inflight, frames_.size());
+        counters_->local().frames_dropped.fetch_add(n, std::memory_order_relaxed);
+        remove(frames_.end() - n, frames_.end());
+    }
+
+    void outbound_queue::remove(hubmessage_queue::iterator first, hubmessage_queue::iterator last)
+    {
+        std::size_t bytes = 0;
+        for (auto it = first; it != last; ++it)
+            bytes += (*it)->wire_size();
+
+        auto const n = std::distance(first, last);
+        if (first == frames_.begin())
+            popped_ += n;
+        else
+            conflated_.clear(); // positions moved
+        frames_.erase(first, last);
+        nbytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        nframes_.store(frames_.size(), std::memory_order_relaxed);
+
+        auto& counts = counters_->local();
+        counts.frames_queued.fetch_sub(n, std::memory_order_relaxed);
+        counts.bytes_queued.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "hub_options.h"
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace msghublib::detail {
+
+struct hub_counters;
+
+// A live publication held back during a replay (see outbound_queue::hold)
+struct held_publication {
+    shared_hubmessage    frame;
+    shared_large_message large; // instead of a frame
+
+    // as counted against the queue limits
+    [[nodiscard]] std::size_t size() const { return frame ? frame->wire_size() : large->body.size(); }
+};
+
+// The frames waiting to be written on one connection, bounded by the queue
+// limits in hub_options and enforcing its slow consumer policy. Only used
+// from the connection's strand, except congested() and drained().
+class outbound_queue
+{
+  public:
+    enum class verdict {
+        queued,
+        dropped,   // a publication was discarded (new or old, by policy)
+        congested, // queued over the limits, the publisher should wait
+        overflow,  // the connection should be closed
+    };
+
+    // Queue nodes come from `nodes`
+    outbound_queue(hub_options const& options, std::shared_ptr<hub_counters> counters,
+                   std::shared_ptr<recycler> const& nodes)
+        : options_(options), counters_(std::move(counters))
+        , frames_(recycling_allocator<shared_hubmessage>(nodes)) {}
+    outbound_queue(outbound_queue const&)            = delete;
+    outbound_queue& operator=(outbound_queue const&) = delete;
+    ~outbound_queue();
+
+    // The first `inflight` frames are being written and are never dropped
+    verdict push(shared_hubmessage msg, std::size_t inflight);
+    void    pop(std::size_t n);
+    // Publications queued before that the last push() or push_bulk()
+    // dropped for it (drop_oldest): a batch frame counts all it carries
+    [[nodiscard]] std::size_t evicted() const { return evicted_; }
+
+    // Conflation (see msghub::subscribe_conflated): a publication queued
+    // with push_conflated() is the one pending for its topic, until it is
+    // being written. replace() puts `msg` in its place, if there is one.
+    verdict push_conflated(shared_hubmessage msg, std::size_t inflight);
+    [[nodiscard]] bool replace(shared_hubmessage const& msg, std::size_t inflight);
+    // Drops all frames not being written
+    void    discard(std::size_t inflight);
+
+    [[nodiscard]] hubmessage_queue const& frames() const { return frames_; }
+    [[nodiscard]] bool                    empty()  const { return frames_.empty(); }
+
+    // Large publications wait in a lane of their own and are fed into the
+    // queue a fragment at a time, so that other frames get in between. They
+    // count against the limits as a frame each, with all of their body.
+    verdict push_bulk(shared_large_message msg, std::size_t inflight);
+    // Queues the next fragment, if any
+    void feed_bulk();
+    [[nodiscard]] bool bulk_pending() const { return !bulk_.empty(); }
+    // Drops the large publications not started yet, returns how many
+    std::size_t discard_bulk();
+
+    // Live publications held back during a replay (see hubclient) wait
+    // outside the queue, but count against the limits: hold() applies the
+    // policy to `msg`, dropping the oldest of `held` first under drop_oldest,
+    // before adding it to `held`; unhold() counts out one leaving `held`
+    verdict hold(std::deque<held_publication>& held, held_publication msg, std::size_t inflight);
+    void    unhold(held_publication const& msg);
+
+    // At or above the limits, resp. back below half of them
+    [[nodiscard]] bool congested() const { return over(1); }
+    [[nodiscard]] bool drained()   const { return !over(2); }
+    // Below the limits, resp. half of them and `frames`, held publications
+    // aside: for replayed ones
+    [[nodiscard]] bool has_room() const { return !over(1, false); }
+    [[nodiscard]] bool caught_up(std::size_t frames) const {
+        return nframes_.load(std::memory_order_relaxed) < frames && !over(2, false);
+    }
+
+  private:
+    [[nodiscard]] bool over(std::size_t divisor, bool held = true) const;
+    // The slow consumer policy, for a publication arriving while congested:
+    // whether to queue it, and the verdict
+    std::pair<bool, verdict> police(std::size_t inflight);
+    void remove(hubmessage_queue::iterator first, hubmessage_queue::iterator last);
+
+    hub_options const& options_;
+    std::shared_ptr<hub_counters> counters_;
+    hubmessage_queue   frames_;
+    std::deque<shared_large_message> bulk_;
+    std::size_t        bulk_offset_ = 0; // into the front of bulk_
+    // positions of the conflated frames pending, by topic id, counted from
+    // the first frame ever queued; forgotten once frames are removed other
+    // than from the front
+    std::unordered_map<std::uint32_t, std::uint64_t> conflated_;
+    std::uint64_t      popped_ = 0; // frames removed from the front
+    std::size_t        evicted_ = 0;
+    // mirrors of the queue extent, readable from other threads
+    std::atomic<std::size_t> nframes_{0}, nbytes_{0};
+    // likewise of bulk_: publications, and body bytes not fed yet
+    std::atomic<std::size_t> nbulk_{0}, bulk_bytes_{0};
+    // likewise of the held publications
+    std::atomic<std::size_t> nheld_{0}, held_bytes_{0};
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Read-mostly value published by copy-on-write.
+//
+// Writers are serialized, copy the current value, modify the copy and
+// publish it. Readers pin the current version without taking a lock or
+// touching a shared reference count: every thread caches the last snapshot
+// it read and only reloads it when the published version changed, so the
+// common read costs an acquire load and an uncontended increment.
+//
+// A thread's cache keeps its last snapshot alive until it next reads (any
+// rcu_value of the same type) or exits, or the snapshot is superseded: an
+// update releases the previous snapshots from the caches of all threads not
+// reading them, on the updating thread, as does destroying the rcu_value.
+template <typename T>
+class rcu_value
+{
+  public:
+    using pointer = std::shared_ptr<T const>;
+
+    explicit rcu_value(T initial = {})
+        : current_(std::make_shared<T const>(std::move(initial)))
+        , version_(next_version())
+    {}
+
+    rcu_value(rcu_value const&) = delete;
+    rcu_value& operator=(rcu_value const&) = delete;
+
+    // No reads may be in progress
+    ~rcu_value() {
+        std::vector<pointer> released; // not under the locks
+        auto& r = registry();
+        std::lock_guard lk(r.mutex);
+        for (auto* c : r.caches) {
+            std::lock_guard clk(c->mutex);
+            if (c->owner != this)
+                continue;
+            released.push_back(std::move(c->ptr));
+            c->owner = nullptr;
+            c->version.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Keeps a snapshot alive for as long as it exists
+    class read_guard
+    {
+      public:
+        T const* operator->() const { return value_; }
+        T const& operator*()  const { return *value_; }
+
+        read_guard(read_guard const&) = delete;
+        read_guard& operator=(read_guard const&) = delete;
+        ~read_guard() { if (!own_) cache().readers.fetch_sub(1, std::memory_order_release); }
+
+      private:
+        friend class rcu_value;
+        explicit read_guard(T const* cached) : value_(cached) {}
+        explicit read_guard(pointer own) : own_(std::move(own)), value_(own_.get()) {}
+
+        pointer  own_; // only set on the slow path
+        T const* value_;
+    };
+
+    [[nodiscard]] read_guard read() const {
+        auto& c = cache();
+        auto v = version_.load(std::memory_order_acquire);
+
+        if (c.version.load(std::memory_order_relaxed) != v && c.readers.load(std::memory_order_relaxed) == 0) {
+            pointer next; // the previous one is released after unlocking
+            std::lock_guard lk(c.mutex);
+            // loaded under the lock, so an update publishing meanwhile
+            // finds this snapshot superseded
+            v    = version_.load(std::memory_order_acquire);
+            next = std::atomic_load(&current_);
+            std::swap(c.ptr, next);
+            c.owner = this;
+            c.version.store(v, std::memory_order_relaxed);
+        }
+
+        // counted before checking the version, which an update clears
+        // before it checks the count (see release_superseded)
+        c.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (c.version.load(std::memory_order_seq_cst) == v)
+            return read_guard(c.ptr.get());
+        c.readers.fetch_sub(1, std::memory_order_relaxed);
+
+        // the cache is pinned by an enclosing read of another snapshot, or
+        // was just released
+        return read_guard(std::atomic_load(&current_));
+    }
+
+    // Applies `f` to a copy of the current value and publishes the result,
+    // unless `f` throws. Returns whatever `f` returns.
+    template <typename F> decltype(auto) update(F&& f) {
+        std::vector<pointer> released; // not under the lock
+        std::lock_guard      lk(mutex_);
+        auto next = std::make_shared<T>(*current_);
+
+        if constexpr (std::is_void_v<std::invoke_result_t<F, T&>>) {
+            std::forward<F>(f)(*next);
+            publish(std::move(next), released);
+        } else {
+            auto result = std::forward<F>(f)(*next);
+            publish(std::move(next), released);
+            return result;
+        }
+    }
+
+  private:
+    // Changed under its mutex, by its thread or by the owner of the cached
+    // snapshot when it supersedes it or is destroyed; its thread reads it
+    // without, relying on `readers` to keep the owner off its snapshot
+    struct thread_cache {
+        std::mutex                 mutex;
+        std::atomic<std::uint64_t> version{0};
+        rcu_value const*           owner = nullptr;
+        pointer                    ptr;
+        std::atomic<unsigned>      readers{0}; // changed by its thread only
+
+        thread_cache() {
+            auto& r = registry();
+            std::lock_guard lk(r.mutex);
+            r.caches.push_back(this);
+        }
+        ~thread_cache() {
+            auto& r = registry();
+            std::lock_guard lk(r.mutex);
+            std::erase(r.caches, this);
+        }
+    };
+    // the caches of all threads, for owners to clear
+    struct cache_registry {
+        std::mutex                 mutex;
+        std::vector<thread_cache*> caches;
+    };
+
+    static thread_cache& cache() {
+        static thread_local thread_cache s_cache;
+        return s_cache;
+    }
+
+    static cache_registry& registry() {
+        static cache_registry s_registry;
+        return s_registry;
+    }
+
+    // versions are unique across all instances, so a cached snapshot can
+    // never be mistaken for one of another instance
+    static std::uint64_t next_version() {
+        static std::atomic<std::uint64_t> s_generation{0};
+        return ++s_generation;
+    }
+
+    void publish(pointer next, std::vector<pointer>& released) {
+        released.push_back(std::atomic_exchange(&current_, std::move(next)));
+        auto const v = next_version();
+        version_.store(v, std::memory_order_release);
+        release_superseded(v, released);
+    }
+
+    // Takes snapshots older than version `v` from the caches of threads
+    // not reading them, so an idle thread doesn't keep them alive. A thread
+    // that starts reading meanwhile finds its version cleared and doesn't
+    // touch its snapshot; one that counted itself first keeps it.
+    void release_superseded(std::uint64_t v, std::vector<pointer>& released) {
+        auto& r = registry();
+        std::lock_guard lk(r.mutex);
+        for (auto* c : r.caches) {
+            std::lock_guard clk(c->mutex);
+            if (c->owner != this || c->version.load(std::memory_order_relaxed) == v)
+                continue;
+            c->version.store(0, std::memory_order_seq_cst);
+            if (c->readers.load(std::memory_order_seq_cst) != 0)
+                continue;
+            released.push_back(std::move(c->ptr));
+            c->owner = nullptr;
+        }
+    }
+
+    std::mutex                 mutex_;   // serializes writers
+    pointer                    current_; // using std::atomic_* accessors
+    std::atomic<std::uint64_t> version_;
+};
+
+}  // namespace msghublib::detail
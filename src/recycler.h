@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Keeps freed blocks for reuse by later allocations of the same size, so
+// that a connection in steady state stops hitting the heap for the handlers
+// it initiates and the nodes of its queue. Thread safe: handlers can be
+// allocated by one thread and freed by another.
+class recycler
+{
+  public:
+    explicit recycler(std::size_t keep = 64) : keep_(keep) {}
+    recycler(recycler const&)            = delete;
+    recycler& operator=(recycler const&) = delete;
+
+    ~recycler() {
+        for (auto& b : bins_)
+            for (void* p : b.blocks)
+                ::operator delete(p);
+    }
+
+    void* allocate(std::size_t size) {
+        {
+            std::lock_guard lk(mx_);
+            if (auto* b = find(size); b && !b->blocks.empty()) {
+                void* p = b->blocks.back();
+                b->blocks.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p, std::size_t size) noexcept {
+        {
+            std::lock_guard lk(mx_);
+            auto* b = find(size);
+            if (!b && bins_.size() < bins_.capacity()) {
+                b = &bins_.emplace_back();
+                b->size = size;
+                b->blocks.reserve(keep_);
+            }
+            if (b && b->blocks.size() < keep_) {
+                b->blocks.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+  private:
+    struct bin {
+        std::size_t        size = 0;
+        std::vector<void*> blocks;
+    };
+
+    bin* find(std::size_t size) {
+        for (auto& b : bins_)
+            if (b.size == size)
+                return &b;
+        return nullptr;
+    }
+
+    std::mutex       mx_;
+    std::size_t      keep_; // blocks per size
+    std::vector<bin> bins_ = [] { std::vector<bin> v; v.reserve(16); return v; }();
+};
+
+// Standard allocator drawing from a shared recycler, which it keeps alive
+template <typename T>
+class recycling_allocator
+{
+  public:
+    using value_type = T;
+
+    explicit recycling_allocator(std::shared_ptr<recycler> r) : recycler_(std::move(r)) {}
+    template <typename U>
+    recycling_allocator(recycling_allocator<U> const& other) : recycler_(other.recycler_) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(recycler_->allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        recycler_->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U> bool operator==(recycling_allocator<U> const& other) const {
+        return recycler_ == other.recycler_;
+    }
+
+  private:
+    template <typename U> friend class recycling_allocator;
+    std::shared_ptr<recycler> recycler_;
+};
+
+// Completion handler whose operation state Asio allocates from a recycler,
+// through the associated allocator
+template <typename Handler>
+class recycled_handler
+{
+  public:
+    using allocator_type = recycling_allocator<void>;
+
+    recycled_handler(std::shared_ptr<recycler> const& r, Handler handler)
+        : allocator_(r), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_; }
+
+    template <typename... Args> void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+  private:
+    allocator_type allocator_;
+    Handler        handler_;
+};
+
+template <typename Handler>
+recycled_handler<std::decay_t<Handler>> recycled(std::shared_ptr<recycler> const& r, Handler&& handler) {
+    return {r, std::forward<Handler>(handler)};
+}
+
+}  // namespace msghublib::detail
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "span.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <boost/system/error_code.hpp>
+
+namespace msghublib::detail {
+
+// Single producer, single consumer byte ring in memory shared by two
+// processes. Head and tail count the bytes ever written and read, the
+// capacity is a power of two.
+//
+// The other process may write anything into the control block, so each side
+// keeps its own count in private memory and checks the peer's against the
+// capacity before copying: a ring claiming more than that is corrupt.
+//
+// A side that found the ring empty (or full) raises its sleeps flag and
+// checks again before waiting for a wakeup; the other side only wakes it if
+// it finds the flag raised, so a busy ring costs no system calls.
+class shm_ring
+{
+  public:
+    struct control {
+        alignas(64) std::atomic<std::uint64_t> head{0}; // written by the producer
+        alignas(64) std::atomic<std::uint64_t> tail{0}; // written by the consumer
+        alignas(64) std::atomic<bool> reader_sleeps{false};
+        alignas(64) std::atomic<bool> writer_sleeps{false};
+    };
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+                  std::atomic<bool>::is_always_lock_free,
+                  "shared between processes");
+
+    static constexpr std::size_t footprint(std::size_t capacity) {
+        return sizeof(control) + capacity;
+    }
+
+    shm_ring() = default;
+    // Views a ring of `capacity` bytes at `at`; the creator initializes it
+    shm_ring(void* at, std::size_t capacity, bool initialize)
+        : control_(initialize ? new (at) control : std::launder(static_cast<control*>(at)))
+        , data_(static_cast<char*>(at) + sizeof(control))
+        , mask_(capacity - 1)
+        , written_(control_->head.load(std::memory_order_relaxed))
+        , read_(control_->tail.load(std::memory_order_relaxed)) {}
+
+    // Copies as much of `bytes` as fits, returning how much that was. The
+    // reader sees them after the next flush().
+    std::size_t write(span<char const> bytes, boost::system::error_code& ec) {
+        auto const used = written_ - control_->tail.load(std::memory_order_acquire);
+        if (used > capacity())
+            return corrupt(ec);
+
+        auto const n = std::min<std::size_t>(bytes.size(), capacity() - used);
+        copy_in(written_, bytes.data(), n);
+        written_ += n;
+        return n;
+    }
+
+    void flush() { control_->head.store(written_, std::memory_order_seq_cst); }
+
+    // Moves up to `into.size()` bytes out of the ring
+    std::size_t read(span<char> into, boost::system::error_code& ec) {
+        auto const available = control_->head.load(std::memory_order_acquire) - read_;
+        if (available > capacity())
+            return corrupt(ec);
+
+        auto const n = std::min<std::size_t>(into.size(), available);
+        copy_out(read_, into.data(), n);
+        read_ += n;
+        control_->tail.store(read_, std::memory_order_seq_cst);
+        return n;
+    }
+
+    // Either also holds for a corrupt ring, so that the next read() or
+    // write() reports it rather than waiting
+    [[nodiscard]] bool readable() const { return control_->head.load(std::memory_order_seq_cst) != read_; }
+    [[nodiscard]] bool writable() const {
+        return written_ - control_->tail.load(std::memory_order_seq_cst) != capacity();
+    }
+
+    // About to wait: raise the flag, then check again. Returns whether the
+    // wait is still needed; the flag is lowered otherwise.
+    bool sleep_reading() { return sleep(control_->reader_sleeps, [this] { return !readable(); }); }
+    bool sleep_writing() { return sleep(control_->writer_sleeps, [this] { return !writable(); }); }
+    void wake_reading() { control_->reader_sleeps.store(false, std::memory_order_relaxed); }
+    void wake_writing() { control_->writer_sleeps.store(false, std::memory_order_relaxed); }
+
+    // Whether the other side needs a wakeup now, lowering its flag
+    bool reader_asleep() { return control_->reader_sleeps.exchange(false, std::memory_order_seq_cst); }
+    bool writer_asleep() { return control_->writer_sleeps.exchange(false, std::memory_order_seq_cst); }
+
+  private:
+    [[nodiscard]] std::size_t capacity() const { return mask_ + 1; }
+
+    static std::size_t corrupt(boost::system::error_code& ec) {
+        ec = make_error_code(boost::system::errc::bad_message);
+        return 0;
+    }
+
+    template <typename Still> static bool sleep(std::atomic<bool>& flag, Still still) {
+        flag.store(true, std::memory_order_seq_cst);
+        if (still())
+            return true;
+        flag.store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    void copy_in(std::uint64_t at, char const* from, std::size_t n) {
+        auto const offset = at & mask_;
+        auto const first  = std::min<std::size_t>(n, mask_ + 1 - offset);
+        std::copy_n(from, first, data_ + offset);
+        std::copy_n(from + first, n - first, data_);
+    }
+
+    void copy_out(std::uint64_t at, char* to, std::size_t n) const {
+        auto const offset = at & mask_;
+        auto const first  = std::min<std::size_t>(n, mask_ + 1 - offset);
+        std::copy_n(data_ + offset, first, to);
+        std::copy_n(data_, n - first, to + first);
+    }
+
+    control*      control_ = nullptr;
+    char*         data_    = nullptr;
+    std::size_t   mask_    = 0;
+    std::uint64_t written_ = 0; // by this side, as producer
+    std::uint64_t read_    = 0; // by this side, as consumer
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,321 @@
+#include "shmstream.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace msghublib::detail {
+
+    namespace {
+        constexpr std::size_t max_fds = 4; // per message
+
+        boost::system::error_code last_error() {
+            return {errno, boost::system::system_category()};
+        }
+
+        unique_fd duplicate(unique_fd const& fd, boost::system::error_code& ec) {
+            unique_fd copy(::fcntl(fd.get(), F_DUPFD_CLOEXEC, 0));
+            if (!copy)
+                ec = last_error();
+            return copy;
+        }
+    }
+
+    void unique_fd::reset(int fd)
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = fd;
+    }
+
+    void send_with_fds(int socket, span<char const> bytes, span<int const> fds,
+                       boost::system::error_code& ec)
+    {
+        ec = {};
+        if (fds.size() > max_fds || bytes.empty()) {
+            ec = boost::asio::error::invalid_argument;
+            return;
+        }
+
+        alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_fds)> control{};
+        iovec  iov{const_cast<char*>(bytes.data()), bytes.size()};
+        msghdr msg{};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.data();
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        auto* cmsg       = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+        // the descriptors go along with the first part sent
+        while (iov.iov_len) {
+            auto const n = ::sendmsg(socket, &msg, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                ec = last_error();
+                return;
+            }
+            iov.iov_base = static_cast<char*>(iov.iov_base) + n;
+            iov.iov_len -= n;
+            msg.msg_control    = nullptr;
+            msg.msg_controllen = 0;
+        }
+    }
+
+    std::size_t receive_with_fds(int socket, boost::asio::mutable_buffer into,
+                                 std::vector<unique_fd>& fds, boost::system::error_code& ec)
+    {
+        ec = {};
+        alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_fds)> control{};
+        iovec  iov{into.data(), into.size()};
+        msghdr msg{};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+
+        ssize_t n;
+        do
+            n = ::recvmsg(socket, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        while (n < 0 && errno == EINTR);
+
+        if (n < 0) {
+            ec = last_error();
+            return 0;
+        }
+
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            auto const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i < count; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds.emplace_back(fd);
+            }
+        }
+
+        if (n == 0)
+            ec = boost::asio::error::eof;
+        return n;
+    }
+
+    shm_stream::handles shm_stream::allocate(std::size_t ring_size, error_code& ec)
+    {
+        ec = {};
+        handles h{
+            unique_fd(::memfd_create("msghub", MFD_CLOEXEC | MFD_ALLOW_SEALING)),
+            unique_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+            unique_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+        };
+
+        // sealed at its size, so that the hub can trust it to stay mapped
+        if (!h.memory || !h.wake_client || !h.wake_hub ||
+            ::ftruncate(h.memory.get(), 2 * shm_ring::footprint(ring_size)) != 0 ||
+            ::fcntl(h.memory.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+            ec = last_error();
+        return h;
+    }
+
+    std::shared_ptr<shm_stream> shm_stream::open(executor_type const& executor, handles const& h,
+                                                 std::size_t ring_size, side s,
+                                                 std::chrono::nanoseconds busy_poll,
+                                                 error_code& ec)
+    {
+        ec = {};
+        auto const footprint = shm_ring::footprint(ring_size);
+
+        // a region the peer could still shrink would fault us on access
+        struct stat st {};
+        int const seals = ::fcntl(h.memory.get(), F_GET_SEALS);
+        if (ring_size < 64 || (ring_size & (ring_size - 1)) || seals < 0 || !(seals & F_SEAL_SHRINK) ||
+            ::fstat(h.memory.get(), &st) != 0 ||
+            static_cast<std::size_t>(st.st_size) < 2 * footprint) {
+            ec = boost::asio::error::invalid_argument;
+            return nullptr;
+        }
+
+        auto stream = std::make_shared<shm_stream>(executor, busy_poll);
+        stream->region_ = ::mmap(nullptr, 2 * footprint, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                 h.memory.get(), 0);
+        if (stream->region_ == MAP_FAILED) {
+            stream->region_ = nullptr;
+            ec = last_error();
+            return nullptr;
+        }
+        stream->region_size_ = 2 * footprint;
+
+        // the client to hub ring comes first; the client initializes both
+        bool const client = s == side::client;
+        shm_ring upstream(stream->region_, ring_size, client);
+        shm_ring downstream(static_cast<char*>(stream->region_) + footprint, ring_size, client);
+        stream->in_  = client ? downstream : upstream;
+        stream->out_ = client ? upstream : downstream;
+
+        auto self = duplicate(client ? h.wake_client : h.wake_hub, ec);
+        if (!ec)
+            stream->wake_peer_ = duplicate(client ? h.wake_hub : h.wake_client, ec);
+        if (!ec)
+            stream->wake_self_.assign(self.release(), ec);
+        return ec ? nullptr : stream;
+    }
+
+    shm_stream::shm_stream(executor_type const& executor, std::chrono::nanoseconds busy_poll)
+        : executor_(executor), busy_poll_(busy_poll), wake_self_(executor) {}
+
+    shm_stream::~shm_stream()
+    {
+        if (region_)
+            ::munmap(region_, region_size_);
+    }
+
+    void shm_stream::async_read_some(boost::asio::mutable_buffer into, completion done)
+    {
+        // a connection starts reading from the thread that connected it
+        dispatch(executor_, [this, self = shared_from_this(), into, done = std::move(done)]() mutable {
+            if (closed_)
+                return complete(std::move(done), boost::asio::error::operation_aborted, 0);
+
+            read_into_ = into;
+            read_done_ = std::move(done);
+            progress();
+        });
+    }
+
+    void shm_stream::async_write(span<boost::asio::const_buffer const> buffers, completion done)
+    {
+        dispatch(executor_, [this, self = shared_from_this(), buffers, done = std::move(done)]() mutable {
+            if (closed_)
+                return complete(std::move(done), boost::asio::error::operation_aborted, 0);
+
+            write_from_  = buffers;
+            write_index_ = write_offset_ = written_ = 0;
+            write_done_  = std::move(done);
+            progress();
+        });
+    }
+
+    void shm_stream::close()
+    {
+        closed_ = true;
+        error_code ignored;
+        wake_self_.cancel(ignored);
+
+        if (read_done_)
+            complete(std::exchange(read_done_, {}), boost::asio::error::operation_aborted, 0);
+        if (write_done_)
+            complete(std::exchange(write_done_, {}), boost::asio::error::operation_aborted, written_);
+    }
+
+    void shm_stream::progress()
+    {
+        auto const until = std::chrono::steady_clock::now() + busy_poll_;
+
+        while (read_done_ || write_done_) {
+            bool const moved = (read_done_ && try_read()) | (write_done_ && try_write());
+            if (moved || (busy_poll_.count() && std::chrono::steady_clock::now() < until))
+                continue;
+
+            // sleep, unless the peer got in first
+            bool const read_blocked  = !read_done_ || in_.sleep_reading();
+            bool const write_blocked = !write_done_ || out_.sleep_writing();
+            if (read_blocked && write_blocked) {
+                if (!waiting_)
+                    wait();
+                return;
+            }
+            in_.wake_reading();
+            out_.wake_writing();
+        }
+    }
+
+    bool shm_stream::try_read()
+    {
+        error_code ec;
+        auto const n = in_.read({static_cast<char*>(read_into_.data()), read_into_.size()}, ec);
+        if (ec) {
+            complete(std::exchange(read_done_, {}), ec, 0);
+            return true;
+        }
+        if (!n)
+            return false;
+
+        if (in_.writer_asleep())
+            signal_peer();
+        complete(std::exchange(read_done_, {}), {}, n);
+        return true;
+    }
+
+    bool shm_stream::try_write()
+    {
+        error_code  ec;
+        std::size_t moved = 0;
+        for (; write_index_ < write_from_.size(); ++write_index_, write_offset_ = 0) {
+            auto const& buffer = write_from_[write_index_];
+            auto const  rest   = buffer.size() - write_offset_;
+            auto const  n      = out_.write({static_cast<char const*>(buffer.data()) + write_offset_, rest}, ec);
+            if (ec) {
+                complete(std::exchange(write_done_, {}), ec, written_);
+                return true;
+            }
+
+            moved += n;
+            if (n < rest) {
+                write_offset_ += n;
+                break;
+            }
+        }
+
+        if (moved) {
+            written_ += moved;
+            out_.flush();
+            if (out_.reader_asleep())
+                signal_peer();
+        }
+        if (write_index_ == write_from_.size()) {
+            complete(std::exchange(write_done_, {}), {}, written_);
+            return true;
+        }
+        return moved != 0;
+    }
+
+    void shm_stream::wait()
+    {
+        waiting_ = true;
+        wake_self_.async_wait(descriptor::wait_read, [this, self = shared_from_this()](error_code ec) {
+            waiting_ = false;
+            if (ec || closed_)
+                return; // close() failed the operations
+
+            std::uint64_t count;
+            [[maybe_unused]] auto n = ::read(wake_self_.native_handle(), &count, sizeof(count));
+            in_.wake_reading();
+            out_.wake_writing();
+            progress();
+        });
+    }
+
+    void shm_stream::signal_peer()
+    {
+        std::uint64_t const one = 1;
+        [[maybe_unused]] auto n = ::write(wake_peer_.get(), &one, sizeof(one));
+    }
+
+    void shm_stream::complete(completion done, error_code ec, std::size_t n)
+    {
+        post(executor_, [done = std::move(done), ec, n] { done(ec, n); });
+    }
+
+}  // namespace msghublib::detail
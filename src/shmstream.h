@@ -0,0 +1,128 @@
+#pragma once
+
+#include "hubexecutor.h"
+#include "shmring.h"
+#include "span.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace msghublib::detail {
+
+// Owns a file descriptor
+class unique_fd
+{
+  public:
+    unique_fd() = default;
+    explicit unique_fd(int fd) : fd_(fd) {}
+    unique_fd(unique_fd&& other) noexcept : fd_(other.release()) {}
+    unique_fd& operator=(unique_fd&& other) noexcept {
+        reset(other.release());
+        return *this;
+    }
+    ~unique_fd() { reset(); }
+
+    [[nodiscard]] int get() const { return fd_; }
+    explicit operator bool() const { return fd_ >= 0; }
+    int release() { return std::exchange(fd_, -1); }
+    void reset(int fd = -1);
+
+  private:
+    int fd_ = -1;
+};
+
+// Sends `bytes` over a Unix domain socket along with descriptors for the
+// peer to receive
+void send_with_fds(int socket, span<char const> bytes, span<int const> fds,
+                   boost::system::error_code& ec);
+// Receives into `into` without blocking, appending any descriptors that
+// came along to `fds`. Fails with would_block if there was nothing to read,
+// with eof once the peer closed.
+std::size_t receive_with_fds(int socket, boost::asio::mutable_buffer into,
+                             std::vector<unique_fd>& fds, boost::system::error_code& ec);
+
+// Byte stream between two processes on the same host, through a pair of
+// shm_rings in a memfd region, with an eventfd per side to wake it up. The
+// frames of a connection travel through it exactly as through its socket,
+// which only remains to tell either side when the other one went away.
+//
+// Operations run and complete on the executor, never from within the
+// initiating call; at most one read and one write may be outstanding. A side that
+// finds nothing to do polls for up to `busy_poll` before going to sleep,
+// keeping its io thread busy in the meantime.
+class shm_stream : public std::enable_shared_from_this<shm_stream>
+{
+  public:
+    using executor_type = boost::asio::strand<hub_executor<>>;
+    using error_code    = boost::system::error_code;
+    using completion    = std::function<void(error_code, std::size_t)>;
+
+    enum class side { client, hub };
+
+    // Shared by both sides: the client creates them and hands them to the
+    // hub, in this order
+    struct handles {
+        unique_fd memory, wake_client, wake_hub;
+    };
+
+    // Creates a region with rings of `ring_size` bytes, a power of two,
+    // sealed against resizing
+    static handles allocate(std::size_t ring_size, error_code& ec);
+
+    // Maps the region, keeping copies of the eventfds it needs; returns
+    // null on failure, such as a region smaller than `ring_size` implies
+    // or one that isn't sealed against shrinking.
+    // The client opens it before handing it to the hub.
+    static std::shared_ptr<shm_stream> open(executor_type const& executor, handles const& h,
+                                            std::size_t ring_size, side s,
+                                            std::chrono::nanoseconds busy_poll,
+                                            error_code& ec);
+
+    shm_stream(executor_type const& executor, std::chrono::nanoseconds busy_poll);
+    shm_stream(shm_stream const&)            = delete;
+    shm_stream& operator=(shm_stream const&) = delete;
+    ~shm_stream();
+
+    void async_read_some(boost::asio::mutable_buffer into, completion done);
+    // Completes once all of `buffers` were written; they must stay valid
+    // until then
+    void async_write(span<boost::asio::const_buffer const> buffers, completion done);
+
+    // Fails outstanding operations with operation_aborted
+    void close();
+
+  private:
+    using descriptor = boost::asio::posix::basic_stream_descriptor<executor_type>;
+
+    void progress();
+    bool try_read();
+    bool try_write();
+    void wait();
+    void signal_peer();
+    void complete(completion done, error_code ec, std::size_t n);
+
+    executor_type                              executor_;
+    std::chrono::nanoseconds                   busy_poll_;
+    void*                                      region_      = nullptr;
+    std::size_t                                region_size_ = 0;
+    shm_ring                                   in_, out_;
+    descriptor                                 wake_self_;
+    unique_fd                                  wake_peer_;
+    bool                                       waiting_ = false;
+    bool                                       closed_  = false;
+
+    boost::asio::mutable_buffer                read_into_;
+    completion                                 read_done_;
+    span<boost::asio::const_buffer const>      write_from_;
+    std::size_t                                write_index_ = 0, write_offset_ = 0, written_ = 0;
+    completion                                 write_done_;
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,61 @@
+#include "sysreport.h"
+
+#include <sstream>
+
+namespace msghublib::detail {
+
+    namespace {
+        // Topic names are the only strings; they're the client's choice
+        void quoted(std::ostream& os, std::string const& text)
+        {
+            static char const hex[] = "0123456789abcdef";
+            os << '"';
+            for (unsigned char c : text) {
+                if (c == '"' || c == '\\')
+                    os << '\\' << c;
+                else if (c < 0x20)
+                    os << "\\u00" << hex[c >> 4] << hex[c & 0xF];
+                else
+                    os << c;
+            }
+            os << '"';
+        }
+    }
+
+    std::string stats_report(hub_stats const& s)
+    {
+        std::ostringstream os;
+        os << "{\"writes\":" << s.writes << ",\"frames_written\":" << s.frames_written
+           << ",\"bytes_written\":" << s.bytes_written << ",\"publications_in\":" << s.publications_in
+           << ",\"bytes_in\":" << s.bytes_in << ",\"frames_dropped\":" << s.frames_dropped
+           << ",\"frames_conflated\":" << s.frames_conflated
+           << ",\"consumers_disconnected\":" << s.consumers_disconnected
+           << ",\"publishers_paused\":" << s.publishers_paused
+           << ",\"queue_high_water_frames\":" << s.queue_high_water_frames
+           << ",\"queue_high_water_bytes\":" << s.queue_high_water_bytes
+           << ",\"frames_queued\":" << s.frames_queued << ",\"bytes_queued\":" << s.bytes_queued
+           << ",\"connections_accepted\":" << s.connections_accepted
+           << ",\"connections_open\":" << s.connections_open
+           << ",\"accept_errors\":" << s.accept_errors << ",\"topics\":" << s.topics
+           << ",\"subscriptions\":" << s.subscriptions
+           << ",\"topics_refused\":" << s.topics_refused << "}";
+        return os.str();
+    }
+
+    std::string topics_report(span<topic_stats const> topics)
+    {
+        std::ostringstream os;
+        os << '[';
+        char const* sep = "";
+        for (auto const& t : topics) {
+            os << sep << "{\"topic\":";
+            quoted(os, t.topic);
+            os << ",\"publications\":" << t.publications << ",\"bytes\":" << t.bytes
+               << ",\"subscribers\":" << t.subscribers << '}';
+            sep = ",";
+        }
+        os << ']';
+        return os.str();
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "hub_stats.h"
+#include "span.h"
+
+#include <string>
+
+namespace msghublib::detail {
+
+// Bodies of the "$SYS" publications (see hub_options::sys_interval), JSON
+std::string stats_report(hub_stats const& stats);
+// `topics` as they fared since the last report
+std::string topics_report(span<topic_stats const> topics);
+
+}  // namespace msghublib::detail
@@ -0,0 +1,29 @@
+#include "topicregistry.h"
+
+namespace msghublib::detail {
+
+    topic_registry::topic_registry(topic_registry const& other)
+        : ids_(other.ids_)
+        , names_(other.names_.size())
+    {
+        // names_ must refer to our own keys
+        for (auto const& [name, id] : ids_)
+            names_[id] = &name;
+    }
+
+    std::optional<topic_id> topic_registry::find(std::string_view topic) const
+    {
+        if (auto it = ids_.find(topic); it != ids_.end())
+            return it->second;
+        return std::nullopt;
+    }
+
+    topic_id topic_registry::intern(std::string_view topic)
+    {
+        auto [it, inserted] = ids_.emplace(topic, static_cast<topic_id>(names_.size()));
+        if (inserted)
+            names_.push_back(&it->first);
+        return it->second;
+    }
+
+}  // namespace msghublib::detail
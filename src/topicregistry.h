@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace msghublib::detail {
+
+using topic_id = std::uint32_t;
+
+// Transparent hash, for heterogeneous string_view lookup in unordered maps
+struct string_hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view sv) const {
+        return std::hash<std::string_view>{}(sv);
+    }
+};
+
+// Interns topic names and assigns each a stable, dense id, so per-topic state
+// can live in contiguous vectors indexed by id. Lookups take a string_view
+// and never allocate. Ids are never reused.
+class topic_registry
+{
+  public:
+    topic_registry() = default;
+    topic_registry(topic_registry const& other);
+    topic_registry& operator=(topic_registry const&) = delete;
+
+    [[nodiscard]] std::optional<topic_id> find(std::string_view topic) const;
+    topic_id intern(std::string_view topic);
+
+    [[nodiscard]] std::string_view name(topic_id id) const { return *names_[id]; }
+    [[nodiscard]] std::size_t      size()            const { return names_.size(); }
+
+  private:
+    std::unordered_map<std::string, topic_id, string_hash, std::equal_to<>> ids_;
+    std::vector<std::string const*> names_; // keys of ids_, by id
+};
+
+}  // namespace msghublib::detail
@@ -0,0 +1,123 @@
+#include "topictrie.h"
+
+#include <algorithm>
+
+namespace msghublib::detail {
+
+    namespace {
+        // Splits off the first segment of `topic`, leaving the remainder
+        std::string_view next_segment(std::string_view& topic, bool& last)
+        {
+            auto dot = topic.find('.');
+            last = dot == std::string_view::npos;
+
+            auto segment = topic.substr(0, dot);
+            topic.remove_prefix(last ? topic.size() : dot + 1);
+            return segment;
+        }
+    }
+
+    bool topic_trie::is_pattern(std::string_view topic)
+    {
+        bool last = topic.empty();
+        while (!last) {
+            auto segment = next_segment(topic, last);
+            if (segment == "*" || (last && segment == ">"))
+                return true;
+        }
+        return false;
+    }
+
+    void topic_trie::insert(std::string_view pattern, topic_id id)
+    {
+        node* n = &root_;
+        bool last = false;
+        while (!last) {
+            auto segment = next_segment(pattern, last);
+            if (last && segment == ">") {
+                n->rest.push_back(id);
+                break;
+            }
+
+            auto it = std::find_if(n->children.begin(), n->children.end(),
+                                   [&](auto& child) { return child.first == segment; });
+            if (it == n->children.end()) {
+                n->children.emplace_back(segment, node{});
+                it = std::prev(n->children.end());
+            }
+            n = &it->second;
+            if (last)
+                n->here.push_back(id);
+        }
+
+        ids_.insert(std::upper_bound(ids_.begin(), ids_.end(), id), id);
+    }
+
+    void topic_trie::erase(std::string_view pattern, topic_id id)
+    {
+        auto const at = std::lower_bound(ids_.begin(), ids_.end(), id);
+        if (at == ids_.end() || *at != id)
+            return;
+        erase(root_, pattern, id);
+        ids_.erase(at);
+    }
+
+    bool topic_trie::erase(node& n, std::string_view pattern, topic_id id)
+    {
+        bool last = false;
+        auto segment = next_segment(pattern, last);
+        if (last && segment == ">") {
+            std::erase(n.rest, id);
+        } else if (auto it = std::find_if(n.children.begin(), n.children.end(),
+                                          [&](auto& child) { return child.first == segment; });
+                   it != n.children.end()) {
+            auto& child = it->second;
+            if (last)
+                std::erase(child.here, id);
+            bool const emptied = last ? child.here.empty() && child.rest.empty() && child.children.empty()
+                                      : erase(child, pattern, id);
+            if (emptied)
+                n.children.erase(it); // no dead branches
+        }
+        return n.here.empty() && n.rest.empty() && n.children.empty();
+    }
+
+    std::vector<topic_id> topic_trie::match(std::string_view topic) const
+    {
+        std::vector<topic_id> out;
+        if (!empty())
+            match(root_, topic, out);
+
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    void topic_trie::match(std::string_view topic, match_list& out) const
+    {
+        out.clear();
+        if (!empty())
+            match(root_, topic, out);
+
+        std::sort(out.begin(), out.end());
+    }
+
+    template <typename Out>
+    void topic_trie::match(node const& n, std::string_view topic, Out& out) const
+    {
+        // ">" needs at least one more segment, which there always is here
+        out.insert(out.end(), n.rest.begin(), n.rest.end());
+
+        bool last = false;
+        auto segment = next_segment(topic, last);
+
+        for (auto const& [name, child] : n.children) {
+            if (name != segment && name != "*")
+                continue;
+            if (last)
+                out.insert(out.end(), child.here.begin(), child.here.end());
+            else
+                match(child, topic, out);
+        }
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "topicregistry.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+
+namespace msghublib::detail {
+
+// Wildcard subscriptions, by topic segment. Segments are separated by '.';
+// a "*" segment matches exactly one segment, a trailing ">" segment one or
+// more. Only the patterns live here, exact topics are looked up in the
+// topic_registry, so matching costs in the order of the topic's depth
+// regardless of the number of subscriptions.
+class topic_trie
+{
+  public:
+    [[nodiscard]] static bool is_pattern(std::string_view topic);
+
+    void insert(std::string_view pattern, topic_id id);
+    void erase(std::string_view pattern, topic_id id);
+
+    // Ids of all patterns matching `topic`, in ascending order
+    [[nodiscard]] std::vector<topic_id> match(std::string_view topic) const;
+    // Likewise into `out`, which holds a few without allocating: for
+    // matching on every publication
+    using match_list = boost::container::small_vector<topic_id, 8>;
+    void match(std::string_view topic, match_list& out) const;
+
+    [[nodiscard]] bool empty() const { return ids_.empty(); }
+    [[nodiscard]] bool contains(topic_id id) const {
+        return std::binary_search(ids_.begin(), ids_.end(), id);
+    }
+    [[nodiscard]] bool operator==(topic_trie const& other) const { return ids_ == other.ids_; }
+
+  private:
+    struct node {
+        std::vector<std::pair<std::string, node>> children; // few, by segment
+        std::vector<topic_id> here;  // patterns ending at this node
+        std::vector<topic_id> rest;  // patterns ending in ">" below it
+    };
+
+    template <typename Out> void match(node const& n, std::string_view rest, Out& out) const;
+    // Returns whether `n` is left empty
+    static bool erase(node& n, std::string_view rest, topic_id id);
+
+    node root_;
+    std::vector<topic_id> ids_; // sorted
+};
+
+}  // namespace msghublib::detail
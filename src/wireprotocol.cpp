@@ -0,0 +1,446 @@
+#include "wireprotocol.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace msghublib::detail {
+
+    namespace {
+        // Bounds-checked cursor over a received frame
+        struct cursor {
+            char const* p;
+            char const* end;
+            bool incomplete = false;
+            bool bad        = false;
+
+            [[nodiscard]] bool ok() const { return !incomplete && !bad; }
+
+            std::uint8_t byte() {
+                if (p == end) {
+                    incomplete = true;
+                    return 0;
+                }
+                return static_cast<std::uint8_t>(*p++);
+            }
+
+            std::uint32_t varint() {
+                std::uint32_t value = 0;
+                for (std::size_t i = 0; i < wire::max_varint && ok(); ++i) {
+                    auto b = byte();
+                    value |= std::uint32_t(b & 0x7F) << (7 * i);
+                    if (!(b & 0x80))
+                        return value;
+                }
+                bad = bad || ok(); // overlong
+                return 0;
+            }
+
+            std::string_view bytes(std::size_t n) {
+                if (static_cast<std::size_t>(end - p) < n) {
+                    incomplete = true;
+                    return {};
+                }
+                std::string_view result(p, n);
+                p += n;
+                return result;
+            }
+        };
+    }
+
+    void wire::put_varint(std::vector<char>& out, std::uint32_t value)
+    {
+        do {
+            std::uint8_t b = value & 0x7F;
+            value >>= 7;
+            out.push_back(static_cast<char>(value ? b | 0x80 : b));
+        } while (value);
+    }
+
+    hubmessage wire::hello(unsigned version, bool with_credit, bool with_trace)
+    {
+        char const body[] = { static_cast<char>(version), with_credit, with_trace };
+        return { hubmessage::action::hello, {},
+                 span<char const>(body, with_trace ? 3 : with_credit ? 2 : 1) };
+    }
+
+    unsigned wire::hello_version(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        return body.size() ? static_cast<std::uint8_t>(body[0]) : 1;
+    }
+
+    bool wire::hello_credit(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        return body.size() > 1 && body[1];
+    }
+
+    bool wire::hello_trace(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        return body.size() > 2 && body[2];
+    }
+
+    namespace {
+        enum : std::uint8_t { conflated = 0x01, replay_sequence = 0x02, replay_time = 0x04 };
+    }
+
+    hubmessage wire::subscribe(std::string_view topic, subscription const& options)
+    {
+        std::vector<char> body;
+        if (options.conflation || options.replay) {
+            std::uint8_t flags = options.conflation ? conflated : 0;
+            if (options.replay)
+                flags |= options.replay->kind == log_position::by::time ? replay_time : replay_sequence;
+            body.push_back(static_cast<char>(flags));
+        }
+        if (options.conflation)
+            put_varint(body, static_cast<std::uint32_t>(options.conflation->count()));
+        if (options.replay) {
+            char position[sizeof(std::uint64_t)];
+            std::memcpy(position, &options.replay->value, sizeof(position));
+            body.insert(body.end(), std::begin(position), std::end(position));
+        }
+        return { hubmessage::action::subscribe, topic, span<char const>(body.data(), body.size()) };
+    }
+
+    wire::subscription wire::subscription_of(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        cursor in{body.data(), body.data() + body.size()};
+        if (body.empty())
+            return {};
+
+        subscription result;
+        auto const flags = in.byte();
+        if (flags & conflated) {
+            auto const ms = in.varint();
+            if (in.ok())
+                result.conflation = std::chrono::milliseconds(ms);
+        }
+        if (flags & (replay_sequence | replay_time)) {
+            auto const position = in.bytes(sizeof(std::uint64_t));
+            if (in.ok()) {
+                log_position from;
+                from.kind = flags & replay_time ? log_position::by::time : log_position::by::sequence;
+                std::memcpy(&from.value, position.data(), sizeof(from.value));
+                result.replay = from;
+            }
+        }
+        return result;
+    }
+
+    hubmessage wire::credit(std::uint32_t n)
+    {
+        std::vector<char> body;
+        put_varint(body, n);
+        return { hubmessage::action::credit, {}, span<char const>(body.data(), body.size()) };
+    }
+
+    std::uint32_t wire::credit_amount(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        cursor in{body.data(), body.data() + body.size()};
+        auto const n = in.varint();
+        return in.ok() ? n : 0;
+    }
+
+    hubmessage wire::transport(std::uint32_t ring_size)
+    {
+        std::vector<char> body;
+        put_varint(body, ring_size);
+        return { hubmessage::action::transport, {}, span<char const>(body.data(), body.size()) };
+    }
+
+    std::uint32_t wire::transport_ring_size(hubmessage const& msg)
+    {
+        auto body = msg.body();
+        cursor in{body.data(), body.data() + body.size()};
+        auto const n = in.varint();
+        return in.ok() ? n : 0;
+    }
+
+    wire::batch_writer::batch_writer()
+    {
+        body_.resize(sizeof(count_));
+    }
+
+    bool wire::batch_writer::add(std::string_view topic, span<char const> body)
+    {
+        auto const mark = body_.size();
+
+        auto known = std::find(topics_.begin(), topics_.end(), topic);
+        if (known != topics_.end()) {
+            put_varint(body_, static_cast<std::uint32_t>(known - topics_.begin()) + 1);
+        } else {
+            put_varint(body_, 0);
+            put_varint(body_, topic.size());
+            body_.insert(body_.end(), topic.begin(), topic.end());
+        }
+        put_varint(body_, body.size());
+        body_.insert(body_.end(), body.begin(), body.end());
+
+        if (body_.size() > std::size_t(hubmessage::messagesize) - hubmessage::headersize) {
+            body_.resize(mark);
+            return false;
+        }
+
+        if (known == topics_.end())
+            topics_.push_back(topic);
+        ++count_;
+        return true;
+    }
+
+    hubmessage wire::batch_writer::take()
+    {
+        std::memcpy(body_.data(), &count_, sizeof(count_));
+        hubmessage frame(hubmessage::action::batch, {},
+                         span<char const>(body_.data(), body_.size()));
+
+        body_.resize(sizeof(count_));
+        count_ = 0;
+        topics_.clear();
+        return frame;
+    }
+
+    bool wire::read_batch(hubmessage const& msg, batch& out)
+    {
+        out.topics.clear();
+        out.entries.clear();
+        out.stamps = msg.stamps();
+
+        auto const body = msg.body();
+        cursor in{body.data(), body.data() + body.size()};
+        auto const count = batch_size(msg);
+        in.bytes(sizeof(std::uint16_t));
+
+        for (std::uint32_t i = 0; i < count && in.ok(); ++i) {
+            auto index = in.varint();
+            if (!index) {
+                auto const topiclen = in.varint();
+                out.topics.push_back(in.bytes(topiclen));
+                index = out.topics.size();
+            } else if (index > out.topics.size()) {
+                return false;
+            }
+
+            auto const bodylen = in.varint();
+            auto const payload = in.bytes(bodylen);
+            out.entries.emplace_back(index - 1, span<char const>(payload.data(), payload.size()));
+        }
+        return in.ok() && in.p == in.end;
+    }
+
+    std::uint32_t wire::batch_size(hubmessage const& msg)
+    {
+        std::uint16_t count = 0;
+        if (auto body = msg.body(); body.size() >= sizeof(count))
+            std::memcpy(&count, body.data(), sizeof(count));
+        return count;
+    }
+
+    hubmessage wire::fragment(large_message const& msg, std::size_t& offset)
+    {
+        bool const first = !offset;
+        std::string_view const topic = first ? std::string_view(msg.topic) : std::string_view();
+
+        std::vector<char> body;
+        if (first)
+            put_varint(body, msg.body.size());
+
+        std::size_t const room = std::size_t(hubmessage::messagesize) - hubmessage::headersize -
+            topic.size() - body.size();
+        std::size_t const n = std::min(room, msg.body.size() - offset);
+        body.insert(body.end(), msg.body.begin() + offset, msg.body.begin() + offset + n);
+        offset += n;
+
+        hubmessage frame(first ? hubmessage::action::fragment_begin : hubmessage::action::fragment,
+                         topic, span<char const>(body.data(), body.size()));
+        if (first && msg.topic_id)
+            frame.set_topic_id(*msg.topic_id);
+        return frame;
+    }
+
+    bool wire::reassembler::add(hubmessage const& frame)
+    {
+        auto const body = frame.body();
+
+        if (frame.get_action() == hubmessage::action::fragment_begin) {
+            if (current_)
+                return false; // the previous one is incomplete
+
+            cursor in{body.data(), body.data() + body.size()};
+            total_ = in.varint();
+            if (!in.ok() || total_ > limit_)
+                return false;
+
+            current_ = std::make_shared<large_message>();
+            current_->topic = frame.topic();
+            keep_     = true;
+            received_ = 0;
+            chunk_    = span<char const>(in.p, in.end - in.p);
+        } else {
+            if (!current_)
+                return false;
+            chunk_ = body;
+        }
+
+        if (chunk_.size() > total_ - received_)
+            return false;
+
+        received_ += chunk_.size();
+        if (keep_) {
+            // the total is the peer's word: memory grows with what arrives
+            auto& kept = current_->body;
+            if (kept.capacity() == 0)
+                kept.reserve(std::min(total_, initial_reserve));
+            kept.insert(kept.end(), chunk_.begin(), chunk_.end());
+        }
+        return true;
+    }
+
+    std::shared_ptr<large_message> wire::reassembler::take()
+    {
+        total_ = received_ = 0;
+        return std::move(current_);
+    }
+
+    span<char const> frame_encoder::encode(hubmessage const& msg, std::vector<char>& out)
+    {
+        // hello is always sent in version 1 framing, it negotiates the rest
+        if (version_ < 2 || msg.get_action() == hubmessage::action::hello) {
+            auto [header, payload] = msg.on_the_wire();
+            auto const* h = static_cast<char const*>(header.data());
+            out.insert(out.end(), h, h + header.size());
+            return {static_cast<char const*>(payload.data()), payload.size()};
+        }
+
+        bool define = false;
+        std::uint32_t const a = alias(msg, define);
+        auto const topic = msg.topic();
+        auto const body  = msg.body();
+        bool const trace = tracing_ && msg.stamps() && msg.publication();
+
+        std::uint16_t const magic = hubmessage::cookie_v2;
+        auto const* m = reinterpret_cast<char const*>(&magic);
+        out.insert(out.end(), m, m + sizeof(magic));
+        out.push_back(static_cast<char>(msg.get_action() | (define ? wire::define_topic : 0) |
+                                        (trace ? wire::traced : 0)));
+        wire::put_varint(out, a);
+        wire::put_varint(out, body.size());
+        if (define) {
+            wire::put_varint(out, topic.size());
+            out.insert(out.end(), topic.begin(), topic.end());
+        }
+        if (trace) {
+            std::uint64_t const stamps[] = {msg.stamps()->published, msg.stamps()->hub_received,
+                                            hubmessage::monotonic_ns()};
+            auto const* p = reinterpret_cast<char const*>(stamps);
+            out.insert(out.end(), p, p + sizeof(stamps));
+        }
+        return body;
+    }
+
+    std::uint32_t frame_encoder::alias(hubmessage const& msg, bool& define)
+    {
+        auto const topic = msg.topic();
+        define = false;
+        if (topic.empty())
+            return 0;
+        bool const room = next_alias_ < wire::max_alias && alias_bytes_ + topic.size() <= max_alias_bytes_;
+
+        switch (mode_) {
+        case aliasing::by_topic_id:
+            if (auto id = msg.topic_id()) {
+                if (auto it = aliases_.find(*id); it != aliases_.end())
+                    return it->second;
+                if (room) {
+                    define = true;
+                    alias_bytes_ += topic.size();
+                    return aliases_.emplace(*id, next_alias_++).first->second;
+                }
+            }
+            break;
+        case aliasing::by_name:
+            if (auto it = names_.find(topic); it != names_.end())
+                return it->second;
+            if (room) {
+                define = true;
+                alias_bytes_ += topic.size();
+                return names_.emplace(topic, next_alias_++).first->second;
+            }
+            break;
+        }
+
+        define = true; // one-off literal
+        return 0;
+    }
+
+    std::size_t frame_decoder::decode(span<char const> wire, hubmessage& msg)
+    {
+        std::uint16_t magic = 0;
+        if (wire.size() < sizeof(magic))
+            return 0;
+
+        std::memcpy(&magic, wire.data(), sizeof(magic));
+        if (magic == hubmessage::cookie_v2)
+            return decode_v2(wire, msg);
+
+        auto n = msg.decode(wire);
+        return (n && !msg.verify()) ? corrupt : n;
+    }
+
+    std::size_t frame_decoder::decode_v2(span<char const> wire, hubmessage& msg)
+    {
+        cursor in{wire.data() + sizeof(std::uint16_t), wire.data() + wire.size()};
+
+        auto const flags    = in.byte();
+        auto const alias    = in.varint();
+        auto const bodylen  = in.varint();
+        bool const define   = flags & wire::define_topic;
+        auto const topiclen = define ? in.varint() : 0;
+        bool const traced   = flags & wire::traced;
+
+        // reject oversized frames before waiting for their bytes, and
+        // frames of no action we know
+        if (in.bad || (flags & wire::action_mask) > wire::max_action ||
+            std::size_t(topiclen) + bodylen >
+                          std::size_t(hubmessage::messagesize) - hubmessage::headersize)
+            return corrupt;
+
+        auto topic = in.bytes(topiclen);
+        auto const trace = in.bytes(traced ? wire::trace_size : 0);
+        auto const body = in.bytes(bodylen);
+
+        if (!in.ok())
+            return 0;
+
+        if (define && alias) {
+            // redefines a known alias, or defines the next one
+            if (alias >= wire::max_alias || alias > aliases_.size())
+                return corrupt;
+            if (alias == aliases_.size())
+                aliases_.emplace_back();
+            auto& slot = aliases_[alias];
+            // nor may what they stand for add up to more than allowed
+            alias_bytes_ += topic.size() - (slot ? slot->size() : 0);
+            if (alias_bytes_ > max_alias_bytes_)
+                return corrupt;
+            slot.emplace(topic);
+        } else if (!define) {
+            if (alias >= aliases_.size() || !aliases_[alias])
+                return corrupt;
+            topic = *aliases_[alias];
+        }
+
+        msg.assign(static_cast<hubmessage::action>(flags & wire::action_mask), topic,
+                   span<char const>(body.data(), body.size()));
+        if (traced) {
+            std::uint64_t sent[3];
+            std::memcpy(sent, trace.data(), wire::trace_size);
+            msg.set_stamps({sent[0], sent[1], sent[2], hubmessage::monotonic_ns()});
+        }
+        return in.p - wire.data();
+    }
+
+}  // namespace msghublib::detail
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "hubmessage.h"
+#include "topicregistry.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace msghublib::detail {
+
+// Version 2 framing replaces the topic string by a small alias:
+//
+//   uint16  magic      hubmessage::cookie_v2
+//   uint8   action     low nibble: hubmessage::action, high bits: flags
+//   varint  alias      topic alias, 0 stands for the empty topic
+//   varint  bodylen
+//   [varint topiclen, topic bytes]     only with flag define_topic
+//   [uint64 published, hub_received,   only with flag traced
+//    uint64 sent]
+//   body
+//
+// A frame with define_topic binds its alias to the topic for all later
+// frames in the same direction of the connection; alias 0 with define_topic
+// carries a one-off literal topic. Aliases are chosen by the sender, densely:
+// a new alias is the next after those defined so far, so that a peer can't
+// make the receiver keep more aliases than it sent topics. Neither may the
+// topics it keeps aliases for add up to more than hub_options::
+// max_alias_bytes; a sender past that limit sends literal topics instead.
+//
+// Publications are traced on connections that negotiated it: the sender
+// stamps the time of writing as `sent`, and passes on the others (see
+// hubmessage::timestamps). Stamps are in nanoseconds of CLOCK_MONOTONIC.
+//
+// Version 1 frames remain valid at any time (they cannot start with the v2
+// magic, as that would exceed messagesize), so each side switches its
+// outgoing framing once the hello exchange showed the peer speaks v2.
+
+// Where a replay of a topic's log starts: at the first publication with
+// at least this sequence number (a topic's publications count from 0), or
+// served at least at this time, in nanoseconds since the system clock's
+// epoch
+struct log_position {
+    enum class by : std::uint8_t { sequence, time };
+    by            kind  = by::sequence;
+    std::uint64_t value = 0;
+};
+
+namespace wire {
+    enum : std::uint8_t { action_mask = 0x0F, traced = 0x40, define_topic = 0x80 };
+
+    constexpr std::size_t   max_varint = 5;
+    constexpr std::size_t   trace_size = 3 * sizeof(std::uint64_t);
+    constexpr std::size_t   max_header = 2 + 1 + 3 * max_varint + trace_size;
+    constexpr std::uint32_t max_alias  = 1u << 20;
+    constexpr std::uint8_t  max_action = hubmessage::action::transport;
+
+    void put_varint(std::vector<char>& out, std::uint32_t value);
+
+    // The hello exchange: a client offers the highest version it speaks
+    // right after connecting, the hub answers with the version both sides
+    // will use. Peers that predate it ignore the hello and stay at 1.
+    //
+    // A client may also ask for publish credit; the hub confirms it in its
+    // answer and from then on grants credit for the publications it read.
+    // Likewise for tracing publications, which both sides must want.
+    hubmessage hello(unsigned version, bool with_credit = false, bool with_trace = false);
+    unsigned   hello_version(hubmessage const& msg);
+    bool       hello_credit(hubmessage const& msg);
+    bool       hello_trace(hubmessage const& msg);
+
+    // A subscription, from a client to the hub. Its body, if any, is a
+    // uint8 of flags, followed by what they ask for:
+    //
+    //   [varint min_interval]   only with flag conflated, in milliseconds
+    //                           (see msghub::subscribe_conflated)
+    //   [uint64 position]       only with flag replay_sequence or
+    //                           replay_time (see msghub::subscribe_from)
+    //
+    // Hubs that predate either ignore the body.
+    struct subscription {
+        std::optional<std::chrono::milliseconds> conflation;
+        std::optional<log_position>              replay;
+    };
+    hubmessage   subscribe(std::string_view topic, subscription const& options = {});
+    subscription subscription_of(hubmessage const& msg);
+
+    // Grants the client `n` more publications (hub to client only)
+    hubmessage    credit(std::uint32_t n);
+    std::uint32_t credit_amount(hubmessage const& msg);
+
+    // Moves a connection from a Unix domain socket onto a shm_stream with
+    // rings of `ring_size` bytes. A client on the same host sends it as its
+    // first frame, along with the descriptors of the stream; all further
+    // frames in both directions use the stream.
+    hubmessage    transport(std::uint32_t ring_size);
+    std::uint32_t transport_ring_size(hubmessage const& msg);
+
+    // Several publications in one frame, from a client to a version 2 hub.
+    // The body is a uint16 count followed by that many entries:
+    //
+    //   varint  topic      1-based index of a topic earlier in this frame,
+    //                      or 0 for a new one:
+    //   [varint topiclen, topic bytes]
+    //   varint  bodylen
+    //   body
+    class batch_writer
+    {
+      public:
+        batch_writer();
+
+        // Adds a publication, unless the frame is too full to hold it. The
+        // topic is referred to until take().
+        [[nodiscard]] bool add(std::string_view topic, span<char const> body);
+        [[nodiscard]] std::size_t size()  const { return count_; }
+        [[nodiscard]] bool        empty() const { return !count_; }
+
+        // Returns the frame and starts a new one
+        hubmessage take();
+
+      private:
+        std::vector<char>             body_;
+        std::uint16_t                 count_ = 0;
+        std::vector<std::string_view> topics_; // distinct, in order of appearance
+    };
+
+    struct batch {
+        std::vector<std::string_view>                            topics;
+        std::vector<std::pair<std::uint32_t, span<char const>>> entries; // topic index, body
+        std::optional<hubmessage::timestamps>                    stamps;  // of them all
+    };
+
+    // Views into `msg`, false if it is malformed
+    bool          read_batch(hubmessage const& msg, batch& out);
+    std::uint32_t batch_size(hubmessage const& msg);
+
+    // Publications too large for one frame travel as a fragment_begin frame
+    // with the topic, its body holding `varint total` and the first chunk,
+    // followed by fragment frames with the next chunks (version 2 only).
+    // The fragments of one publication go back to back with respect to other
+    // large ones, but other frames may come in between.
+    //
+    // Returns the fragment at `offset`, advancing it past the chunk
+    hubmessage fragment(large_message const& msg, std::size_t& offset);
+
+    // Longest topic of a large publication: its fragment_begin frame holds
+    // the topic, the total as a varint and at least a byte of the body
+    constexpr std::size_t max_fragment_topic =
+        std::size_t(hubmessage::messagesize) - hubmessage::headersize - max_varint - 1;
+
+    // Reassembles the large publications arriving on a connection
+    class reassembler
+    {
+      public:
+        explicit reassembler(std::size_t limit) : limit_(limit) {}
+
+        // Takes the next fragment frame. Returns false if it doesn't continue
+        // the publication being reassembled, or exceeds the limit.
+        [[nodiscard]] bool add(hubmessage const& frame);
+
+        [[nodiscard]] std::string_view topic()    const { return current_->topic; }
+        [[nodiscard]] std::size_t      total()    const { return total_; }
+        [[nodiscard]] std::size_t      offset()   const { return received_ - chunk_.size(); }
+        [[nodiscard]] bool             complete() const { return current_ && received_ == total_; }
+        // The chunk of the last fragment, valid as long as that frame
+        [[nodiscard]] span<char const> chunk()    const { return chunk_; }
+
+        // Stops collecting the body, for receivers that only stream
+        void drop_body() { keep_ = false; current_->body = {}; }
+        [[nodiscard]] bool keeps_body() const { return keep_; }
+        // The complete publication, resetting for the next
+        std::shared_ptr<large_message> take();
+
+      private:
+        static constexpr std::size_t initial_reserve = 8 * std::size_t(hubmessage::messagesize);
+
+        std::size_t                    limit_;
+        std::shared_ptr<large_message> current_;
+        std::size_t                    total_ = 0, received_ = 0;
+        bool                           keep_ = true;
+        span<char const>               chunk_;
+    };
+
+    // Number of publications in a frame
+    inline std::uint32_t publications(hubmessage const& msg) {
+        switch (msg.get_action()) {
+            case hubmessage::action::publish: return 1;
+            case hubmessage::action::batch:   return batch_size(msg);
+            default:                          return 0;
+        }
+    }
+}
+
+class frame_encoder
+{
+  public:
+    enum class aliasing {
+        by_name,     // aliases assigned per connection, in order of first use
+        by_topic_id, // aliases looked up by hubmessage::topic_id (hub side)
+    };
+
+    frame_encoder(aliasing mode, std::size_t max_alias_bytes)
+        : mode_(mode), max_alias_bytes_(max_alias_bytes) {}
+
+    void set_version(unsigned v) { version_ = v; }
+    [[nodiscard]] unsigned version() const { return version_; }
+    // Whether to pass on the stamps of traced publications (version 2 only)
+    void set_tracing(bool on) { tracing_ = on; }
+
+    // Appends the encoded frame for `msg` to `out`, except for a trailing
+    // part which is returned instead so that large payloads can be written
+    // from where they are.
+    span<char const> encode(hubmessage const& msg, std::vector<char>& out);
+
+  private:
+    // Returns the alias for the topic of `msg`, and whether the frame
+    // must define it
+    std::uint32_t alias(hubmessage const& msg, bool& define);
+
+    aliasing    mode_;
+    std::size_t max_alias_bytes_;
+    std::size_t alias_bytes_ = 0; // of the topics defined so far
+    unsigned    version_     = 1;
+    bool        tracing_     = false;
+    std::unordered_map<std::string, std::uint32_t, string_hash, std::equal_to<>> names_;
+    // by topic id, for the topics sent only: ids are hub wide
+    std::unordered_map<topic_id, std::uint32_t> aliases_;
+    std::uint32_t                               next_alias_ = 1;
+};
+
+class frame_decoder
+{
+  public:
+    static constexpr std::size_t corrupt = static_cast<std::size_t>(-1);
+
+    explicit frame_decoder(std::size_t max_alias_bytes) : max_alias_bytes_(max_alias_bytes) {}
+
+    // Decodes one frame of either version from the front of `wire` into
+    // `msg`. Returns the number of bytes consumed, 0 if `wire` doesn't hold
+    // a complete frame yet, or `corrupt`.
+    std::size_t decode(span<char const> wire, hubmessage& msg);
+
+  private:
+    std::size_t decode_v2(span<char const> wire, hubmessage& msg);
+
+    std::vector<std::optional<std::string>> aliases_{std::string()};
+    std::size_t                             max_alias_bytes_;
+    std::size_t                             alias_bytes_ = 0; // of the topics in aliases_
+};
+
+}  // namespace msghublib::detail
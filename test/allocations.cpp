@@ -0,0 +1,105 @@
+// Built as its own executable: it replaces the global allocation functions
+#define BOOST_TEST_MODULE msghub_allocations
+
+#include "msghub.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+// Counts heap allocations by all threads while enabled
+namespace {
+    std::atomic_bool     counting{false};
+    std::atomic<long>    allocations{0};
+
+    void* allocate(std::size_t size) {
+        if (counting.load(std::memory_order_relaxed))
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        if (void* p = std::malloc(size ? size : 1))
+            return p;
+        throw std::bad_alloc();
+    }
+}
+
+// every replaceable form the program might pair, so that new and delete match
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    try { return allocate(size); } catch (std::bad_alloc const&) { return nullptr; }
+}
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    try { return allocate(size); } catch (std::bad_alloc const&) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { std::free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { std::free(p); }
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+// Once warmed up, publishing from a client through the hub to another
+// client doesn't allocate, bodies beyond the inline capacity included
+BOOST_AUTO_TEST_CASE(test_steady_state_allocations)
+{
+    boost::asio::thread_pool io(1);
+
+    constexpr int rounds = 20, burst = 50;
+    std::string const body(1000, '*');
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int received = 0;
+
+    msghublib::msghub hub(io.get_executor()), subscriber(io.get_executor()), publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("steady", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++received;
+        cv.notify_all();
+    }));
+    std::this_thread::sleep_for(100ms); // subscription
+
+    auto run = [&](int n) {
+        for (int r = 0; r < n; ++r) {
+            for (int i = 0; i < burst; ++i)
+                publisher.publish("steady", body);
+
+            std::unique_lock lk(mx);
+            BOOST_REQUIRE(cv.wait_for(lk, 5s, [&] { return received == burst; }));
+            received = 0;
+        }
+    };
+
+    run(rounds); // warm up
+
+    counting = true;
+    run(rounds);
+    counting = false;
+
+    BOOST_TEST_MESSAGE(allocations << " allocations for " << rounds * burst << " messages");
+    BOOST_CHECK_EQUAL(allocations.load(), 0);
+
+    subscriber.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+    namespace asio = boost::asio;
+}
+
+// Pipelines subscriptions from a coroutine, without blocking the io thread
+BOOST_AUTO_TEST_CASE(test_async_coroutine)
+{
+    asio::thread_pool io(1);
+
+    constexpr int ntopics = 50;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    msghublib::msghub client(io.get_executor());
+    std::promise<int> done;
+    int received = 0; // outlives the coroutine, unlike the deliveries
+
+    co_spawn(
+        io,
+        [&]() -> asio::awaitable<void> {
+            co_await client.async_connect("localhost", 0xBEE, asio::use_awaitable);
+
+            for (int i = 0; i < ntopics; ++i) {
+                co_await client.async_subscribe(
+                    "topic" + std::to_string(i),
+                    [&](std::string_view, msghublib::span<char const>) {
+                        if (++received == ntopics)
+                            done.set_value(received);
+                    },
+                    asio::use_awaitable);
+            }
+            co_await client.async_unsubscribe("topic0", asio::use_awaitable);
+            co_await client.async_subscribe(
+                "topic0",
+                [&](std::string_view, msghublib::span<char const>) {
+                    if (++received == ntopics)
+                        done.set_value(received);
+                },
+                asio::use_awaitable);
+
+            asio::steady_timer settle(co_await asio::this_coro::executor, 100ms);
+            co_await settle.async_wait(asio::use_awaitable);
+
+            for (int i = 0; i < ntopics; ++i)
+                co_await hub.async_publish("topic" + std::to_string(i), "hello",
+                                           asio::use_awaitable);
+        },
+        asio::detached);
+
+    auto result = done.get_future();
+    BOOST_REQUIRE(result.wait_for(5s) == std::future_status::ready);
+    BOOST_CHECK_EQUAL(result.get(), ntopics);
+
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_async_connect_failure)
+{
+    asio::thread_pool io(1);
+
+    msghublib::msghub client(io.get_executor());
+    auto connected = client.async_connect("localhost", 0xBEF, asio::use_future);
+    BOOST_CHECK_THROW(connected.get(), msghublib::system_error);
+
+    auto subscribed = client.async_subscribe("topic", {}, asio::use_future);
+    BOOST_CHECK_THROW(subscribed.get(), msghublib::system_error);
+
+    client.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+#include "msghub.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    msghublib::hub_options speaking(unsigned version) {
+        msghublib::hub_options options;
+        options.max_protocol_version = version;
+        return options;
+    }
+}
+
+// Batches arrive complete and in order per topic, from the hub itself and
+// from peers of either protocol version; version 2 ones send few frames
+BOOST_AUTO_TEST_CASE(test_publish_batch)
+{
+    boost::asio::thread_pool io(1);
+
+    constexpr int nmessages = 300;
+    char const* const topics[] = { "batch.a", "batch.b", "batch.c" };
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::map<std::string, std::vector<std::string>, std::less<>> received;
+    int total = 0;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("batch.*", [&](std::string_view topic, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        received[std::string(topic)].emplace_back(message.data(), message.size());
+        ++total;
+        cv.notify_all();
+    }));
+
+    msghublib::msghub v1(io.get_executor(), speaking(1)), v2(io.get_executor(), speaking(2));
+    BOOST_CHECK_NO_THROW(v1.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(v2.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms); // negotiation
+
+    std::vector<std::pair<std::string, std::string>> batch;
+    for (int i = 0; i < nmessages; ++i)
+        batch.emplace_back(topics[i % 3], std::to_string(i));
+
+    auto const frames_before = v2.stats().frames_written;
+    int expected = 0;
+    for (auto* publisher : {&hub, &v1, &v2}) {
+        BOOST_CHECK_NO_THROW(publisher->publish_batch(batch));
+
+        std::unique_lock lk(mx);
+        expected += nmessages;
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return total == expected; }));
+    }
+
+    {
+        std::lock_guard lk(mx);
+        for (int t = 0; t < 3; ++t) {
+            auto const& got = received[topics[t]];
+            BOOST_REQUIRE_EQUAL(got.size(), std::size_t(nmessages)); // a third from each
+            for (std::size_t j = 0; j < got.size(); ++j) {
+                int const i = (j % (nmessages / 3)) * 3 + t;
+                BOOST_CHECK_EQUAL(got[j], std::to_string(i));
+            }
+        }
+    }
+
+    auto const frames = v2.stats().frames_written - frames_before;
+    BOOST_TEST_MESSAGE("v2 batch of " << nmessages << " in " << frames << " frames");
+    BOOST_CHECK_LE(frames, 2u);
+
+    v1.stop();
+    v2.stop();
+    hub.stop();
+    io.join();
+}
+
+// Messages too large for a frame go in fragments within a batch, though not
+// in order with the others; a batch
+// with one too large even for that goes not at all
+BOOST_AUTO_TEST_CASE(test_publish_batch_large)
+{
+    boost::asio::thread_pool io(1);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::vector<std::size_t> received; // sizes
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("batch.large", [&](std::string_view, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        received.push_back(message.size());
+        cv.notify_all();
+    }));
+
+    msghublib::msghub v2(io.get_executor(), speaking(2));
+    BOOST_CHECK_NO_THROW(v2.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms); // negotiation
+
+    std::string const small(10, 's'), large(64 * 1024, 'l');
+    constexpr std::size_t frame_size = 8 * 1024; // of the wire protocol
+    std::string const nearly(frame_size - 24, 'n'); // fills a frame, too much for a batch
+    std::vector<std::pair<std::string, std::string>> const batch{
+        {"batch.large", small}, {"batch.large", large}, {"batch.large", nearly}, {"batch.large", small}};
+    std::vector<std::size_t> const sizes{small.size(), large.size(), nearly.size(), small.size()};
+
+    for (auto* publisher : {&hub, &v2}) {
+        BOOST_CHECK_NO_THROW(publisher->publish_batch(batch));
+
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return received.size() == sizes.size(); }));
+        BOOST_CHECK(std::is_permutation(received.begin(), received.end(), sizes.begin(), sizes.end()));
+        received.clear();
+    }
+
+    std::string const long_topic(frame_size, 't');
+    std::vector<std::pair<std::string, std::string>> const refused{
+        {"batch.large", small}, {long_topic, large}};
+    for (auto* publisher : {&hub, &v2}) {
+        boost::system::error_code ec;
+        publisher->publish_batch(refused, ec);
+        BOOST_CHECK(ec == boost::asio::error::message_size);
+    }
+    std::this_thread::sleep_for(100ms);
+    {
+        std::lock_guard lk(mx);
+        BOOST_CHECK(received.empty());
+    }
+
+    v2.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
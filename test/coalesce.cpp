@@ -0,0 +1,64 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+BOOST_AUTO_TEST_CASE(test_write_coalescing)
+{
+    boost::asio::thread_pool io(1);
+
+    constexpr int nmessages = 1000;
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int received = 0;
+    bool in_order = true;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe(
+        "burst", [&](std::string_view, msghublib::span<char const> message) {
+            std::lock_guard lk(mx);
+            in_order = in_order &&
+                std::string_view(message.data(), message.size()) == std::to_string(received);
+            ++received;
+            cv.notify_one();
+        }));
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+
+    // queue the whole burst from one task so writes cannot keep up one-by-one
+    post(io, [&] {
+        for (int i = 0; i < nmessages; ++i)
+            publisher.publish("burst", std::to_string(i));
+    });
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return received == nmessages; }));
+        BOOST_CHECK(in_order);
+    }
+
+    auto stats = publisher.stats();
+    BOOST_TEST_MESSAGE("average batch: " << stats.average_batch());
+    BOOST_CHECK_GE(stats.frames_written, nmessages); // plus protocol negotiation
+    BOOST_CHECK_LT(stats.writes, stats.frames_written);
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,57 @@
+#include "msghub.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+// Publishing from many threads while subscriptions keep changing: readers
+// never block on writers and always see a consistent table
+BOOST_AUTO_TEST_CASE(test_concurrent_subscriptions)
+{
+    boost::asio::thread_pool io(4);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::atomic_int stable = 0;
+    BOOST_CHECK_NO_THROW(hub.subscribe("stable", [&](auto...) { ++stable; }));
+
+    constexpr int npublishers = 4, nmessages = 2'000;
+    std::atomic_bool done = false;
+
+    std::thread churn([&] {
+        for (int i = 0; !done; ++i) {
+            auto topic = "churn" + std::to_string(i % 10);
+            hub.subscribe(topic, [](auto...) {});
+            hub.unsubscribe(topic);
+        }
+    });
+
+    std::vector<std::thread> publishers;
+    for (int p = 0; p < npublishers; ++p) {
+        publishers.emplace_back([&] {
+            for (int i = 0; i < nmessages; ++i) {
+                hub.publish("stable", "tick");
+                hub.publish("churn" + std::to_string(i % 10), "tock");
+            }
+        });
+    }
+
+    for (auto& t : publishers)
+        t.join();
+    done = true;
+    churn.join();
+
+    BOOST_CHECK_EQUAL(stable, npublishers * nmessages);
+
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
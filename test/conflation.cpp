@@ -0,0 +1,127 @@
+#include "msghub.h"
+#include "waiting.h"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    using msghub_test::numbers;
+
+    void check_increasing(std::vector<int> const& v) {
+        for (std::size_t i = 1; i < v.size(); ++i)
+            BOOST_CHECK_LT(v[i - 1], v[i]);
+    }
+}
+
+// A client that doesn't keep up only gets the latest of conflated topics,
+// and everything of the others
+BOOST_AUTO_TEST_CASE(test_conflation)
+{
+    boost::asio::thread_pool io(1), client_io(1);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::promise<void> go;
+    auto               gate = go.get_future().share();
+    numbers            prices, news;
+
+    msghublib::msghub client(client_io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.subscribe_conflated("prices.*", [&](auto, auto body) {
+        gate.wait(); // stalls the client, the hub queues meanwhile
+        prices.add(body);
+    }));
+    BOOST_CHECK_NO_THROW(client.subscribe("news", [&](auto, auto body) { news.add(body); }));
+    std::this_thread::sleep_for(200ms);
+
+    constexpr int n = 5000;
+    std::string const padding(4000, ' ');
+    for (int i = 0; i < n; ++i) {
+        auto const price = std::to_string(i) + padding;
+        BOOST_CHECK_NO_THROW(hub.publish("prices.a", {price.data(), price.size()}));
+        if (i % 50 == 0) {
+            auto const item = std::to_string(i);
+            BOOST_CHECK_NO_THROW(hub.publish("news", {item.data(), item.size()}));
+        }
+    }
+    std::this_thread::sleep_for(100ms);
+    auto const queued = hub.stats();
+    go.set_value();
+
+    auto const got = prices.until(n - 1);
+    BOOST_TEST_MESSAGE("received " << got.size() << " of " << n << ", "
+                                   << queued.frames_conflated << " conflated");
+    BOOST_REQUIRE(!got.empty());
+    BOOST_CHECK_EQUAL(got.back(), n - 1);
+    BOOST_CHECK_LT(got.size(), std::size_t(n) / 2);
+    check_increasing(got);
+    BOOST_CHECK_GT(queued.frames_conflated, 0u);
+
+    auto const items = news.until(n - 50);
+    BOOST_CHECK_EQUAL(items.size(), std::size_t(n) / 50);
+    check_increasing(items);
+
+    client.stop();
+    hub.stop();
+    io.join();
+    client_io.join();
+}
+
+// With a minimum interval, the hub passes on one publication per interval,
+// and the last one in the end
+BOOST_AUTO_TEST_CASE(test_conflation_throttled)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    numbers ticks, all;
+    msghublib::msghub client(io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.subscribe_conflated("tick", [&](auto, auto body) { ticks.add(body); },
+                                                    100ms));
+    msghublib::msghub other(io.get_executor());
+    BOOST_CHECK_NO_THROW(other.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(other.subscribe("tick", [&](auto, auto body) { all.add(body); }));
+    std::this_thread::sleep_for(200ms);
+
+    constexpr int n = 200; // over about a second
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        auto const v = std::to_string(i);
+        BOOST_CHECK_NO_THROW(hub.publish("tick", {v.data(), v.size()}));
+        std::this_thread::sleep_for(5ms);
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const got = ticks.until(n - 1);
+    BOOST_TEST_MESSAGE("received " << got.size() << " of " << n);
+    BOOST_REQUIRE(!got.empty());
+    BOOST_CHECK_EQUAL(got.back(), n - 1);
+    BOOST_CHECK_LE(got.size(), std::size_t(elapsed / 100ms) + 2);
+    BOOST_CHECK_GE(got.size(), 3u);
+    check_increasing(got);
+
+    // others aren't affected
+    BOOST_CHECK_EQUAL(all.until(n - 1).size(), std::size_t(n));
+
+    other.stop();
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
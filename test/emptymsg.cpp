@@ -0,0 +1,61 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+BOOST_AUTO_TEST_CASE(test_emptymsg)
+{
+    boost::asio::thread_pool io(1);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::vector<std::string> received;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe(
+        "empty", [&](std::string_view topic, msghublib::span<char const> message) {
+            std::lock_guard lk(mx);
+            BOOST_CHECK_EQUAL(topic, "empty");
+            received.emplace_back(message.data(), message.size());
+            cv.notify_one();
+        }));
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+
+    // Alternate empty and non-empty bodies, in one burst so that many frames
+    // (some without body bytes) arrive in a single read
+    std::vector<std::string> expected;
+    for (int i = 0; i < 200; ++i)
+        expected.push_back(i % 2 ? std::to_string(i) : "");
+
+    post(io, [&] {
+        for (auto& body : expected)
+            publisher.publish("empty", body);
+    });
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return received.size() == expected.size(); }));
+        BOOST_TEST(received == expected, boost::test_tools::per_element());
+    }
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
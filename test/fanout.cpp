@@ -0,0 +1,64 @@
+#include "msghub.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+BOOST_AUTO_TEST_CASE(test_fanout)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    constexpr int nsubscribers = 5;
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int received = 0;
+
+    std::vector<std::unique_ptr<msghublib::msghub>> subscribers;
+    for (int i = 0; i < nsubscribers; ++i) {
+        auto& sub = *subscribers.emplace_back(
+            std::make_unique<msghublib::msghub>(io.get_executor()));
+
+        BOOST_CHECK_NO_THROW(sub.connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(sub.subscribe(
+            "fanout", [&](std::string_view topic, msghublib::span<char const> message) {
+                std::lock_guard lk(mx);
+                BOOST_CHECK_EQUAL(topic, "fanout");
+                BOOST_CHECK_EQUAL(std::string_view(message.data(), message.size()), "payload");
+                ++received;
+                cv.notify_one();
+            }));
+    }
+
+    // subscriptions travel asynchronously; give the hub a moment to register them
+    std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_NO_THROW(hub.publish("fanout", "payload"));
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 1s, [&] { return received == nsubscribers; }));
+    }
+
+    for (auto& sub : subscribers)
+        sub->stop();
+    hub.stop();
+    io.join();
+
+    BOOST_CHECK_EQUAL(received, nsubscribers);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
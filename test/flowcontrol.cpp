@@ -0,0 +1,237 @@
+#include "msghub.h"
+#include "rawclient.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+    using boost::asio::ip::tcp;
+    using msghub_test::subscribe_without_reading;
+
+    constexpr std::size_t window = 16;
+
+    msghublib::hub_options windowed() {
+        msghublib::hub_options options;
+        options.publish_window = window;
+        return options;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_async_publish_completes)
+{
+    boost::asio::thread_pool io(1);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    msghublib::msghub publisher(io.get_executor(), windowed());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms); // negotiation
+
+    std::vector<std::future<void>> accepted;
+    for (int i = 0; i < 100; ++i)
+        accepted.push_back(publisher.async_publish("topic", "message", boost::asio::use_future));
+
+    for (auto& f : accepted) {
+        BOOST_REQUIRE(f.wait_for(5s) == std::future_status::ready);
+        BOOST_CHECK_NO_THROW(f.get());
+    }
+
+    // the hub itself never waits
+    BOOST_CHECK_NO_THROW(hub.async_publish("topic", "message", boost::asio::use_future).get());
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_async_publish_not_connected)
+{
+    boost::asio::thread_pool io(1);
+    msghublib::msghub hub(io.get_executor());
+
+    std::promise<msghublib::error_code> result;
+    hub.async_publish("topic", "message",
+                      [&](msghublib::error_code ec) { result.set_value(ec); });
+    BOOST_CHECK(result.get_future().get() == msghublib::hub_errc::hub_not_connected);
+
+    hub.stop();
+    io.join();
+}
+
+// The hub withholds credit while a subscriber is congested under
+// block_publisher, so the publisher stalls within its window
+BOOST_AUTO_TEST_CASE(test_publish_credit_throttles)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options blocking;
+    blocking.max_queue_frames = 8;
+    blocking.slow_consumer    = msghublib::slow_consumer_policy::block_publisher;
+
+    msghublib::msghub hub(io.get_executor(), blocking);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    tcp::socket stalled(io);
+    stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    subscribe_without_reading(stalled, "flood");
+
+    msghublib::msghub publisher(io.get_executor(), windowed());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int nmessages = 10'000;
+    std::string const payload(4000, '*');
+    std::atomic_int accepted{0}, failed{0};
+
+    for (int i = 0; i < nmessages; ++i) {
+        publisher.async_publish("flood", payload, [&](msghublib::error_code ec) {
+            ++(ec ? failed : accepted);
+        });
+    }
+    std::this_thread::sleep_for(200ms);
+
+    BOOST_TEST_MESSAGE("accepted while stalled: " << accepted);
+    BOOST_CHECK_LT(accepted, nmessages);
+    BOOST_CHECK_GT(hub.stats().publishers_paused, 0u);
+
+    // once the subscriber is gone the publisher may proceed
+    stalled.close();
+    for (int i = 0; i < 50 && accepted < nmessages; ++i)
+        std::this_thread::sleep_for(100ms);
+
+    BOOST_CHECK_EQUAL(accepted, nmessages);
+    BOOST_CHECK_EQUAL(failed, 0);
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// A batch frame dropped for a publication under drop_oldest takes all of
+// its publications with it, none of which the hub credits
+BOOST_AUTO_TEST_CASE(test_publish_credit_drop_oldest_batch)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options blocking;
+    blocking.max_queue_frames = 8;
+    blocking.slow_consumer    = msghublib::slow_consumer_policy::block_publisher;
+
+    msghublib::msghub hub(io.get_executor(), blocking);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    tcp::socket stalled(io);
+    stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    subscribe_without_reading(stalled, "flood");
+
+    auto dropping = windowed();
+    dropping.publish_window   = 4;
+    dropping.max_queue_frames = 8;
+    dropping.slow_consumer    = msghublib::slow_consumer_policy::drop_oldest;
+    msghublib::msghub publisher(io.get_executor(), dropping);
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+
+    std::string const payload(60, '*');
+    std::vector<msghublib::message_view> const batch(100, {"flood", payload});
+    for (int i = 0; i < 2'000; ++i)
+        publisher.publish_batch(batch);
+
+    constexpr int nmessages = 100;
+    std::atomic_int accepted{0}, failed{0};
+    for (int i = 0; i < nmessages; ++i) {
+        publisher.async_publish("flood", payload, [&](msghublib::error_code ec) {
+            ++(ec ? failed : accepted);
+        });
+    }
+    std::this_thread::sleep_for(200ms);
+    BOOST_TEST_MESSAGE("dropped " << publisher.stats().frames_dropped);
+    BOOST_CHECK_GT(publisher.stats().frames_dropped, 0u);
+
+    stalled.close();
+    for (int i = 0; i < 50 && accepted < nmessages; ++i)
+        std::this_thread::sleep_for(100ms);
+
+    BOOST_CHECK_EQUAL(accepted, nmessages);
+    BOOST_CHECK_EQUAL(failed, 0);
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// Publications a publisher drops from its own queue under drop_oldest are
+// never credited; those after them still complete
+BOOST_AUTO_TEST_CASE(test_publish_credit_drop_oldest_large)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options blocking;
+    blocking.max_queue_frames = 8;
+    blocking.slow_consumer    = msghublib::slow_consumer_policy::block_publisher;
+
+    msghublib::msghub hub(io.get_executor(), blocking);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    // stalls in its first handler, so the hub stops reading the publisher
+    std::mutex mx;
+    std::condition_variable cv;
+    bool released = false;
+    msghublib::msghub subscriber(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("snapshot", [&](std::string_view, msghublib::span<char const>) {
+        std::unique_lock lk(mx);
+        cv.wait(lk, [&] { return released; });
+    }));
+
+    auto dropping = windowed();
+    dropping.publish_window  = 4;
+    dropping.max_queue_bytes = 1024 * 1024;
+    dropping.slow_consumer   = msghublib::slow_consumer_policy::drop_oldest;
+    msghublib::msghub publisher(io.get_executor(), dropping);
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int nmessages = 200;
+    std::string const payload(64 * 1024, '*');
+    std::atomic_int accepted{0}, failed{0};
+    for (int i = 0; i < nmessages; ++i) {
+        publisher.async_publish("snapshot", payload, [&](msghublib::error_code ec) {
+            ++(ec ? failed : accepted);
+        });
+    }
+    std::this_thread::sleep_for(200ms);
+    BOOST_TEST_MESSAGE("dropped " << publisher.stats().frames_dropped);
+    BOOST_CHECK_GT(publisher.stats().frames_dropped, 0u);
+
+    {
+        std::lock_guard lk(mx);
+        released = true;
+    }
+    cv.notify_all();
+    for (int i = 0; i < 50 && accepted < nmessages; ++i)
+        std::this_thread::sleep_for(100ms);
+
+    BOOST_CHECK_EQUAL(accepted, nmessages);
+    BOOST_CHECK_EQUAL(failed, 0);
+
+    subscriber.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
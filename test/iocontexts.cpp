@@ -0,0 +1,188 @@
+#include "msghub.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+    using boost::asio::ip::tcp;
+
+    msghublib::hub_options lanes(std::size_t n) {
+        msghublib::hub_options options;
+        options.io_contexts     = n;
+        options.pin_io_contexts = true;
+        return options;
+    }
+}
+
+// Clients spread over the hub's own io_contexts still reach each other,
+// and the hub's local subscribers
+BOOST_AUTO_TEST_CASE(test_io_contexts)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), lanes(3));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    constexpr int nclients = 12;
+    std::atomic_int received{0}, local{0};
+    BOOST_CHECK_NO_THROW(hub.subscribe("lanes", [&](auto...) { ++local; }));
+
+    std::vector<std::unique_ptr<msghublib::msghub>> clients;
+    for (int c = 0; c < nclients; ++c) {
+        auto& client = *clients.emplace_back(std::make_unique<msghublib::msghub>(io.get_executor()));
+        BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(client.subscribe("lanes", [&](auto...) { ++received; }));
+    }
+    std::this_thread::sleep_for(200ms); // subscriptions
+
+    BOOST_CHECK_NO_THROW(hub.publish("lanes", "from the hub"));
+    BOOST_CHECK_NO_THROW(clients.front()->publish("lanes", "from a client"));
+
+    for (int i = 0; i < 50 && (received < 2 * nclients || local < 1); ++i)
+        std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(received, 2 * nclients);
+    BOOST_CHECK_EQUAL(local, 2);
+
+    for (auto& client : clients)
+        client->stop();
+    hub.stop();
+    io.join();
+}
+
+// stop() hangs up on the lanes' clients; the hub serves again once created
+BOOST_AUTO_TEST_CASE(test_io_contexts_stop)
+{
+    boost::asio::thread_pool io(1);
+
+    msghublib::msghub hub(io.get_executor(), lanes(2));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    tcp::socket client(io);
+    client.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    std::this_thread::sleep_for(100ms);
+    hub.stop();
+
+    timeval const patience{5, 0};
+    ::setsockopt(client.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &patience, sizeof(patience));
+    char byte;
+    boost::system::error_code ec;
+    client.read_some(boost::asio::buffer(&byte, 1), ec);
+    BOOST_CHECK(ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset);
+
+    std::atomic_int received{0};
+    msghublib::msghub again(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(again.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(again.subscribe("lanes", [&](auto...) { ++received; }));
+    std::this_thread::sleep_for(200ms); // subscription
+    BOOST_CHECK_NO_THROW(hub.publish("lanes", "once more"));
+    for (int i = 0; i < 50 && !received; ++i)
+        std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(received, 1);
+
+    again.stop();
+    hub.stop();
+    io.join();
+}
+
+// Clients coming and going in quick succession don't disturb the others
+BOOST_AUTO_TEST_CASE(test_io_contexts_reconnect_storm)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), lanes(2));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::atomic_int received{0};
+    msghublib::msghub steady(io.get_executor());
+    BOOST_CHECK_NO_THROW(steady.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(steady.subscribe("storm", [&](auto...) { ++received; }));
+
+    boost::asio::io_context storm;
+    for (int i = 0; i < 500; ++i) {
+        tcp::socket s(storm);
+        s.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    }
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_NO_THROW(publisher.publish("storm", "still here"));
+
+    for (int i = 0; i < 50 && received < 1; ++i)
+        std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(received, 1);
+
+    publisher.stop();
+    steady.stop();
+    hub.stop();
+    io.join();
+}
+
+// A lane that can't accept for lack of descriptors accepts again once
+// there are some
+BOOST_AUTO_TEST_CASE(test_io_contexts_out_of_descriptors)
+{
+    boost::asio::thread_pool io(1);
+
+    msghublib::msghub hub(io.get_executor(), lanes(2));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    // the clients' descriptors first, then none left for the hub
+    constexpr int nclients = 8;
+    boost::asio::io_context clients_io;
+    std::vector<tcp::socket> clients;
+    for (int i = 0; i < nclients; ++i)
+        clients.emplace_back(clients_io).open(tcp::v4());
+
+    rlimit const before = [] { rlimit l; ::getrlimit(RLIMIT_NOFILE, &l); return l; }();
+    int const probe = ::open("/dev/null", O_RDONLY);
+    ::close(probe);
+    rlimit scarce = before;
+    scarce.rlim_cur = probe + 16;
+    BOOST_REQUIRE_EQUAL(::setrlimit(RLIMIT_NOFILE, &scarce), 0);
+
+    std::vector<int> fillers;
+    for (int fd; (fd = ::open("/dev/null", O_RDONLY)) >= 0;)
+        fillers.push_back(fd);
+
+    for (auto& c : clients)
+        c.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    std::this_thread::sleep_for(300ms);
+    auto const starved = hub.stats();
+
+    for (int fd : fillers)
+        ::close(fd);
+    ::setrlimit(RLIMIT_NOFILE, &before);
+
+    BOOST_TEST_MESSAGE("accept errors: " << starved.accept_errors);
+    BOOST_CHECK_GT(starved.accept_errors, 0u);
+    BOOST_CHECK_LT(starved.connections_accepted, std::uint64_t(nclients));
+
+    for (int i = 0; i < 50 && hub.stats().connections_accepted < nclients; ++i)
+        std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(hub.stats().connections_accepted, std::uint64_t(nclients));
+
+    for (auto& c : clients)
+        c.close();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
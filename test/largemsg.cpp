@@ -0,0 +1,218 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    std::vector<char> snapshot(std::size_t size) {
+        std::vector<char> body(size);
+        for (std::size_t i = 0; i < size; ++i)
+            body[i] = static_cast<char>(i * 7 + i / 251);
+        return body;
+    }
+}
+
+// Messages beyond a frame arrive whole, or piecewise to streaming
+// subscribers, from the hub itself and from a client, along with small ones
+BOOST_AUTO_TEST_CASE(test_large_messages)
+{
+    boost::asio::thread_pool io(2);
+
+    constexpr int nticks = 100;
+    auto const body = snapshot(3 * 1024 * 1024 + 17);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int whole = 0, streamed = 0, ticks = 0;
+    std::vector<char> pieces;
+
+    auto on_whole = [&](std::string_view, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        BOOST_CHECK(std::equal(message.begin(), message.end(), body.begin(), body.end()));
+        ++whole;
+        cv.notify_all();
+    };
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("snapshot", on_whole));
+
+    msghublib::msghub subscriber(io.get_executor()), streamer(io.get_executor()), publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(streamer.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("snapshot", on_whole));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("tick", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++ticks;
+        cv.notify_all();
+    }));
+    BOOST_CHECK_NO_THROW(streamer.subscribe_stream("snapshot",
+        [&](std::string_view, msghublib::span<char const> chunk, std::size_t offset, std::size_t total) {
+            std::lock_guard lk(mx);
+            BOOST_CHECK_EQUAL(total, body.size());
+            BOOST_CHECK_EQUAL(offset, pieces.size());
+            pieces.insert(pieces.end(), chunk.begin(), chunk.end());
+            if (offset + chunk.size() == total)
+                ++streamed;
+            cv.notify_all();
+        }));
+    std::this_thread::sleep_for(100ms); // subscriptions
+
+    for (auto* source : {&hub, &publisher}) {
+        BOOST_CHECK_NO_THROW(source->publish("snapshot", body));
+        for (int i = 0; i < nticks; ++i)
+            BOOST_CHECK_NO_THROW(source->publish("tick", std::to_string(i)));
+
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 10s, [&] { return whole == 2 && streamed == 1 && ticks == nticks; }));
+        BOOST_CHECK(pieces == body);
+        whole = streamed = ticks = 0;
+        pieces.clear();
+    }
+
+    // too large even for fragments, by body or by topic: fails alike
+    // through every overload
+    std::vector<char> const oversized(msghublib::hub_options{}.max_message_size + 1);
+    std::string const long_topic(64 * 1024, 't');
+    for (auto* source : {&hub, &publisher}) {
+        for (auto [topic, message] : {std::pair<std::string_view, msghublib::span<char const>>{"snapshot", oversized},
+                                      {long_topic, body}}) {
+            msghublib::error_code ec;
+            source->publish(topic, message, ec);
+            BOOST_CHECK_EQUAL(ec, boost::asio::error::message_size);
+
+            try {
+                source->publish(topic, message);
+                BOOST_ERROR("published an oversized message");
+            } catch (msghublib::system_error const& se) {
+                BOOST_CHECK_EQUAL(se.code(), boost::asio::error::message_size);
+            }
+
+            auto accepted = source->async_publish(topic, message, boost::asio::use_future);
+            BOOST_REQUIRE(accepted.wait_for(5s) == std::future_status::ready);
+            try {
+                accepted.get();
+                BOOST_ERROR("accepted an oversized message");
+            } catch (msghublib::system_error const& se) {
+                BOOST_CHECK_EQUAL(se.code(), boost::asio::error::message_size);
+            }
+        }
+    }
+
+    subscriber.stop();
+    streamer.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// Peers speaking protocol version 1 can't take large messages
+BOOST_AUTO_TEST_CASE(test_large_message_v1)
+{
+    boost::asio::thread_pool io(1);
+
+    msghublib::hub_options v1;
+    v1.max_protocol_version = 1;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    msghublib::msghub publisher(io.get_executor(), v1);
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+
+    auto const body = snapshot(64 * 1024);
+    auto accepted = publisher.async_publish("snapshot", body, boost::asio::use_future);
+    BOOST_REQUIRE(accepted.wait_for(5s) == std::future_status::ready);
+    BOOST_CHECK_THROW(accepted.get(), msghublib::system_error);
+
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// Large messages count against the subscribers' queue limits
+BOOST_AUTO_TEST_CASE(test_large_message_queue_limits)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options bounded;
+    bounded.max_queue_bytes = 1024 * 1024;
+    bounded.slow_consumer   = msghublib::slow_consumer_policy::drop_newest;
+
+    msghublib::msghub hub(io.get_executor(), bounded);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    // stalls in its first handler, so it stops reading
+    std::mutex mx;
+    std::condition_variable cv;
+    bool released = false;
+    msghublib::msghub subscriber(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("snapshot", [&](std::string_view, msghublib::span<char const>) {
+        std::unique_lock lk(mx);
+        cv.wait(lk, [&] { return released; });
+    }));
+    std::this_thread::sleep_for(100ms);
+
+    auto const body = snapshot(256 * 1024);
+    for (int i = 0; i < 64; ++i)
+        BOOST_CHECK_NO_THROW(hub.publish("snapshot", body));
+    std::this_thread::sleep_for(200ms);
+
+    auto const stats = hub.stats();
+    BOOST_TEST_MESSAGE("dropped " << stats.frames_dropped << " frames");
+    BOOST_CHECK_GT(stats.frames_dropped, 0u);
+
+    {
+        std::lock_guard lk(mx);
+        released = true;
+    }
+    cv.notify_all();
+    subscriber.stop();
+    hub.stop();
+    io.join();
+}
+
+// Large messages wait for the hello, and fail if it's never answered
+BOOST_AUTO_TEST_CASE(test_large_message_hello_timeout)
+{
+    boost::asio::io_context mute;
+    boost::asio::ip::tcp::acceptor acceptor(mute, {boost::asio::ip::address_v4::loopback(), 0xBEE});
+
+    boost::asio::thread_pool io(1);
+    msghublib::hub_options impatient;
+    impatient.hello_timeout = 200ms;
+    msghublib::msghub publisher(io.get_executor(), impatient);
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    auto peer = acceptor.accept();
+
+    auto const body = snapshot(64 * 1024);
+    auto accepted = publisher.async_publish("snapshot", body, boost::asio::use_future);
+    BOOST_REQUIRE(accepted.wait_for(5s) == std::future_status::ready);
+    try {
+        accepted.get();
+        BOOST_ERROR("accepted a large message for a version 1 hub");
+    } catch (msghublib::system_error const& se) {
+        BOOST_CHECK_EQUAL(se.code(), boost::asio::error::message_size);
+    }
+
+    publisher.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
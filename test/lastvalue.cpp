@@ -0,0 +1,182 @@
+#include "msghub.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    // What a subscriber received, in order
+    struct recorder {
+        std::mutex               mx;
+        std::vector<std::string> received;
+
+        msghublib::msghub::onmessage handler() {
+            return [this](std::string_view topic, msghublib::span<char const> body) {
+                std::lock_guard lk(mx);
+                received.push_back(std::string(topic) + "=" + std::string(body.begin(), body.end()));
+            };
+        }
+
+        std::vector<std::string> get() {
+            std::lock_guard lk(mx);
+            return received;
+        }
+    };
+}
+
+// A late subscriber first gets what retained topics kept for it
+BOOST_AUTO_TEST_CASE(test_last_value)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    hub.retain("status");
+    hub.retain("prices.>", 2);
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    for (auto v : {"1", "2", "3"}) {
+        BOOST_CHECK_NO_THROW(publisher.publish("status", msghublib::span<char const>(v, 1)));
+        BOOST_CHECK_NO_THROW(publisher.publish("prices.a", msghublib::span<char const>(v, 1)));
+        BOOST_CHECK_NO_THROW(publisher.publish("other", msghublib::span<char const>(v, 1)));
+    }
+    BOOST_CHECK_NO_THROW(hub.publish("prices.b", "9"));
+    std::this_thread::sleep_for(200ms);
+
+    recorder status, prices;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe("status", status.handler()));
+    BOOST_CHECK_NO_THROW(late.subscribe("prices.*", prices.handler()));
+    BOOST_CHECK_NO_THROW(late.subscribe("other", [](auto...) { BOOST_ERROR("not retained"); }));
+    std::this_thread::sleep_for(200ms);
+
+    BOOST_CHECK(status.get() == std::vector<std::string>{"status=3"});
+    // topics in any order; the values of each happen to sort in order
+    auto replayed = prices.get();
+    std::sort(replayed.begin(), replayed.end());
+    BOOST_CHECK(replayed == (std::vector<std::string>{"prices.a=2", "prices.a=3", "prices.b=9"}));
+
+    // then live
+    BOOST_CHECK_NO_THROW(publisher.publish("status", "4"));
+    std::this_thread::sleep_for(200ms);
+    BOOST_CHECK(status.get() == (std::vector<std::string>{"status=3", "status=4"}));
+
+    // retaining no more
+    hub.retain("status", 0);
+    recorder later;
+    BOOST_CHECK_NO_THROW(late.unsubscribe("status"));
+    BOOST_CHECK_NO_THROW(late.subscribe("status", later.handler()));
+    std::this_thread::sleep_for(200ms);
+    BOOST_CHECK(later.get().empty());
+
+    late.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// Over the memory budget, the topics published to least recently go first
+BOOST_AUTO_TEST_CASE(test_last_value_eviction)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options options;
+    options.retain_bytes = 3 * 100;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    hub.retain("t.>");
+
+    std::string const body(80, 'x');
+    for (int t = 0; t < 10; ++t)
+        BOOST_CHECK_NO_THROW(hub.publish("t." + std::to_string(t), {body.data(), body.size()}));
+
+    std::mutex               mx;
+    std::vector<std::string> topics;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe("t.*", [&](std::string_view topic, auto) {
+        std::lock_guard lk(mx);
+        topics.emplace_back(topic);
+    }));
+    std::this_thread::sleep_for(200ms);
+
+    {
+        std::lock_guard lk(mx);
+        std::sort(topics.begin(), topics.end());
+        BOOST_CHECK(topics == (std::vector<std::string>{"t.7", "t.8", "t.9"}));
+    }
+
+    late.stop();
+    hub.stop();
+    io.join();
+}
+
+// Subscribing while a retained topic is being published to, a subscriber
+// gets every publication from the last one kept on, exactly once
+BOOST_AUTO_TEST_CASE(test_last_value_while_publishing)
+{
+    boost::asio::thread_pool io(4);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    hub.retain("counter");
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(publisher.publish("counter", "0"));
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int n = 5000;
+    std::atomic_bool publishing{true};
+    std::thread feed([&] {
+        for (int i = 1; i <= n; ++i) {
+            auto const v = std::to_string(i);
+            publisher.publish("counter", {v.data(), v.size()});
+        }
+        publishing = false;
+    });
+
+    std::vector<std::unique_ptr<recorder>> recorders;
+    std::vector<std::unique_ptr<msghublib::msghub>> subscribers;
+    while (publishing && subscribers.size() < 8) {
+        auto& r = *recorders.emplace_back(std::make_unique<recorder>());
+        auto& s = *subscribers.emplace_back(std::make_unique<msghublib::msghub>(io.get_executor()));
+        BOOST_CHECK_NO_THROW(s.connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(s.subscribe("counter", r.handler()));
+        std::this_thread::sleep_for(2ms);
+    }
+    feed.join();
+
+    for (auto& r : recorders) {
+        for (int i = 0; i < 50 && (r->get().empty() || r->get().back() != "counter=" + std::to_string(n)); ++i)
+            std::this_thread::sleep_for(100ms);
+
+        auto const got = r->get();
+        BOOST_REQUIRE(!got.empty());
+        auto next = std::stoi(got.front().substr(8));
+        for (auto const& v : got)
+            BOOST_CHECK_EQUAL(v, "counter=" + std::to_string(next++));
+        BOOST_CHECK_EQUAL(next, n + 1);
+    }
+
+    for (auto& s : subscribers)
+        s->stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+#include "msghub.h"
+#include "waiting.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+BOOST_AUTO_TEST_CASE(test_local_fastpath)
+{
+    boost::asio::thread_pool io(1);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int local_received = 0, remote_received = 0;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("local", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++local_received;
+        cv.notify_all();
+    }));
+
+    msghublib::msghub remote(io.get_executor());
+    BOOST_CHECK_NO_THROW(remote.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(remote.subscribe("local", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++remote_received;
+        cv.notify_all();
+    }));
+    std::this_thread::sleep_for(100ms); // let the subscription reach the hub
+
+    // the local subscriber is served before publish returns
+    BOOST_CHECK_NO_THROW(hub.publish("local", "from hub"));
+    {
+        std::lock_guard lk(mx);
+        BOOST_CHECK_EQUAL(local_received, 1);
+    }
+
+    // remote subscribers still get it, and remote publications reach the hub
+    BOOST_CHECK_NO_THROW(remote.publish("local", "from remote"));
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 1s, [&] { return local_received == 2 && remote_received == 2; }));
+    }
+
+    remote.stop();
+    hub.stop();
+    io.join();
+}
+
+// On the hub's instance, a local handler is invoked from publish() and from
+// the threads reading clients at once, and may publish from within
+BOOST_AUTO_TEST_CASE(test_local_concurrent_handlers)
+{
+    boost::asio::thread_pool io(4);
+    constexpr int nclients = 3, nmessages = 200;
+
+    std::atomic_int inflight{0}, overlapped{0}, received{0}, echoed{0};
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("echo", [&](std::string_view, msghublib::span<char const>) {
+        ++echoed;
+    }));
+    BOOST_CHECK_NO_THROW(hub.subscribe("local", [&](std::string_view, msghublib::span<char const> message) {
+        if (inflight++ > 0)
+            ++overlapped;
+        std::this_thread::sleep_for(100us); // widen the window
+        hub.publish("echo", message);
+        --inflight;
+        ++received;
+    }));
+
+    std::vector<std::unique_ptr<msghublib::msghub>> clients;
+    for (int i = 0; i < nclients; ++i) {
+        auto& client = *clients.emplace_back(std::make_unique<msghublib::msghub>(io.get_executor()));
+        BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    }
+
+    std::vector<std::thread> publishers;
+    for (auto& client : clients)
+        publishers.emplace_back([&client = *client] {
+            for (int i = 0; i < nmessages; ++i)
+                client.publish("local", "from a client");
+        });
+    for (int i = 0; i < nmessages; ++i)
+        hub.publish("local", "from the hub");
+    for (auto& t : publishers)
+        t.join();
+
+    constexpr int expected = (nclients + 1) * nmessages;
+    BOOST_CHECK(msghub_test::eventually([&] { return received == expected && echoed == expected; }));
+    BOOST_CHECK_GT(overlapped.load(), 0);
+
+    for (auto& client : clients)
+        client->stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+// Clients on a Unix domain socket and on TCP are served by the same hub
+BOOST_AUTO_TEST_CASE(test_local_sockets)
+{
+    boost::asio::thread_pool io(2);
+
+    auto const path = std::filesystem::temp_directory_path() /
+        ("msghub-test-" + std::to_string(::getpid()) + ".sock");
+    auto const named = "unix:" + path.string();
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int received = 0;
+    auto on_message = [&](std::string_view, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        BOOST_CHECK_EQUAL(std::string(message.begin(), message.end()), "hello");
+        ++received;
+        cv.notify_all();
+    };
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(named));
+    BOOST_CHECK_NO_THROW(hub.create("tcp::" + std::to_string(0xBEE)));
+    BOOST_CHECK_THROW(hub.create("unix:@msghub-test"), msghublib::system_error); // one of each
+    BOOST_CHECK(std::filesystem::is_socket(path));
+
+    msghublib::msghub on_named(io.get_executor()), on_tcp(io.get_executor()),
+        publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(on_named.connect(named));
+    BOOST_CHECK_NO_THROW(on_tcp.connect("tcp:localhost:" + std::to_string(0xBEE)));
+    BOOST_CHECK_NO_THROW(publisher.connect(named));
+
+    for (auto* subscriber : {&hub, &on_named, &on_tcp})
+        BOOST_CHECK_NO_THROW(subscriber->subscribe("local", on_message));
+    std::this_thread::sleep_for(100ms); // subscriptions
+
+    BOOST_CHECK_NO_THROW(publisher.publish("local", "hello"));
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return received == 3; }));
+    }
+
+    for (auto* subscriber : {&on_named, &on_tcp, &publisher})
+        subscriber->stop();
+    hub.stop();
+    io.join();
+    BOOST_CHECK(!std::filesystem::exists(path));
+}
+
+// A hub takes over a socket file left behind, not one a hub serves on
+BOOST_AUTO_TEST_CASE(test_local_socket_in_use)
+{
+    boost::asio::thread_pool io(1);
+
+    auto const path = std::filesystem::temp_directory_path() /
+        ("msghub-test-" + std::to_string(::getpid()) + ".sock");
+    auto const named = "unix:" + path.string();
+    {
+        // gone without removing its file
+        boost::asio::local::stream_protocol::acceptor stale(io, path.string());
+    }
+    BOOST_REQUIRE(std::filesystem::is_socket(path));
+
+    msghublib::msghub hub(io.get_executor()), other(io.get_executor()), client(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(named));
+
+    msghublib::error_code ec;
+    other.create(named, ec);
+    BOOST_CHECK(ec == boost::asio::error::address_in_use);
+    BOOST_CHECK(std::filesystem::is_socket(path));
+    BOOST_CHECK_NO_THROW(client.connect(named)); // still the first hub's
+
+    client.stop();
+    other.stop();
+    hub.stop();
+    io.join();
+    BOOST_CHECK(!std::filesystem::exists(path));
+}
+
+BOOST_AUTO_TEST_CASE(test_abstract_socket)
+{
+    boost::asio::thread_pool io(1);
+    auto const abstract = "unix:@msghub-test-" + std::to_string(::getpid());
+
+    std::promise<std::string> received;
+    msghublib::msghub hub(io.get_executor()), subscriber(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(abstract));
+
+    auto connected = subscriber.async_connect(abstract, boost::asio::use_future);
+    BOOST_REQUIRE(connected.wait_for(5s) == std::future_status::ready);
+    BOOST_CHECK_NO_THROW(connected.get());
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("local", [&](std::string_view, msghublib::span<char const> message) {
+        received.set_value(std::string(message.begin(), message.end()));
+    }));
+    std::this_thread::sleep_for(100ms); // subscription
+
+    BOOST_CHECK_NO_THROW(hub.publish("local", "hello"));
+    auto message = received.get_future();
+    BOOST_REQUIRE(message.wait_for(5s) == std::future_status::ready);
+    BOOST_CHECK_EQUAL(message.get(), "hello");
+
+    subscriber.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_endpoint_uris)
+{
+    boost::asio::io_context io;
+    msghublib::msghub hub(io.get_executor());
+
+    for (auto uri : {"", "unix:", "tcp:localhost", "tcp:localhost:", "tcp:localhost:99999",
+                     "udp:localhost:3000", "/run/msghub.sock"}) {
+        msghublib::error_code ec;
+        hub.connect(uri, ec);
+        BOOST_CHECK_MESSAGE(ec == boost::asio::error::invalid_argument, uri);
+        hub.create(uri, ec);
+        BOOST_CHECK_MESSAGE(ec == boost::asio::error::invalid_argument, uri);
+    }
+    BOOST_CHECK_THROW(hub.connect("unix:"), msghublib::system_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
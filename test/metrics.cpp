@@ -0,0 +1,161 @@
+#include "msghub.h"
+#include "waiting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    using msghub_test::eventually;
+}
+
+// Connections, subscriptions and publications show in the stats, overall
+// and per topic
+BOOST_AUTO_TEST_CASE(test_metrics)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("metrics.local", [](auto...) {}));
+
+    std::atomic_int received{0};
+    {
+        msghublib::msghub client(io.get_executor());
+        BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(client.subscribe("metrics.remote", [&](auto...) { ++received; }));
+        BOOST_CHECK_NO_THROW(client.subscribe("metrics.*", [&](auto...) {}));
+
+        BOOST_CHECK(eventually([&] { return hub.stats().subscriptions == 3; }));
+        auto stats = hub.stats();
+        BOOST_CHECK_EQUAL(stats.connections_accepted, 1u);
+        BOOST_CHECK_EQUAL(stats.connections_open, 1u);
+        BOOST_CHECK_EQUAL(stats.topics, 3u);
+
+        for (int i = 0; i < 10; ++i)
+            BOOST_CHECK_NO_THROW(client.publish("metrics.remote", "twelve bytes"));
+        BOOST_CHECK_NO_THROW(hub.publish("metrics.local", "hello"));
+        BOOST_CHECK_NO_THROW(hub.publish("nobody.listens", "hello"));
+
+        BOOST_CHECK(eventually([&] { return received == 10; }));
+        stats = hub.stats();
+        BOOST_CHECK_EQUAL(stats.publications_in, 12u);
+        BOOST_CHECK_EQUAL(stats.bytes_in, 130u);
+        BOOST_CHECK_GE(stats.frames_queued + stats.frames_written, 10u);
+
+        auto const topics = hub.stats_by_topic();
+        auto const remote = std::find_if(topics.begin(), topics.end(),
+                                         [](auto const& t) { return t.topic == "metrics.remote"; });
+        BOOST_REQUIRE(remote != topics.end());
+        BOOST_CHECK_EQUAL(remote->publications, 10u);
+        BOOST_CHECK_EQUAL(remote->bytes, 120u);
+        BOOST_CHECK_EQUAL(remote->subscribers, 1u);
+        BOOST_CHECK(std::none_of(topics.begin(), topics.end(),
+                                 [](auto const& t) { return t.topic == "nobody.listens"; }));
+
+        client.stop();
+    }
+
+    BOOST_CHECK(eventually([&] { return hub.stats().connections_open == 0; }));
+    BOOST_CHECK_EQUAL(hub.stats().connections_accepted, 1u);
+
+    hub.stop();
+    io.join();
+}
+
+// The hub reports on "$SYS" topics, to its remote subscribers too
+BOOST_AUTO_TEST_CASE(test_metrics_sys_topics)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options options;
+    options.sys_interval = 50ms;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::mutex  mx;
+    std::string stats, topics;
+    msghublib::msghub client(io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.subscribe("$SYS.stats", [&](auto, auto body) {
+        std::lock_guard lk(mx);
+        stats.assign(body.begin(), body.end());
+    }));
+    BOOST_CHECK_NO_THROW(hub.subscribe("$SYS.topics", [&](auto, auto body) {
+        std::lock_guard lk(mx);
+        if (std::string(body.begin(), body.end()).find("\"busy\"") != std::string::npos)
+            topics.assign(body.begin(), body.end());
+    }));
+    BOOST_CHECK_NO_THROW(hub.subscribe("busy", [](auto...) {}));
+
+    for (int i = 0; i < 5; ++i)
+        BOOST_CHECK_NO_THROW(client.publish("busy", "message"));
+
+    BOOST_CHECK(eventually([&] {
+        std::lock_guard lk(mx);
+        return !stats.empty() && !topics.empty();
+    }));
+
+    {
+        std::lock_guard lk(mx); // not while stopping: reports keep coming
+        BOOST_TEST_MESSAGE(stats);
+        BOOST_TEST_MESSAGE(topics);
+        BOOST_CHECK(stats.find("\"connections_open\":1") != std::string::npos);
+        BOOST_CHECK(topics.find("{\"topic\":\"busy\",\"publications\":5,\"bytes\":35,\"subscribers\":1}") !=
+                    std::string::npos);
+    }
+
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
+// Past max_topics, new topics are refused, and counted; known ones work on
+BOOST_AUTO_TEST_CASE(test_metrics_max_topics)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::hub_options options;
+    options.max_topics = 3;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("known", [](auto...) {}));
+    BOOST_CHECK_NO_THROW(hub.retain("kept.>"));
+
+    std::atomic_int received{0}, refused{0};
+    msghublib::msghub client(io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.subscribe("kept.>", [&](auto...) { ++received; }));
+    BOOST_CHECK_NO_THROW(client.subscribe("remote", [&](auto...) { ++received; }));
+    BOOST_CHECK_NO_THROW(client.subscribe("refused", [&](auto...) { ++refused; }));
+    BOOST_CHECK(eventually([&] { return hub.stats().topics_refused == 1; }));
+    BOOST_CHECK_EQUAL(hub.stats().topics, 3u);
+
+    BOOST_CHECK_THROW(hub.subscribe("another", [](auto...) {}), boost::system::system_error);
+    BOOST_CHECK_NO_THROW(hub.subscribe("known", [](auto...) {}));
+
+    // fanned out by the pattern, not retained
+    BOOST_CHECK_NO_THROW(hub.publish("kept.one", "hello"));
+    BOOST_CHECK_NO_THROW(hub.publish("remote", "hello"));
+    BOOST_CHECK_NO_THROW(hub.publish("refused", "hello"));
+    BOOST_CHECK(eventually([&] { return received == 2; }));
+    BOOST_CHECK_EQUAL(refused, 0);
+    BOOST_CHECK_EQUAL(hub.stats().topics, 3u);
+    BOOST_CHECK_GE(hub.stats().topics_refused, 3u);
+
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,290 @@
+#include "msghub.h"
+#include "waiting.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    // A log directory of its own, removed afterwards
+    struct scratch_directory {
+        std::filesystem::path path = std::filesystem::temp_directory_path() /
+            ("msghub-log-" + std::to_string(::getpid()));
+
+        scratch_directory() { std::filesystem::remove_all(path); }
+        ~scratch_directory() { std::filesystem::remove_all(path); }
+    };
+
+    msghublib::hub_options logging_to(scratch_directory const& dir) {
+        msghublib::hub_options options;
+        options.log_directory    = dir.path.string();
+        options.log_segment_size = 4096; // a few records each, to span segments
+        return options;
+    }
+
+    using msghub_test::numbers;
+
+    std::vector<int> range(int from, int to) {
+        std::vector<int> v;
+        for (int i = from; i < to; ++i)
+            v.push_back(i);
+        return v;
+    }
+
+    void publish_range(msghublib::msghub& publisher, std::string const& topic, int from, int to) {
+        std::string const padding(100, ' '); // fills segments sooner
+        for (int i = from; i < to; ++i) {
+            auto const body = std::to_string(i) + padding;
+            BOOST_CHECK_NO_THROW(publisher.publish(topic, {body.data(), body.size()}));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_persist_needs_log)
+{
+    boost::asio::thread_pool io(1);
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    msghublib::error_code ec;
+    hub.persist("orders", ec);
+    BOOST_CHECK(ec == boost::asio::error::operation_not_supported);
+
+    hub.stop();
+    io.join();
+}
+
+// A client replays from a sequence number, then goes on live
+BOOST_AUTO_TEST_CASE(test_persist_replay)
+{
+    scratch_directory dir;
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), logging_to(dir));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("orders.>"));
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    publish_range(publisher, "orders.new", 0, 100);
+    publish_range(publisher, "other", 0, 10);
+    std::this_thread::sleep_for(200ms);
+
+    numbers got;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe_from("orders.new", got.handler(), 40));
+    std::this_thread::sleep_for(100ms);
+    publish_range(publisher, "orders.new", 100, 110);
+
+    BOOST_CHECK(got.until(109) == range(40, 110));
+
+    late.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// The log outlives the hub; replays go by sequence number or time
+BOOST_AUTO_TEST_CASE(test_persist_restart)
+{
+    scratch_directory dir;
+    std::chrono::system_clock::time_point between;
+    {
+        boost::asio::thread_pool io(2);
+        msghublib::msghub hub(io.get_executor(), logging_to(dir));
+        BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+        BOOST_CHECK_NO_THROW(hub.persist("orders"));
+
+        publish_range(hub, "orders", 0, 50);
+        std::this_thread::sleep_for(50ms);
+        between = std::chrono::system_clock::now();
+        std::this_thread::sleep_for(50ms);
+        publish_range(hub, "orders", 50, 100);
+
+        hub.stop();
+        io.join();
+    }
+
+    boost::asio::thread_pool io(2);
+    msghublib::msghub hub(io.get_executor(), logging_to(dir));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("orders"));
+    publish_range(hub, "orders", 100, 110); // sequence numbers go on
+
+    numbers all, since;
+    msghublib::msghub client(io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.subscribe_from("orders", all.handler(), 0));
+    BOOST_CHECK(all.until(109) == range(0, 110));
+
+    msghublib::msghub other(io.get_executor());
+    BOOST_CHECK_NO_THROW(other.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(other.subscribe_from("orders", since.handler(), between));
+    BOOST_CHECK(since.until(109) == range(50, 110));
+
+    other.stop();
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
+// Subscribing while the topic is published to, each publication arrives
+// once: replayed or live
+BOOST_AUTO_TEST_CASE(test_persist_while_publishing)
+{
+    scratch_directory dir;
+    boost::asio::thread_pool io(4);
+
+    msghublib::msghub hub(io.get_executor(), logging_to(dir));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("counter"));
+
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+
+    constexpr int n = 3000;
+    std::atomic_bool publishing{true};
+    std::thread feed([&] {
+        publish_range(publisher, "counter", 0, n);
+        publishing = false;
+    });
+
+    std::vector<std::unique_ptr<numbers>>           got;
+    std::vector<std::unique_ptr<msghublib::msghub>> subscribers;
+    while (publishing && subscribers.size() < 8) {
+        auto& r = *got.emplace_back(std::make_unique<numbers>());
+        auto& s = *subscribers.emplace_back(std::make_unique<msghublib::msghub>(io.get_executor()));
+        BOOST_CHECK_NO_THROW(s.connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(s.subscribe_from("counter", r.handler(), 0));
+        std::this_thread::sleep_for(5ms);
+    }
+    feed.join();
+
+    for (auto& r : got)
+        BOOST_CHECK(r->until(n - 1) == range(0, n));
+
+    for (auto& s : subscribers)
+        s->stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// A replay is paced by the subscriber's queue: a long one under tight queue
+// limits and drop_newest still arrives whole
+BOOST_AUTO_TEST_CASE(test_persist_replay_paced)
+{
+    scratch_directory dir;
+    boost::asio::thread_pool io(2);
+
+    auto options             = logging_to(dir);
+    options.max_queue_frames = 16;
+    options.slow_consumer    = msghublib::slow_consumer_policy::drop_newest;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("ticks"));
+
+    constexpr int n = 2000;
+    publish_range(hub, "ticks", 0, n);
+    std::this_thread::sleep_for(200ms);
+
+    numbers got;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe_from("ticks", got.handler(), 0));
+
+    BOOST_CHECK(got.until(n - 1) == range(0, n));
+    BOOST_CHECK_EQUAL(hub.stats().frames_dropped, 0u);
+
+    late.stop();
+    hub.stop();
+    io.join();
+}
+
+// Large publications wait for a replay like small ones
+BOOST_AUTO_TEST_CASE(test_persist_replay_large)
+{
+    scratch_directory dir;
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), logging_to(dir));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("ticks"));
+
+    constexpr int n = 20'000;
+    publish_range(hub, "ticks", 0, n);
+    std::this_thread::sleep_for(200ms);
+
+    numbers got;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe_from("ticks", got.handler(), 0));
+    std::this_thread::sleep_for(20ms); // subscribed, still replaying
+
+    auto const large = std::to_string(n) + std::string(64 * 1024, ' ');
+    BOOST_CHECK_NO_THROW(hub.publish("ticks", {large.data(), large.size()}));
+
+    BOOST_CHECK(got.until(n) == range(0, n + 1));
+
+    late.stop();
+    hub.stop();
+    io.join();
+}
+
+// Publishers, the hub's own and connections, keep up with a log whose
+// backlog is small rather than stall on it
+BOOST_AUTO_TEST_CASE(test_persist_small_backlog)
+{
+    scratch_directory dir;
+    boost::asio::thread_pool io(2);
+
+    auto options        = logging_to(dir);
+    options.log_backlog = 4;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.persist("ticks"));
+
+    numbers live;
+    msghublib::msghub subscriber(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("ticks", live.handler()));
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int n = 3000;
+    publish_range(hub, "ticks", 0, 500);
+    msghublib::msghub publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    publish_range(publisher, "ticks", 500, n);
+
+    BOOST_CHECK(live.until(n - 1) == range(0, n));
+    BOOST_CHECK_GT(hub.stats().publishers_paused, 0u);
+
+    numbers got;
+    msghublib::msghub late(io.get_executor());
+    BOOST_CHECK_NO_THROW(late.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(late.subscribe_from("ticks", got.handler(), 0));
+    BOOST_CHECK(got.until(n - 1) == range(0, n));
+
+    late.stop();
+    publisher.stop();
+    subscriber.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,210 @@
+#include "msghub.h"
+#include "rawclient.h"
+#include "waiting.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    msghublib::hub_options speaking(unsigned version) {
+        msghublib::hub_options options;
+        options.max_protocol_version = version;
+        return options;
+    }
+}
+
+// Version 1 and version 2 peers share a hub; version 2 frames only carry the
+// topic name the first time
+BOOST_AUTO_TEST_CASE(test_protocol_negotiation)
+{
+    boost::asio::thread_pool io(1);
+
+    constexpr int nmessages = 100;
+    std::string const topic = "prices.europe.currencies.EUR.USD.spot.mid";
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int received[2] = {};
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    msghublib::msghub v1(io.get_executor(), speaking(1)), v2(io.get_executor(), speaking(2));
+    int index = 0;
+    for (auto* peer : {&v1, &v2}) {
+        BOOST_CHECK_NO_THROW(peer->connect("localhost", 0xBEE));
+        BOOST_CHECK_NO_THROW(peer->subscribe(
+            topic, [&, i = index++](std::string_view t, msghublib::span<char const> message) {
+                std::lock_guard lk(mx);
+                BOOST_CHECK_EQUAL(t, topic);
+                BOOST_CHECK_EQUAL(std::string_view(message.data(), message.size()), "1.0842");
+                ++received[i];
+                cv.notify_one();
+            }));
+    }
+    std::this_thread::sleep_for(100ms); // negotiation and subscriptions
+
+    auto const v1_before  = v1.stats().bytes_written;
+    auto const v2_before  = v2.stats().bytes_written;
+    auto const hub_before = hub.stats().bytes_written;
+
+    for (int i = 0; i < nmessages; ++i) {
+        v1.publish(topic, "1.0842");
+        v2.publish(topic, "1.0842");
+    }
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] {
+            return received[0] == 2 * nmessages && received[1] == 2 * nmessages;
+        }));
+    }
+
+    auto const v1_bytes = v1.stats().bytes_written - v1_before;
+    auto const v2_bytes = v2.stats().bytes_written - v2_before;
+    BOOST_TEST_MESSAGE("v1: " << v1_bytes << " bytes, v2: " << v2_bytes << " bytes");
+    BOOST_CHECK_EQUAL(v1_bytes, nmessages * (7 + topic.size() + 6));
+    BOOST_CHECK_LT(3 * v2_bytes, v1_bytes);
+
+    // the hub fans everything out to both, but aliases for the v2 one
+    auto const hub_bytes = hub.stats().bytes_written - hub_before;
+    BOOST_TEST_MESSAGE("hub: " << hub_bytes << " bytes");
+    BOOST_CHECK_LT(hub_bytes, 2 * v1_bytes + 2 * v1_bytes / 3);
+
+    v1.stop();
+    v2.stop();
+    hub.stop();
+    io.join();
+}
+
+// A version 2 peer defines aliases in order: one that skips ahead, say to
+// make the hub keep a million of them, or sends an action there isn't, is
+// not read from anymore
+BOOST_AUTO_TEST_CASE(test_protocol_alias_density)
+{
+    boost::asio::thread_pool io(1);
+    using tcp = boost::asio::ip::tcp;
+    int constexpr publish = 2;
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::vector<std::string> received;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("topic", [&](std::string_view, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        received.emplace_back(message.data(), message.size());
+        cv.notify_one();
+    }));
+
+    boost::asio::io_context client_io;
+    tcp::socket sparse(client_io), unknown(client_io), dense(client_io);
+    for (auto* s : {&sparse, &unknown, &dense})
+        s->connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+
+    msghub_test::write_v2_defining(sparse, publish, (1u << 20) - 1, "topic", "sparse");
+    msghub_test::write_v2_defining(sparse, publish, 1, "topic", "after sparse");
+    msghub_test::write_v2_defining(unknown, 0x0E, 1, "topic", "unknown");
+    msghub_test::write_v2_defining(unknown, publish, 1, "topic", "after unknown");
+    msghub_test::write_v2_defining(dense, publish, 1, "topic", "dense");
+    msghub_test::write_v2_defining(dense, publish, 2, "topic", "dense again");
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return received.size() >= 2; }));
+    }
+    std::this_thread::sleep_for(100ms); // for any others
+    {
+        std::lock_guard lk(mx);
+        BOOST_CHECK((received == std::vector<std::string>{"dense", "dense again"}));
+    }
+
+    for (auto* s : {&sparse, &unknown, &dense})
+        s->close();
+    hub.stop();
+    io.join();
+}
+
+// A peer may not make the hub keep more than max_alias_bytes of topics for
+// its aliases: the frame that would is taken for corrupt
+BOOST_AUTO_TEST_CASE(test_protocol_alias_bytes)
+{
+    boost::asio::thread_pool io(1);
+    using tcp = boost::asio::ip::tcp;
+    int constexpr publish = 2;
+
+    std::mutex mx;
+    std::vector<std::string> received;
+
+    msghublib::hub_options options;
+    options.max_alias_bytes = 64;
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::string const first(40, 'a'), second(40, 'b');
+    for (auto& topic : {first, second})
+        BOOST_CHECK_NO_THROW(hub.subscribe(topic, [&](std::string_view, msghublib::span<char const> message) {
+            std::lock_guard lk(mx);
+            received.emplace_back(message.data(), message.size());
+        }));
+
+    boost::asio::io_context client_io;
+    tcp::socket greedy(client_io);
+    greedy.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    BOOST_CHECK(msghub_test::eventually([&] { return hub.stats().connections_open == 1; }));
+
+    msghub_test::write_v2_defining(greedy, publish, 1, first, "within");
+    msghub_test::write_v2_defining(greedy, publish, 1, second, "redefined");
+    msghub_test::write_v2_defining(greedy, publish, 2, first, "beyond");
+    BOOST_CHECK(msghub_test::eventually([&] { return hub.stats().connections_open == 0; }));
+    {
+        std::lock_guard lk(mx);
+        BOOST_CHECK((received == std::vector<std::string>{"within", "redefined"}));
+    }
+
+    greedy.close();
+    hub.stop();
+    io.join();
+}
+
+// A corrupt frame drops the connection at once, even from a subscriber
+// that doesn't read what the hub is still writing to it
+BOOST_AUTO_TEST_CASE(test_protocol_corrupt_closes)
+{
+    boost::asio::thread_pool io(1);
+    using tcp = boost::asio::ip::tcp;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    boost::asio::io_context client_io;
+    tcp::socket stalled(client_io);
+    stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    msghub_test::subscribe_without_reading(stalled, "flood");
+    BOOST_CHECK(msghub_test::eventually([&] { return hub.stats().subscriptions == 1; }));
+
+    std::string const body(4000, 'x');
+    for (int i = 0; i < 4000; ++i) // more than the socket buffers take
+        BOOST_CHECK_NO_THROW(hub.publish("flood", {body.data(), body.size()}));
+
+    msghub_test::write_v2_defining(stalled, 0x0E, 1, "flood", "no such action");
+    BOOST_CHECK(msghub_test::eventually([&] { return hub.stats().connections_open == 0; }));
+
+    stalled.close();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
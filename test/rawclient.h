@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+// Clients that speak the wire protocol by hand, for tests that need a peer
+// the library wouldn't make
+namespace msghub_test {
+
+    // Subscribes over a raw version 1 connection that is never read from
+    inline void subscribe_without_reading(boost::asio::ip::tcp::socket& s, std::string const& topic) {
+        char header[7];
+        std::uint16_t const topiclen = topic.size(), bodylen = 0, magic = 0xF00D ^ (0x1 << 8);
+        std::memcpy(header + 0, &topiclen, 2);
+        std::memcpy(header + 2, &bodylen, 2);
+        header[4] = 0; // subscribe
+        std::memcpy(header + 5, &magic, 2);
+
+        write(s, std::vector<boost::asio::const_buffer>{
+                     boost::asio::buffer(header), boost::asio::buffer(topic)});
+    }
+
+    // Writes a version 2 frame that defines `alias` as `topic`
+    inline void write_v2_defining(boost::asio::ip::tcp::socket& s, int action, std::uint32_t alias,
+                                  std::string const& topic, std::string const& body) {
+        std::vector<char> frame;
+        auto varint = [&](std::uint32_t value) {
+            do {
+                std::uint8_t b = value & 0x7F;
+                value >>= 7;
+                frame.push_back(static_cast<char>(value ? b | 0x80 : b));
+            } while (value);
+        };
+
+        std::uint16_t const magic = 0xF00D ^ (0x2 << 8);
+        frame.resize(2);
+        std::memcpy(frame.data(), &magic, 2);
+        frame.push_back(static_cast<char>(action | 0x80)); // define_topic
+        varint(alias);
+        varint(body.size());
+        varint(topic.size());
+        frame.insert(frame.end(), topic.begin(), topic.end());
+        frame.insert(frame.end(), body.begin(), body.end());
+
+        write(s, boost::asio::buffer(frame));
+    }
+
+    // Reads the next frame off a raw version 1 connection: its action,
+    // topic and body
+    struct raw_frame {
+        int         action;
+        std::string topic, body;
+    };
+    inline raw_frame read_frame(boost::asio::ip::tcp::socket& s) {
+        char header[7];
+        read(s, boost::asio::buffer(header));
+        std::uint16_t topiclen, bodylen;
+        std::memcpy(&topiclen, header + 0, 2);
+        std::memcpy(&bodylen, header + 2, 2);
+
+        raw_frame frame{header[4], std::string(topiclen, '\0'), std::string(bodylen, '\0')};
+        read(s, std::vector<boost::asio::mutable_buffer>{
+                    boost::asio::buffer(frame.topic), boost::asio::buffer(frame.body)});
+        return frame;
+    }
+
+}  // namespace msghub_test
@@ -0,0 +1,191 @@
+#include "msghub.h"
+#include "rawclient.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+    using boost::asio::ip::tcp;
+    using msghub_test::subscribe_without_reading;
+
+    msghublib::hub_options sharded(std::size_t shards) {
+        msghublib::hub_options options;
+        options.shards = shards;
+        return options;
+    }
+}
+
+// Publications from clients fan out on the shards of their topics, in
+// order per topic, to remote and local subscribers alike
+BOOST_AUTO_TEST_CASE(test_sharded_fan_out)
+{
+    boost::asio::thread_pool io(3);
+
+    constexpr int ntopics = 16, nmessages = 200;
+    std::vector<char> const large(100 * 1024, 'L');
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::map<std::string, int> next; // expected per topic
+    int total = 0, local = 0, larges = 0;
+
+    msghublib::msghub hub(io.get_executor(), sharded(4));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("shard.7", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++local;
+        cv.notify_all();
+    }));
+
+    msghublib::msghub subscriber(io.get_executor()), publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("shard.*", [&](std::string_view topic, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        if (message.size() == large.size()) {
+            ++larges;
+        } else {
+            auto& expected = next[std::string(topic)];
+            BOOST_CHECK_EQUAL(std::string(message.begin(), message.end()), std::to_string(expected));
+            ++expected;
+            ++total;
+        }
+        cv.notify_all();
+    }));
+    std::this_thread::sleep_for(100ms); // subscriptions
+
+    BOOST_CHECK_NO_THROW(publisher.publish("shard.3", large));
+    std::vector<std::string> topics, bodies;
+    for (int i = 0; i < nmessages; ++i) {
+        for (int t = 0; t < ntopics; ++t) {
+            topics.push_back("shard." + std::to_string(t));
+            bodies.push_back(std::to_string(i));
+        }
+        if (i % 2) {
+            std::vector<msghublib::message_view> batch;
+            for (std::size_t m = 0; m < topics.size(); ++m)
+                batch.emplace_back(topics[m], bodies[m]);
+            BOOST_CHECK_NO_THROW(publisher.publish_batch(batch));
+        } else {
+            for (std::size_t m = 0; m < topics.size(); ++m)
+                BOOST_CHECK_NO_THROW(publisher.publish(topics[m], bodies[m]));
+        }
+        topics.clear();
+        bodies.clear();
+    }
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 10s, [&] {
+            return total == ntopics * nmessages && local == nmessages && larges == 1;
+        }));
+    }
+
+    subscriber.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// Congested subscribers hold up publishers from the shards, too
+BOOST_AUTO_TEST_CASE(test_sharded_block_publisher)
+{
+    boost::asio::thread_pool io(2);
+
+    auto options = sharded(2);
+    options.max_queue_frames = 8;
+    options.slow_consumer    = msghublib::slow_consumer_policy::block_publisher;
+
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    tcp::socket stalled(io);
+    stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    subscribe_without_reading(stalled, "flood");
+
+    std::atomic_int received{0};
+    msghublib::msghub subscriber(io.get_executor()), publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("flood", [&](std::string_view, msghublib::span<char const>) {
+        ++received;
+    }));
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int nmessages = 10'000;
+    std::string const payload(4000, '*');
+    for (int i = 0; i < nmessages; ++i)
+        BOOST_CHECK_NO_THROW(publisher.publish("flood", payload));
+    std::this_thread::sleep_for(200ms);
+
+    BOOST_CHECK_LT(received, nmessages);
+    BOOST_CHECK_GT(hub.stats().publishers_paused, 0u);
+
+    // once the stalled subscriber is gone, everything arrives
+    stalled.close();
+    for (int i = 0; i < 50 && received < nmessages; ++i)
+        std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(received, nmessages);
+
+    subscriber.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+// A publisher the shards fall behind on is read from no further, until they
+// caught up
+BOOST_AUTO_TEST_CASE(test_sharded_backlog)
+{
+    boost::asio::thread_pool io(1); // reading and fanning out take turns
+
+    auto options = sharded(1);
+    options.shard_backlog = 16;
+
+    msghublib::msghub hub(io.get_executor(), options);
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    constexpr int nmessages = 10'000;
+    std::mutex mx;
+    std::condition_variable cv;
+    int expected = 0;
+
+    msghublib::msghub subscriber(io.get_executor()), publisher(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("backlog", [&](std::string_view, msghublib::span<char const> message) {
+        std::lock_guard lk(mx);
+        BOOST_CHECK_EQUAL(std::string(message.begin(), message.end()), std::to_string(expected));
+        ++expected;
+        cv.notify_all();
+    }));
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(100ms);
+
+    for (int i = 0; i < nmessages; ++i)
+        BOOST_CHECK_NO_THROW(publisher.publish("backlog", std::to_string(i)));
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 10s, [&] { return expected == nmessages; }));
+    }
+    BOOST_CHECK_GT(hub.stats().publishers_paused, 0u);
+
+    subscriber.stop();
+    publisher.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,200 @@
+#include "msghub.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    // Publishes through a hub, from and to clients on shared memory streams,
+    // small messages in order and a large one alongside them
+    void exchange(msghublib::hub_options const& options)
+    {
+        boost::asio::thread_pool io(2);
+
+        auto const path = std::filesystem::temp_directory_path() /
+            ("msghub-shm-" + std::to_string(::getpid()) + ".sock");
+
+        constexpr int nmessages = 5000;
+        std::vector<char> const large(256 * 1024 + 3, 'L');
+
+        std::mutex mx;
+        std::condition_variable cv;
+        int received = 0, expected = 0, larges = 0, on_socket = 0;
+
+        msghublib::msghub hub(io.get_executor(), options);
+        BOOST_CHECK_NO_THROW(hub.create("unix:" + path.string()));
+
+        msghublib::msghub subscriber(io.get_executor(), options), publisher(io.get_executor(), options),
+            plain(io.get_executor(), options);
+        BOOST_CHECK_NO_THROW(subscriber.connect("shm:" + path.string()));
+        BOOST_CHECK_NO_THROW(plain.connect("unix:" + path.string()));
+        auto connected = publisher.async_connect("shm:" + path.string(), boost::asio::use_future);
+        BOOST_REQUIRE(connected.wait_for(5s) == std::future_status::ready);
+        BOOST_CHECK_NO_THROW(connected.get());
+
+        BOOST_CHECK_NO_THROW(subscriber.subscribe("seq", [&](std::string_view, msghublib::span<char const> message) {
+            std::lock_guard lk(mx);
+            BOOST_CHECK_EQUAL(std::string(message.begin(), message.end()), std::to_string(expected));
+            ++expected;
+            ++received;
+            cv.notify_all();
+        }));
+        BOOST_CHECK_NO_THROW(subscriber.subscribe("large", [&](std::string_view, msghublib::span<char const> message) {
+            std::lock_guard lk(mx);
+            BOOST_CHECK(std::equal(message.begin(), message.end(), large.begin(), large.end()));
+            ++larges;
+            cv.notify_all();
+        }));
+        BOOST_CHECK_NO_THROW(plain.subscribe("seq", [&](std::string_view, msghublib::span<char const>) {
+            std::lock_guard lk(mx);
+            ++on_socket;
+            cv.notify_all();
+        }));
+        std::this_thread::sleep_for(100ms); // subscriptions
+
+        BOOST_CHECK_NO_THROW(publisher.publish("large", large));
+        for (int i = 0; i < nmessages; ++i)
+            BOOST_CHECK_NO_THROW(publisher.publish("seq", std::to_string(i)));
+
+        {
+            std::unique_lock lk(mx);
+            BOOST_CHECK(cv.wait_for(lk, 10s, [&] {
+                return received == nmessages && on_socket == nmessages && larges == 1;
+            }));
+        }
+
+        subscriber.stop();
+        publisher.stop();
+        plain.stop();
+        hub.stop();
+        io.join();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_memory)
+{
+    msghublib::hub_options options;
+    options.shm_ring_size = 64 * 1024; // wraps around, and fills up
+    exchange(options);
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_memory_busy_poll)
+{
+    msghublib::hub_options options;
+    options.shm_busy_poll = 50us;
+    exchange(options);
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_memory_small_ring)
+{
+    boost::asio::thread_pool io(2);
+
+    auto const path = std::filesystem::temp_directory_path() /
+        ("msghub-shm-" + std::to_string(::getpid()) + ".sock");
+
+    msghublib::msghub hub(io.get_executor()); // reads 64K at a time
+    BOOST_CHECK_NO_THROW(hub.create("unix:" + path.string()));
+
+    msghublib::hub_options small;
+    small.read_buffer_size = 4096;
+    small.shm_ring_size    = 4096;
+    msghublib::msghub refused(io.get_executor(), small), accepted(io.get_executor());
+    BOOST_CHECK_NO_THROW(refused.connect("shm:" + path.string()));
+    BOOST_CHECK_NO_THROW(accepted.connect("shm:" + path.string()));
+
+    std::atomic_int received{0};
+    for (auto* client : {&refused, &accepted})
+        BOOST_CHECK_NO_THROW(client->subscribe("t", [&, client](std::string_view, msghublib::span<char const>) {
+            BOOST_CHECK(client == &accepted);
+            ++received;
+        }));
+    std::this_thread::sleep_for(100ms); // subscriptions
+
+    BOOST_CHECK_NO_THROW(hub.publish("t", "hello"));
+    std::this_thread::sleep_for(200ms);
+    BOOST_CHECK_EQUAL(received.load(), 1);
+
+    refused.stop();
+    accepted.stop();
+    hub.stop();
+    io.join();
+}
+
+// The hub maps no region the client could shrink under it afterwards
+BOOST_AUTO_TEST_CASE(test_shared_memory_unsealed)
+{
+    boost::asio::thread_pool io(1);
+
+    auto const path = std::filesystem::temp_directory_path() /
+        ("msghub-shm-" + std::to_string(::getpid()) + ".sock");
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create("unix:" + path.string()));
+
+    boost::asio::io_context client_io;
+    boost::asio::local::stream_protocol::socket client(client_io);
+    client.connect(path.string());
+
+    // a transport frame for 128K rings, handing over an unsealed memfd
+    std::uint32_t const ring_size = 128 * 1024;
+    int const fds[] = {::memfd_create("unsealed", MFD_CLOEXEC), ::eventfd(0, EFD_CLOEXEC),
+                       ::eventfd(0, EFD_CLOEXEC)};
+    BOOST_REQUIRE_EQUAL(::ftruncate(fds[0], 4 * ring_size), 0);
+
+    char frame[7 + 3];
+    std::uint16_t const topiclen = 0, bodylen = 3, magic = 0xF00D ^ (0x1 << 8);
+    std::memcpy(frame + 0, &topiclen, 2);
+    std::memcpy(frame + 2, &bodylen, 2);
+    frame[4] = 8; // transport
+    std::memcpy(frame + 5, &magic, 2);
+    frame[7] = char(0x80), frame[8] = char(0x80), frame[9] = 0x08; // varint 128K
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec  iov{frame, sizeof(frame)};
+    msghdr msg{};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    auto* cmsg         = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    BOOST_REQUIRE_EQUAL(::sendmsg(client.native_handle(), &msg, 0), ssize_t(sizeof(frame)));
+
+    // hung up on, rather than left to truncate the region
+    timeval const patience{5, 0};
+    ::setsockopt(client.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &patience, sizeof(patience));
+    char byte;
+    boost::system::error_code ec;
+    client.read_some(boost::asio::buffer(&byte, 1), ec);
+    BOOST_CHECK(ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset);
+
+    for (int fd : fds)
+        ::close(fd);
+    client.close();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+#include "msghub.h"
+#include "rawclient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+    using boost::asio::ip::tcp;
+    using msghub_test::read_frame;
+    using msghub_test::subscribe_without_reading;
+
+    constexpr std::size_t queue_limit = 8;
+
+    msghublib::hub_options bounded(msghublib::slow_consumer_policy policy) {
+        msghublib::hub_options options;
+        options.max_queue_frames = queue_limit;
+        options.slow_consumer    = policy;
+        return options;
+    }
+
+    // Publishes far more than the socket buffers can hold
+    msghublib::hub_stats flood(msghublib::slow_consumer_policy policy) {
+        boost::asio::thread_pool io(1);
+
+        msghublib::msghub hub(io.get_executor(), bounded(policy));
+        BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+        tcp::socket stalled(io);
+        stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+        subscribe_without_reading(stalled, "flood");
+        std::this_thread::sleep_for(100ms);
+
+        std::string const payload(4000, '*');
+        for (int i = 0; i < 5000; ++i)
+            hub.publish("flood", payload);
+        std::this_thread::sleep_for(100ms);
+
+        auto stats = hub.stats();
+        stalled.close(); // the hub doesn't hang up on its clients
+        hub.stop();
+        io.join();
+        return stats;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_consumer_drop_newest)
+{
+    auto stats = flood(msghublib::slow_consumer_policy::drop_newest);
+
+    BOOST_TEST_MESSAGE("dropped " << stats.frames_dropped << " frames");
+    BOOST_CHECK_GT(stats.frames_dropped, 0u);
+    BOOST_CHECK_EQUAL(stats.consumers_disconnected, 0u);
+    BOOST_CHECK_LE(stats.queue_high_water_frames, queue_limit);
+}
+
+// The frames queued last are the ones that survive: once the consumer
+// reads on, the publications arrive in order, ending in the newest, with no
+// more than a queue's worth after the frames dropped
+BOOST_AUTO_TEST_CASE(test_slow_consumer_drop_oldest)
+{
+    boost::asio::thread_pool io(1);
+
+    msghublib::msghub hub(io.get_executor(), bounded(msghublib::slow_consumer_policy::drop_oldest));
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    tcp::socket stalled(io);
+    stalled.connect({boost::asio::ip::address_v4::loopback(), 0xBEE});
+    subscribe_without_reading(stalled, "flood");
+    std::this_thread::sleep_for(100ms);
+
+    constexpr int n = 5000;
+    std::string const padding(4000, ' ');
+    for (int i = 0; i < n; ++i)
+        hub.publish("flood", std::to_string(i) + padding);
+    std::this_thread::sleep_for(100ms);
+
+    timeval const patience{5, 0}; // rather than hang, should the newest not come
+    ::setsockopt(stalled.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &patience, sizeof(patience));
+    std::vector<int> received;
+    try {
+        while (received.empty() || received.back() != n - 1) {
+            auto frame = read_frame(stalled);
+            if (frame.topic == "flood")
+                received.push_back(std::stoi(frame.body));
+        }
+    } catch (boost::system::system_error const& e) {
+        BOOST_ERROR("the newest publication didn't arrive: " << e.what());
+    }
+
+    BOOST_TEST_MESSAGE("received " << received.size() << " of " << n);
+    BOOST_CHECK_LT(received.size(), std::size_t(n));
+    BOOST_CHECK(std::is_sorted(received.begin(), received.end()));
+
+    auto const gap = std::adjacent_find(received.rbegin(), received.rend(),
+                                        [](int later, int earlier) { return later != earlier + 1; });
+    BOOST_CHECK(gap != received.rend());
+    BOOST_CHECK_LE(std::distance(received.rbegin(), gap), std::ptrdiff_t(queue_limit));
+
+    BOOST_CHECK_GT(hub.stats().frames_dropped, 0u);
+    BOOST_CHECK_EQUAL(hub.stats().consumers_disconnected, 0u);
+
+    stalled.close();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_consumer_disconnect)
+{
+    auto stats = flood(msghublib::slow_consumer_policy::disconnect);
+
+    BOOST_CHECK_EQUAL(stats.consumers_disconnected, 1u);
+    BOOST_CHECK_LE(stats.queue_high_water_frames, queue_limit);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
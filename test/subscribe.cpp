@@ -1,7 +1,10 @@
 #include "msghub.h"
+#include "waiting.h"
 
 #include <boost/test/tools/old/interface.hpp>
 #include <hub_error.h>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <condition_variable> 
 
@@ -57,4 +60,54 @@ BOOST_AUTO_TEST_CASE(test_subscribe)
     BOOST_CHECK(goodmessage);
 }
 
+// Handlers go with the hub, even from threads that read its subscriptions
+// and live on
+BOOST_AUTO_TEST_CASE(test_subscribe_handler_released)
+{
+    boost::asio::thread_pool io(1);
+
+    auto captured = std::make_shared<int>(0);
+    std::weak_ptr<int> const watch = captured;
+    {
+        msghublib::msghub hub(io.get_executor());
+        BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+        BOOST_CHECK_NO_THROW(hub.subscribe("released", [captured](auto...) {}));
+        captured.reset();
+        BOOST_CHECK_NO_THROW(hub.publish("released", "hello")); // reads them on this thread
+        hub.stop();
+    }
+    BOOST_CHECK(msghub_test::eventually([&] { return watch.expired(); })); // once the io thread let go
+
+    io.join();
+}
+
+// Unsubscribing lets go of the handler while the hub runs on, even if the
+// threads that read the subscriptions with it don't read them again
+BOOST_AUTO_TEST_CASE(test_unsubscribe_handler_released)
+{
+    boost::asio::thread_pool io(1);
+
+    std::atomic_int delivered{0};
+    auto captured = std::make_shared<int>(0);
+    std::weak_ptr<int> const watch = captured;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("released", [&delivered, captured](auto...) { ++delivered; }));
+    captured.reset();
+
+    msghublib::msghub client(io.get_executor());
+    BOOST_CHECK_NO_THROW(client.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(client.publish("released", "from the io thread"));
+    BOOST_CHECK_NO_THROW(hub.publish("released", "from this one"));
+    BOOST_CHECK(msghub_test::eventually([&] { return delivered == 2; }));
+
+    BOOST_CHECK_NO_THROW(hub.unsubscribe("released"));
+    BOOST_CHECK(msghub_test::eventually([&] { return watch.expired(); }));
+
+    client.stop();
+    hub.stop();
+    io.join();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+#include "msghub.h"
+#include "waiting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+
+    msghublib::hub_options traced() {
+        msghublib::hub_options options;
+        options.trace_latency = true;
+        return options;
+    }
+
+    msghublib::topic_latency latency_of(msghublib::msghub const& hub, std::string const& topic) {
+        auto const all = hub.latency_by_topic();
+        auto it = std::find_if(all.begin(), all.end(), [&](auto const& t) { return t.topic == topic; });
+        return it == all.end() ? msghublib::topic_latency{} : *it;
+    }
+
+    using msghub_test::eventually;
+}
+
+// Publications through the hub are timed at every stage, for the
+// subscribers on a client and on the hub alike
+BOOST_AUTO_TEST_CASE(test_tracing)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), traced());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::atomic_int received{0}, local{0};
+    BOOST_CHECK_NO_THROW(hub.subscribe("traced", [&](auto...) { ++local; }));
+
+    msghublib::msghub subscriber(io.get_executor(), traced());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("traced", [&](auto...) {
+        std::this_thread::sleep_for(1ms);
+        ++received;
+    }));
+
+    msghublib::msghub publisher(io.get_executor(), traced());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(200ms); // subscriptions, hellos
+
+    for (int i = 0; i < 10; ++i)
+        BOOST_CHECK_NO_THROW(publisher.publish("traced", "message"));
+    std::vector<msghublib::message_view> const batch(5, {"traced", msghublib::span<char const>("batched", 7)});
+    BOOST_CHECK_NO_THROW(publisher.publish_batch(batch));
+
+    BOOST_CHECK(eventually([&] { return received == 15 && local == 15; }));
+    // recorded as the callbacks return
+    BOOST_CHECK(eventually([&] {
+        return latency_of(subscriber, "traced").handler.count == 15 &&
+            latency_of(hub, "traced").handler.count == 15;
+    }));
+
+    auto const remote = latency_of(subscriber, "traced");
+    BOOST_CHECK_EQUAL(remote.to_hub.count, 15u);
+    BOOST_CHECK_EQUAL(remote.in_hub.count, 15u);
+    BOOST_CHECK_EQUAL(remote.from_hub.count, 15u);
+    BOOST_CHECK_EQUAL(remote.handler.count, 15u);
+    BOOST_CHECK_GE(remote.handler.p50, 1'000'000u); // sleeps 1ms
+    BOOST_CHECK_LE(remote.handler.p50, remote.handler.max);
+
+    auto const own = latency_of(hub, "traced");
+    BOOST_CHECK_EQUAL(own.to_hub.count, 15u);
+    BOOST_CHECK_EQUAL(own.in_hub.count, 15u);
+    BOOST_CHECK_EQUAL(own.from_hub.count, 0u); // no connection in between
+    BOOST_CHECK_EQUAL(own.handler.count, 15u);
+
+    BOOST_CHECK(publisher.latency_by_topic().empty());
+
+    publisher.stop();
+    subscriber.stop();
+    hub.stop();
+    io.join();
+}
+
+// Unless both ends of a connection trace, publications travel untraced
+BOOST_AUTO_TEST_CASE(test_tracing_negotiated)
+{
+    boost::asio::thread_pool io(2);
+
+    msghublib::msghub hub(io.get_executor(), traced());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+
+    std::atomic_int received{0};
+    msghublib::msghub subscriber(io.get_executor());
+    BOOST_CHECK_NO_THROW(subscriber.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(subscriber.subscribe("traced", [&](auto...) { ++received; }));
+
+    msghublib::msghub publisher(io.get_executor(), traced());
+    BOOST_CHECK_NO_THROW(publisher.connect("localhost", 0xBEE));
+    std::this_thread::sleep_for(200ms);
+
+    for (int i = 0; i < 10; ++i)
+        BOOST_CHECK_NO_THROW(publisher.publish("traced", "message"));
+    BOOST_CHECK(eventually([&] { return received == 10; }));
+
+    BOOST_CHECK(subscriber.latency_by_topic().empty());
+
+    publisher.stop();
+    subscriber.stop();
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
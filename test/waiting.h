@@ -0,0 +1,52 @@
+#pragma once
+
+#include "msghub.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// For tests that wait for what the hub delivers asynchronously
+namespace msghub_test {
+
+    // Whether `pred` holds, polling it for up to 5 seconds
+    template <typename Pred> bool eventually(Pred pred) {
+        for (int i = 0; i < 50 && !pred(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return pred();
+    }
+
+    // The numbers a subscriber received, in order
+    struct numbers {
+        std::mutex       mx;
+        std::vector<int> received;
+
+        void add(msghublib::span<char const> body) {
+            std::lock_guard lk(mx);
+            received.push_back(std::stoi(std::string(body.begin(), body.end())));
+        }
+
+        msghublib::msghub::onmessage handler() {
+            return [this](std::string_view, msghublib::span<char const> body) { add(body); };
+        }
+
+        std::vector<int> get() {
+            std::lock_guard lk(mx);
+            return received;
+        }
+
+        // Waits for `last` to arrive, for up to 5 seconds
+        std::vector<int> until(int last) {
+            for (int i = 0; i < 100; ++i) {
+                auto got = get();
+                if (!got.empty() && got.back() == last)
+                    return got;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            return get();
+        }
+    };
+
+}  // namespace msghub_test
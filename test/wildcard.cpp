@@ -0,0 +1,120 @@
+#include "msghub.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(message_hub)
+
+namespace {
+    using namespace std::chrono_literals;
+}
+
+// '*' matches one segment, a trailing '>' one or more; a publication
+// matching several subscriptions reaches each of them once
+BOOST_AUTO_TEST_CASE(test_wildcard_subscriptions)
+{
+    boost::asio::thread_pool io(1);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::map<std::string, int> received; // by subscription
+    int total = 0;
+
+    auto counting = [&](std::string subscription) {
+        return [&, subscription](std::string_view, msghublib::span<char const>) {
+            std::lock_guard lk(mx);
+            ++received[subscription];
+            ++total;
+            cv.notify_all();
+        };
+    };
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("prices.*.USD", counting("hub prices.*.USD")));
+
+    msghublib::msghub remote(io.get_executor());
+    BOOST_CHECK_NO_THROW(remote.connect("localhost", 0xBEE));
+    BOOST_CHECK_NO_THROW(remote.subscribe("prices.>", counting("remote prices.>")));
+    BOOST_CHECK_NO_THROW(remote.subscribe("prices.EUR.*", counting("remote prices.EUR.*")));
+    BOOST_CHECK_NO_THROW(remote.subscribe("prices.EUR.USD", counting("remote prices.EUR.USD")));
+    std::this_thread::sleep_for(100ms); // let the subscriptions reach the hub
+
+    for (auto topic : {"prices.EUR.USD", "prices.EUR.GBP", "prices.GBP.USD",
+                       "prices.EUR.USD.bid", "prices", "news.EUR.USD"})
+        BOOST_CHECK_NO_THROW(hub.publish(topic, "1.0842"));
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 1s, [&] { return total == 9; }));
+        lk.unlock();
+        std::this_thread::sleep_for(100ms); // nothing more should arrive
+        lk.lock();
+        BOOST_CHECK_EQUAL(total, 9);
+
+        BOOST_CHECK_EQUAL(received["hub prices.*.USD"], 2);       // EUR.USD, GBP.USD
+        BOOST_CHECK_EQUAL(received["remote prices.>"], 4);        // all but prices, news
+        BOOST_CHECK_EQUAL(received["remote prices.EUR.*"], 2);    // EUR.USD, EUR.GBP
+        BOOST_CHECK_EQUAL(received["remote prices.EUR.USD"], 1);
+    }
+
+    // the patterns no longer match once unsubscribed
+    BOOST_CHECK_NO_THROW(remote.unsubscribe("prices.>"));
+    BOOST_CHECK_NO_THROW(hub.unsubscribe("prices.*.USD"));
+    std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_NO_THROW(hub.publish("prices.GBP.USD", "1.2701"));
+    BOOST_CHECK_NO_THROW(hub.publish("prices.EUR.GBP", "0.8537"));
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 1s, [&] { return total == 10; }));
+        lk.unlock();
+        std::this_thread::sleep_for(100ms);
+        lk.lock();
+        BOOST_CHECK_EQUAL(total, 10);
+        BOOST_CHECK_EQUAL(received["remote prices.EUR.*"], 3);
+    }
+
+    remote.stop();
+    hub.stop();
+    io.join();
+}
+
+// topics only a wildcard takes are routed without an entry of their own, so
+// a high-cardinality namespace doesn't grow the hub's topic table
+BOOST_AUTO_TEST_CASE(test_wildcard_topics_not_interned)
+{
+    boost::asio::thread_pool io(1);
+
+    std::mutex mx;
+    std::condition_variable cv;
+    int total = 0;
+
+    msghublib::msghub hub(io.get_executor());
+    BOOST_CHECK_NO_THROW(hub.create(0xBEE));
+    BOOST_CHECK_NO_THROW(hub.subscribe("ticks.>", [&](std::string_view, msghublib::span<char const>) {
+        std::lock_guard lk(mx);
+        ++total;
+        cv.notify_all();
+    }));
+
+    for (int i = 0; i < 1000; ++i)
+        BOOST_CHECK_NO_THROW(hub.publish("ticks." + std::to_string(i), "x"));
+
+    {
+        std::unique_lock lk(mx);
+        BOOST_CHECK(cv.wait_for(lk, 5s, [&] { return total == 1000; }));
+    }
+    BOOST_CHECK_LE(hub.stats_by_topic().size(), 1u);
+
+    hub.stop();
+    io.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()